@@ -0,0 +1,774 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "aot.h"
+#include "array.h"
+#include "diagnostics.h"
+#include "resolver.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
+
+// Declarations and helpers every generated translation unit starts with. Arithmetic wraps through uint32_t like the
+// VM's ints do on every target, signed overflow would be undefined in C
+static const char* cPrelude = R"(#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define HLANG_EXPORT __declspec(dllexport)
+#else
+#define HLANG_EXPORT __attribute__((visibility("default")))
+#endif
+
+typedef int32_t HInt;
+typedef bool HBool;
+
+#define HL_ADD(a, b) ((HInt)((uint32_t)(a) + (uint32_t)(b)))
+#define HL_SUB(a, b) ((HInt)((uint32_t)(a) - (uint32_t)(b)))
+#define HL_MUL(a, b) ((HInt)((uint32_t)(a) * (uint32_t)(b)))
+/* b is not 0, INT_MIN / -1 traps where the runtime gives the wrapped negation */
+#define HL_DIV(a, b) ((b) == -1 ? HL_SUB(0, a) : (a) / (b))
+
+static jmp_buf hl_failure;
+static const char* hl_error;
+
+static void hl_fail(const char* message) {
+    hl_error = message;
+    longjmp(hl_failure, 1);
+}
+
+static HInt hl_div(HInt a, HInt b) {
+    if(b == 0) hl_fail("Division by zero");
+    return HL_DIV(a, b);
+}
+
+/* Typed arrays like array.h has them, plain loops the C compiler is left to vectorize. Handles are given out and
+   temporaries reused and freed exactly like the runtime does it, handle 0 is the empty array. Operand flags: 1 an array,
+   2 a temporary. Everything is freed when hlang_run starts again */
+typedef struct {
+    HInt* data;
+    uint32_t length;
+    bool boolean;
+} HlArray;
+
+static HlArray hl_empty_array;
+static HlArray* hl_arrays;
+static uint32_t hl_array_count = 1;
+static uint32_t hl_array_capacity;
+static size_t hl_array_bytes;
+static char hl_message[96];
+
+static void hl_free_arrays(void) {
+    for(uint32_t i = 1; i < hl_array_count; i++) free(hl_arrays[i].data);
+    hl_array_count = 1;
+    hl_array_bytes = 0;
+}
+
+static size_t hl_buffer_bytes(uint32_t length) {
+    return ((size_t)length * sizeof(HInt) + 63) & ~(size_t)63;
+}
+
+static HlArray* hl_array(HInt handle) {
+    if(handle == 0) return &hl_empty_array;
+    if((uint32_t)handle >= hl_array_count) {
+        snprintf(hl_message, sizeof(hl_message), "Invalid array %d", handle);
+        hl_fail(hl_message);
+    }
+    return &hl_arrays[handle];
+}
+
+/* Elements are left uninitialized */
+static HInt hl_array_alloc(uint32_t length, bool boolean) {
+    if(length == 0) return 0;
+    size_t bytes = hl_buffer_bytes(length);
+    if(hl_array_bytes + bytes > ((size_t)1 << 30)) hl_fail("Out of memory for arrays");
+    if(hl_array_count == hl_array_capacity || !hl_arrays) {
+        uint32_t capacity = hl_array_capacity ? hl_array_capacity * 2 : 64;
+        HlArray* arrays = (HlArray*)realloc(hl_arrays, capacity * sizeof(HlArray));
+        if(!arrays) hl_fail("Out of memory for arrays");
+        hl_arrays = arrays;
+        hl_array_capacity = capacity;
+    }
+    HInt* data = (HInt*)malloc(bytes);
+    if(!data) hl_fail("Out of memory for arrays");
+    hl_arrays[hl_array_count].data = data;
+    hl_arrays[hl_array_count].length = length;
+    hl_arrays[hl_array_count].boolean = boolean;
+    hl_array_bytes += bytes;
+    return (HInt)hl_array_count++;
+}
+
+static void hl_release(HInt array) {
+    if(array == 0) return;
+    hl_array_bytes -= hl_buffer_bytes(hl_arrays[array].length);
+    free(hl_arrays[array].data);
+    hl_arrays[array].data = NULL;
+    hl_arrays[array].length = 0;
+    while(hl_array_count > 1 && !hl_arrays[hl_array_count - 1].data) hl_array_count--;
+}
+
+/* The first temporary operand is written over */
+static HInt hl_result(uint32_t length, bool boolean, const HInt* arrays, const int* flags, int count) {
+    for(int i = 0; i < count; i++) {
+        if(flags[i] & 2) {
+            hl_arrays[arrays[i]].boolean = boolean;
+            return arrays[i];
+        }
+    }
+    return hl_array_alloc(length, boolean);
+}
+
+static void hl_release_operands(HInt result, const HInt* arrays, const int* flags, int count) {
+    for(int i = 0; i < count; i++) {
+        if((flags[i] & 2) && arrays[i] != result) hl_release(arrays[i]);
+    }
+}
+
+static HInt hl_array_new(HInt length, bool boolean) {
+    if(length < 0) {
+        snprintf(hl_message, sizeof(hl_message), "Negative array length %d", length);
+        hl_fail(hl_message);
+    }
+    HInt array = hl_array_alloc((uint32_t)length, boolean);
+    if(length > 0) memset(hl_arrays[array].data, 0, (size_t)length * sizeof(HInt));
+    return array;
+}
+
+/* Reductions use up a temporary argument */
+static HInt hl_used(HInt array, int flags, HInt result) {
+    if(flags & 2) hl_release(array);
+    return result;
+}
+
+static HInt hl_len(HInt array, int flags) {
+    return hl_used(array, flags, (HInt)hl_array(array)->length);
+}
+
+static HlArray* hl_element(HInt array, HInt index) {
+    HlArray* object = hl_array(array);
+    if((uint32_t)index >= object->length) {
+        snprintf(hl_message, sizeof(hl_message), "Index %d is out of bounds for an array of length %u", index, object->length);
+        hl_fail(hl_message);
+    }
+    return object;
+}
+
+static HInt hl_get(HInt array, HInt index) {
+    return hl_element(array, index)->data[index];
+}
+
+static void hl_set(HInt array, HInt index, HInt value) {
+    HlArray* object = hl_element(array, index);
+    object->data[index] = object->boolean ? value != 0 : value;
+}
+
+/* Length of an element wise result, every array operand has to have it */
+static uint32_t hl_element_count(HInt first, bool firstArray, HInt second, bool secondArray) {
+    uint32_t length = hl_array(firstArray ? first : second)->length;
+    if(firstArray && secondArray && hl_array(second)->length != length) {
+        snprintf(hl_message, sizeof(hl_message), "Arrays of length %u and %u do not match", length, hl_array(second)->length);
+        hl_fail(hl_message);
+    }
+    return length;
+}
+
+#define HL_ELEMENTS(expression) for(uint32_t i = 0; i < length; i++) { \
+        HInt a = leftArray ? left[i] : leftValue; \
+        HInt b = rightArray ? right[i] : rightValue; \
+        out[i] = (expression); \
+    } break;
+
+/* op counts from add in the order of the operators: add, mul, div, sub, ==, <=, >=, <, >, != */
+static HInt hl_array_op(int op, HInt leftValue, int leftFlags, HInt rightValue, int rightFlags) {
+    bool leftArray = leftFlags & 1;
+    bool rightArray = rightFlags & 1;
+    uint32_t length = hl_element_count(leftValue, leftArray, rightValue, rightArray);
+    if(op == 2) {
+        for(uint32_t i = 0; i < (rightArray ? length : 1); i++) {
+            if((rightArray ? hl_arrays[rightValue].data[i] : rightValue) == 0) hl_fail("Division by zero");
+        }
+    }
+    HInt operands[2] = {leftValue, rightValue};
+    int flags[2] = {leftFlags, rightFlags};
+    HInt result = hl_result(length, op >= 4, operands, flags, 2);
+    if(length == 0) return result;
+    const HInt* left = leftArray ? hl_arrays[leftValue].data : NULL;
+    const HInt* right = rightArray ? hl_arrays[rightValue].data : NULL;
+    HInt* out = hl_arrays[result].data;
+    switch(op) {
+        case 0: HL_ELEMENTS(HL_ADD(a, b))
+        case 1: HL_ELEMENTS(HL_MUL(a, b))
+        case 2: HL_ELEMENTS(HL_DIV(a, b))
+        case 3: HL_ELEMENTS(HL_SUB(a, b))
+        case 4: HL_ELEMENTS(a == b)
+        case 5: HL_ELEMENTS(a <= b)
+        case 6: HL_ELEMENTS(a >= b)
+        case 7: HL_ELEMENTS(a < b)
+        case 8: HL_ELEMENTS(a > b)
+        default: HL_ELEMENTS(a != b)
+    }
+    hl_release_operands(result, operands, flags, 2);
+    return result;
+}
+
+static HInt hl_sum(HInt array, int flags) {
+    HlArray* object = hl_array(array);
+    uint32_t sum = 0;
+    for(uint32_t i = 0; i < object->length; i++) sum += (uint32_t)object->data[i];
+    return hl_used(array, flags, (HInt)sum);
+}
+
+static HInt hl_min(HInt array, int flags) {
+    HlArray* object = hl_array(array);
+    if(object->length == 0) hl_fail("min of an empty array");
+    HInt result = object->data[0];
+    for(uint32_t i = 1; i < object->length; i++) result = object->data[i] < result ? object->data[i] : result;
+    return hl_used(array, flags, result);
+}
+
+static HInt hl_max(HInt array, int flags) {
+    HlArray* object = hl_array(array);
+    if(object->length == 0) hl_fail("max of an empty array");
+    HInt result = object->data[0];
+    for(uint32_t i = 1; i < object->length; i++) result = object->data[i] > result ? object->data[i] : result;
+    return hl_used(array, flags, result);
+}
+
+static HInt hl_select(HInt mask, int maskFlags, HInt whenTrue, int trueFlags, HInt whenFalse, int falseFlags) {
+    bool trueArray = trueFlags & 1;
+    bool falseArray = falseFlags & 1;
+    uint32_t length = hl_array(mask)->length;
+    if(trueArray || falseArray) {
+        uint32_t valueLength = hl_element_count(whenTrue, trueArray, whenFalse, falseArray);
+        if(valueLength != length) {
+            snprintf(hl_message, sizeof(hl_message), "Arrays of length %u and %u do not match", length, valueLength);
+            hl_fail(hl_message);
+        }
+    }
+    bool boolean = trueArray && falseArray && hl_array(whenTrue)->boolean && hl_array(whenFalse)->boolean;
+    HInt operands[3] = {mask, whenTrue, whenFalse};
+    int flags[3] = {maskFlags, trueFlags, falseFlags};
+    HInt result = hl_result(length, boolean, operands, flags, 3);
+    if(length == 0) return result;
+    const HInt* condition = hl_arrays[mask].data;
+    HInt* out = hl_arrays[result].data;
+    for(uint32_t i = 0; i < length; i++) {
+        HInt a = trueArray ? hl_arrays[whenTrue].data[i] : whenTrue;
+        HInt b = falseArray ? hl_arrays[whenFalse].data[i] : whenFalse;
+        out[i] = condition[i] != 0 ? a : b;
+    }
+    hl_release_operands(result, operands, flags, 3);
+    return result;
+}
+
+)";
+
+// Void functions return an HInt as well, the VM gives 0 for their calls unless they return a value anyway
+static const char* c_type(DataType type) {
+    return type == DataType::BOOL ? "HBool" : "HInt";
+}
+
+// Lowers one function at a time. Expressions become C expressions, operands that have to be evaluated before a call
+// to their right are moved into temporaries first because C leaves the order of operands and arguments open
+class CGenerator {
+public:
+    CGenerator(const AstArena& ast, const std::unordered_map<SymbolId, uint32_t>& functionIndices,
+               const std::vector<NodeRef<FunctionDeclarationNode>>& functions, const std::vector<DataType>& globalTypes)
+        : ast(ast), functionIndices(functionIndices), functions(functions), globalTypes(globalTypes) {}
+
+    std::string out;
+
+    void prototype(uint32_t index) {
+        auto& function = ast[functions[index]];
+        out += "static ";
+        out += c_type(function.returnType);
+        out += " " + functionName(index) + "(";
+        auto params = ast[function.paramDeclarations];
+        if(params.size() == 0) out += "void";
+        for(uint32_t i = 0; i < params.size(); i++) {
+            auto& param = ast[params[i]];
+            if(i > 0) out += ", ";
+            out += c_type(param.dataType);
+            out += " " + variable(param.slot);
+        }
+        out += ")";
+    }
+
+    void function(uint32_t index) {
+        auto& declaration = ast[functions[index]];
+        isTopLevel = false;
+        temporaries = 0;
+        prototype(index);
+        out += " {\n";
+        indent = 1;
+        statements(declaration.functionBlock);
+        // Falling off the end returns 0 like the VM's implicit return
+        line("return 0;");
+        out += "}\n\n";
+    }
+
+    void topLevel(NodeRef<BlockNode> block) {
+        isTopLevel = true;
+        temporaries = 0;
+        out += "HLANG_EXPORT const char* hlang_run(void) {\n";
+        indent = 1;
+        line("memset(hlang_globals, 0, sizeof(hlang_globals));");
+        line("hl_free_arrays();");
+        line("if(setjmp(hl_failure)) return hl_error;");
+        statements(block);
+        line("return NULL;");
+        out += "}\n";
+    }
+
+private:
+    void line(const std::string& text) {
+        out.append(indent * 4, ' ');
+        out += text;
+        out += '\n';
+    }
+
+    std::string functionName(uint32_t index) const {
+        auto name = symbol_name(ast[functions[index]].functionName);
+        return "hl_" + std::to_string(index) + "_" + std::string(name);
+    }
+
+    static std::string variable(VariableSlot slot) {
+        if(slot.global) return "hlang_globals[" + std::to_string(slot.index) + "]";
+        return "v" + std::to_string(slot.index);
+    }
+
+    // Array operations count as calls, the order arrays are made in decides their handles and which error is raised first
+    bool containsCall(NodeRef<Node> node) const {
+        switch (ast[node].type) {
+            case NodeType::EXPRESSION:
+            case NodeType::PREFIX_EXPRESSION:
+                return containsCall(ast[node.as<ExpressionNode>()].operation);
+            case NodeType::BINARY_OPERATION:
+                if(is_array_type(ast[node.as<BinaryOperation>()].dataType)) return true;
+                return containsCall(ast[node.as<BinaryOperation>()].left) || containsCall(ast[node.as<BinaryOperation>()].right);
+            case NodeType::FUNCTION_CALL:
+            case NodeType::INDEX:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    bool isComparison(NodeRef<Node> node) const {
+        while(ast[node].type == NodeType::EXPRESSION || ast[node].type == NodeType::PREFIX_EXPRESSION) {
+            node = ast[node.as<ExpressionNode>()].operation;
+        }
+        if(ast[node].type != NodeType::BINARY_OPERATION) return false;
+        auto op = ast[node.as<BinaryOperation>()].op;
+        return op >= OperatorType::EQUALS && op <= OperatorType::NOT_EQUALS;
+    }
+
+    // Evaluates value now into a temporary. Literals and locals can not be changed by a call
+    std::string hoist(const std::string& value, NodeRef<Node> node) {
+        while(ast[node].type == NodeType::EXPRESSION || ast[node].type == NodeType::PREFIX_EXPRESSION) {
+            node = ast[node.as<ExpressionNode>()].operation;
+        }
+        if(ast[node].type == NodeType::NUMBER) return value;
+        if(ast[node].type == NodeType::IDENTIFIER && !ast[node.as<IdentifierNode>()].slot.global) return value;
+        std::string name = "t" + std::to_string(temporaries++);
+        line("HInt " + name + " = " + value + ";");
+        return name;
+    }
+
+    std::string expression(NodeRef<Node> node) {
+        switch (ast[node].type) {
+            case NodeType::EXPRESSION:
+            case NodeType::PREFIX_EXPRESSION:
+                return expression(ast[node.as<ExpressionNode>()].operation);
+            case NodeType::NUMBER: {
+                int value = ast[node.as<NumberNode>()].value;
+                return value == INT_MIN ? "(-2147483647 - 1)" : std::to_string(value);
+            }
+            case NodeType::IDENTIFIER:
+                return variable(ast[node.as<IdentifierNode>()].slot);
+            case NodeType::BINARY_OPERATION: {
+                auto& operation = ast[node.as<BinaryOperation>()];
+                std::string left = expression(operation.left);
+                if(containsCall(operation.right)) left = hoist(left, operation.left);
+                std::string right = expression(operation.right);
+                if(is_array_type(operation.dataType)) {
+                    return "hl_array_op(" + std::to_string((int)operation.op - (int)OperatorType::ADD) + ", " + left + ", " +
+                           flags(operation.left) + ", " + right + ", " + flags(operation.right) + ")";
+                }
+                switch (operation.op) {
+                    case OperatorType::ADD: return "HL_ADD(" + left + ", " + right + ")";
+                    case OperatorType::SUB: return "HL_SUB(" + left + ", " + right + ")";
+                    case OperatorType::MUL: return "HL_MUL(" + left + ", " + right + ")";
+                    case OperatorType::DIV: return "hl_div(" + left + ", " + right + ")";
+                    case OperatorType::EQUALS: return "(" + left + " == " + right + ")";
+                    case OperatorType::LESS_EQUALS: return "(" + left + " <= " + right + ")";
+                    case OperatorType::LARGER_EQUALS: return "(" + left + " >= " + right + ")";
+                    case OperatorType::LESS_THAN: return "(" + left + " < " + right + ")";
+                    case OperatorType::LARGER_THAN: return "(" + left + " > " + right + ")";
+                    case OperatorType::NOT_EQUALS: return "(" + left + " != " + right + ")";
+                    default: hlang_error("Invalid optype recieved");
+                }
+            }
+            case NodeType::FUNCTION_CALL:
+                return call(node.as<FunctionCallNode>());
+            case NodeType::INDEX: {
+                // The index runs before the array variable is read
+                auto& index = ast[node.as<IndexNode>()];
+                std::string element = expression(index.index);
+                if(containsCall(index.index)) element = hoist(element, index.index);
+                return "hl_get(" + expression(index.array) + ", " + element + ")";
+            }
+            default:
+                hlang_error("Node type is not supported as expression operand");
+        }
+    }
+
+    std::string flags(NodeRef<Node> node) const {
+        return std::to_string(operand_flags(ast, node));
+    }
+
+    // Arguments before the last one with a call are evaluated ahead of it
+    std::vector<std::string> argumentValues(NodeList<ExpressionNode> list) {
+        auto arguments = ast[list];
+        uint32_t lastCall = 0;
+        for(uint32_t i = 0; i < arguments.size(); i++) {
+            if(containsCall(arguments[i])) lastCall = i;
+        }
+        std::vector<std::string> values;
+        for(uint32_t i = 0; i < arguments.size(); i++) {
+            values.push_back(expression(arguments[i]));
+            if(i < lastCall) values.back() = hoist(values.back(), arguments[i]);
+        }
+        return values;
+    }
+
+    std::string builtin(NodeRef<FunctionCallNode> node) {
+        auto values = argumentValues(ast[node].argumentsList);
+        auto list = ast[ast[node].argumentsList];
+        switch (ast[node].builtin) {
+            case Builtin::INT_ARRAY: return "hl_array_new(" + values[0] + ", false)";
+            case Builtin::BOOL_ARRAY: return "hl_array_new(" + values[0] + ", true)";
+            case Builtin::LEN: return "hl_len(" + values[0] + ", " + flags(list[0]) + ")";
+            case Builtin::SUM: return "hl_sum(" + values[0] + ", " + flags(list[0]) + ")";
+            case Builtin::MIN: return "hl_min(" + values[0] + ", " + flags(list[0]) + ")";
+            case Builtin::MAX: return "hl_max(" + values[0] + ", " + flags(list[0]) + ")";
+            case Builtin::SELECT:
+                return "hl_select(" + values[0] + ", " + flags(list[0]) + ", " + values[1] + ", " + flags(list[1]) + ", " +
+                       values[2] + ", " + flags(list[2]) + ")";
+            default:
+                hlang_error("Invalid builtin");
+        }
+    }
+
+    std::string call(NodeRef<FunctionCallNode> node) {
+        if(ast[node].builtin != Builtin::NONE) return builtin(node);
+        auto it = functionIndices.find(ast[node].functionIdentifier);
+        if(it == functionIndices.end()) {
+            auto name = symbol_name(ast[node].functionIdentifier);
+            hlang_error("%.*s is not a function", (int)name.size(), name.data());
+        }
+        uint32_t index = it->second;
+        auto arguments = ast[ast[node].argumentsList];
+        auto params = ast[ast[functions[index]].paramDeclarations];
+        if(arguments.size() != params.size()) {
+            auto name = symbol_name(ast[node].functionIdentifier);
+            hlang_error("%.*s takes %u arguments, %u given", (int)name.size(), name.data(), params.size(), arguments.size());
+        }
+        auto values = argumentValues(ast[node].argumentsList);
+        std::string result = functionName(index) + "(";
+        for(size_t i = 0; i < values.size(); i++) {
+            if(i > 0) result += ", ";
+            result += values[i];
+        }
+        return result + ")";
+    }
+
+    // Bool globals are stored as 0 or 1 like a C bool would hold them
+    std::string store(VariableSlot slot, NodeRef<ExpressionNode> value) {
+        std::string result = value ? expression(value) : "0";
+        if(slot.global && slot.index < globalTypes.size() && globalTypes[slot.index] == DataType::BOOL && !isComparison(value)) {
+            result = "(" + result + " != 0)";
+        }
+        return variable(slot) + " = " + result + ";";
+    }
+
+    void statements(NodeRef<BlockNode> block) {
+        for(auto statement: ast[ast[block].statements]) {
+            switch (ast[statement].type) {
+                case NodeType::DECLARATION: {
+                    auto& declaration = ast[statement.as<DeclarationNode>()];
+                    std::string assignment = store(declaration.slot, declaration.defaultValueExpression);
+                    line(declaration.slot.global ? assignment : std::string(c_type(declaration.dataType)) + " " + assignment);
+                    break;
+                }
+                case NodeType::ASSIGNMENT: {
+                    auto& assignment = ast[statement.as<AssignmentNode>()];
+                    if(assignment.index) {
+                        // Index and value run before the array variable is read
+                        std::string element = expression(assignment.index);
+                        bool calls = containsCall(assignment.index) || containsCall(assignment.expression);
+                        if(calls) element = hoist(element, assignment.index);
+                        std::string value = expression(assignment.expression);
+                        if(calls) value = hoist(value, assignment.expression);
+                        line("hl_set(" + variable(assignment.slot) + ", " + element + ", " + value + ");");
+                        break;
+                    }
+                    line(store(assignment.slot, assignment.expression));
+                    break;
+                }
+                case NodeType::BRANCH: {
+                    auto& branch = ast[statement.as<BranchNode>()];
+                    // Comparisons come parenthesized already
+                    std::string condition = expression(branch.expression);
+                    line(condition.front() == '(' && condition.back() == ')' && isComparison(branch.expression) ?
+                         "if" + condition + " {" : "if(" + condition + ") {");
+                    indent++;
+                    statements(branch.trueBlock);
+                    indent--;
+                    if(branch.falseBlock) {
+                        line("} else {");
+                        indent++;
+                        statements(branch.falseBlock);
+                        indent--;
+                    }
+                    line("}");
+                    break;
+                }
+                case NodeType::LOOP: {
+                    auto& loop = ast[statement.as<LoopNode>()];
+                    // Temporaries of the condition have to be evaluated again every iteration, inside of the loop
+                    std::string outer = std::move(out);
+                    out.clear();
+                    indent++;
+                    std::string condition = expression(loop.expression);
+                    indent--;
+                    std::string temporaryLines = std::move(out);
+                    out = std::move(outer);
+                    if(temporaryLines.empty()) {
+                        line(condition.front() == '(' && condition.back() == ')' && isComparison(loop.expression) ?
+                             "while" + condition + " {" : "while(" + condition + ") {");
+                        indent++;
+                    } else {
+                        line("for(;;) {");
+                        indent++;
+                        out += temporaryLines;
+                        line("if(!" + condition + ") break;");
+                    }
+                    statements(loop.body);
+                    indent--;
+                    line("}");
+                    break;
+                }
+                case NodeType::FUNCTION_CALL:
+                    line(call(statement.as<FunctionCallNode>()) + ";");
+                    break;
+                case NodeType::LAST_STATEMENT: {
+                    auto returnExpr = ast[statement.as<LastStatementNode>()].returnExpr;
+                    if(ast[statement.as<LastStatementNode>()].isBreak) {
+                        line("break;");
+                    } else if(isTopLevel) {
+                        if(returnExpr) line("(void)" + expression(returnExpr) + ";");
+                        line("return NULL;");
+                    } else {
+                        line("return " + (returnExpr ? expression(returnExpr) : std::string("0")) + ";");
+                    }
+                    break;
+                }
+                default:
+                    break; // Function declarations are lowered on their own
+            }
+        }
+    }
+
+    const AstArena& ast;
+    const std::unordered_map<SymbolId, uint32_t>& functionIndices;
+    const std::vector<NodeRef<FunctionDeclarationNode>>& functions;
+    const std::vector<DataType>& globalTypes;
+    bool isTopLevel = false;
+    uint32_t temporaries = 0;
+    int indent = 0;
+};
+
+// Declared type of every global slot
+static void collect_global_types(const AstArena& ast, NodeRef<BlockNode> block, std::vector<DataType>& types) {
+    for(auto statement: ast[ast[block].statements]) {
+        if(ast[statement].type == NodeType::DECLARATION) {
+            auto& declaration = ast[statement.as<DeclarationNode>()];
+            if(!declaration.slot.global) continue;
+            if(declaration.slot.index >= types.size()) types.resize(declaration.slot.index + 1, DataType::INT);
+            types[declaration.slot.index] = declaration.dataType;
+        } else if(ast[statement].type == NodeType::BRANCH) {
+            auto& branch = ast[statement.as<BranchNode>()];
+            collect_global_types(ast, branch.trueBlock, types);
+            if(branch.falseBlock) collect_global_types(ast, branch.falseBlock, types);
+        } else if(ast[statement].type == NodeType::LOOP) {
+            collect_global_types(ast, ast[statement.as<LoopNode>()].body, types);
+        }
+    }
+}
+
+std::string compileToC(ProgramNode& program, const char* sourceName) {
+    auto& functions = resolveFunctions(program);
+    auto& ast = program.ast;
+    uint32_t globalCount = ast[program.programBlock].frameSize;
+
+    std::vector<DataType> globalTypes;
+    collect_global_types(ast, program.programBlock, globalTypes);
+    std::unordered_map<SymbolId, uint32_t> functionIndices;
+    for(uint32_t i = 0; i < functions.size(); i++) {
+        functionIndices[ast[functions[i]].functionName] = i;
+        collect_global_types(ast, ast[functions[i]].functionBlock, globalTypes);
+    }
+
+    std::string out = "/* Generated by mylangc from " + std::string(sourceName) + " */\n";
+    out += cPrelude;
+    // C has no empty arrays, there is always at least one global slot
+    std::vector<std::string> names(std::max<uint32_t>(globalCount, 1));
+    for(auto& global: program.globalSlots) {
+        if(global.second < names.size()) names[global.second] = std::string(symbol_name(global.first));
+    }
+    out += "HLANG_EXPORT const uint32_t hlang_global_count = " + std::to_string(globalCount) + ";\n";
+    out += "HLANG_EXPORT const char* const hlang_global_names[" + std::to_string(names.size()) + "] = {";
+    for(size_t i = 0; i < names.size(); i++) {
+        out += i > 0 ? ", " : "";
+        out += names[i].empty() ? "NULL" : "\"" + names[i] + "\"";
+    }
+    out += "};\n";
+    out += "HLANG_EXPORT HInt hlang_globals[" + std::to_string(names.size()) + "];\n\n";
+
+    CGenerator generator(ast, functionIndices, functions, globalTypes);
+    for(uint32_t i = 0; i < functions.size(); i++) {
+        generator.prototype(i);
+        generator.out += ";\n";
+    }
+    generator.out += "\n";
+    for(uint32_t i = 0; i < functions.size(); i++) generator.function(i);
+    generator.topLevel(program.programBlock);
+    return out + generator.out;
+}
+
+// Runs arguments[0] found on the path with arguments, no shell sees them. True when it exited with 0
+bool runProcess(const std::vector<std::string>& arguments) {
+#ifdef _WIN32
+    // Windows passes one command line, every argument is quoted for the child's argument parser
+    std::string commandLine;
+    for(auto& argument: arguments) {
+        if(!commandLine.empty()) commandLine += ' ';
+        commandLine += '"';
+        size_t backslashes = 0;
+        for(char c: argument) {
+            if(c == '\\') {
+                backslashes++;
+                continue;
+            }
+            commandLine.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+            backslashes = 0;
+            commandLine += c;
+        }
+        commandLine.append(backslashes * 2, '\\');
+        commandLine += '"';
+    }
+    STARTUPINFOA startup = {};
+    startup.cb = sizeof(startup);
+    PROCESS_INFORMATION process = {};
+    if(!CreateProcessA(nullptr, &commandLine[0], nullptr, nullptr, FALSE, 0, nullptr, nullptr, &startup, &process)) return false;
+    WaitForSingleObject(process.hProcess, INFINITE);
+    DWORD exitCode = 1;
+    GetExitCodeProcess(process.hProcess, &exitCode);
+    CloseHandle(process.hThread);
+    CloseHandle(process.hProcess);
+    return exitCode == 0;
+#else
+    std::vector<char*> argv;
+    for(auto& argument: arguments) argv.push_back(const_cast<char*>(argument.c_str()));
+    argv.push_back(nullptr);
+    pid_t pid;
+    if(posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) return false;
+    int status;
+    while(waitpid(pid, &status, 0) == -1) {
+        if(errno != EINTR) return false;
+    }
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+bool buildSharedObject(const char* cFileName, const char* outputFileName) {
+    // $CC may name a compiler with options of its own like "ccache gcc", it is split on spaces as make would
+    const char* compiler = getenv("CC");
+    if(!compiler || !*compiler) compiler = "cc";
+    std::vector<std::string> arguments;
+    for(const char* c = compiler; *c;) {
+        const char* end = c + strcspn(c, " \t");
+        if(end > c) arguments.emplace_back(c, end);
+        c = *end ? end + 1 : end;
+    }
+    if(arguments.empty()) return false;
+    for(const char* argument: {"-O2", "-shared", "-fPIC", "-o", outputFileName, cFileName}) arguments.emplace_back(argument);
+    return runProcess(arguments);
+}
+
+AotModule::~AotModule() {
+    if(!library) return;
+#ifdef _WIN32
+    FreeLibrary((HMODULE)library);
+#else
+    dlclose(library);
+#endif
+}
+
+std::unique_ptr<AotModule> AotModule::load(const char* fileName) {
+    std::unique_ptr<AotModule> module(new AotModule());
+#ifdef _WIN32
+    HMODULE library = LoadLibraryA(fileName);
+    if(!library) return nullptr;
+    module->library = library;
+    auto symbol = [&](const char* name) { return (void*)GetProcAddress(library, name); };
+#else
+    // A relative name without a slash would be searched for on the library path
+    std::string path = std::string(fileName).find('/') == std::string::npos ? "./" + std::string(fileName) : fileName;
+    void* library = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if(!library) return nullptr;
+    module->library = library;
+    auto symbol = [&](const char* name) { return dlsym(library, name); };
+#endif
+    module->runEntry = (const char* (*)())symbol("hlang_run");
+    module->globalCount = (const uint32_t*)symbol("hlang_global_count");
+    module->globalNames = (const char* const*)symbol("hlang_global_names");
+    module->globals = (const int32_t*)symbol("hlang_globals");
+    if(!module->runEntry || !module->globalCount || !module->globalNames || !module->globals) return nullptr;
+    return module;
+}
+
+void AotModule::run() {
+    const char* error = runEntry();
+    if(error) hlang_error("%s", error);
+}
+
+bool AotModule::readInt(const char* name, HInt& value) const {
+    for(uint32_t i = 0; i < *globalCount; i++) {
+        if(globalNames[i] && strcmp(globalNames[i], name) == 0) {
+            value = globals[i];
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,50 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "parser.h"
+#include "interpreter.h"
+
+// Ahead of time compilation to portable C. Every function declaration becomes a C function over int32_t ints and C
+// bools, variables become C locals named after their resolver slots and globals live in an exported array, so an
+// optimizing C compiler takes it from there. Evaluation order is the VM's, left to right.
+// The translation unit exports
+//   const uint32_t hlang_global_count;
+//   const char* const hlang_global_names[]; // Name of every global slot, null for unnamed ones
+//   int32_t hlang_globals[];
+//   const char* hlang_run(void); // Runs the top level code, returns null or the runtime error
+// Calls run on the C stack, only tail calls the C compiler turns into jumps run in constant space
+std::string compileToC(ProgramNode& program, const char* sourceName);
+// Runs the system C compiler ($CC or cc) with -O2 on cFileName, producing the shared object outputFileName. The
+// compiler is started directly with the file names as arguments, no shell interprets them.
+// False when the compiler failed
+bool buildSharedObject(const char* cFileName, const char* outputFileName);
+
+// A shared object built from compileToC output, loaded into this process
+class AotModule {
+public:
+    ~AotModule();
+    AotModule(const AotModule&) = delete;
+    AotModule& operator=(const AotModule&) = delete;
+
+    // Null when the library can not be loaded or does not export the hlang symbols
+    static std::unique_ptr<AotModule> load(const char* fileName);
+
+    // Runs the top level code. Errors go through hlang_error
+    void run();
+    // Global of the last run, false when there is no global with that name
+    bool readInt(const char* name, HInt& value) const;
+
+private:
+    AotModule() = default;
+
+    void* library = nullptr;
+    const char* (*runEntry)() = nullptr;
+    const uint32_t* globalCount = nullptr;
+    const char* const* globalNames = nullptr;
+    const int32_t* globals = nullptr;
+};
@@ -0,0 +1,521 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "array.h"
+#include "diagnostics.h"
+#include "resolver.h"
+#include "simd.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <vector>
+
+constexpr size_t arrayAlignment = 64;
+// Arrays are only freed when the next run starts, a loop making a new array every iteration stops here
+constexpr size_t maxArrayBytes = (size_t)1 << 30;
+
+struct ArrayObject {
+    HInt* data;
+    uint32_t length;
+    ValueType elementType;
+};
+
+struct ArrayHeap {
+    std::vector<ArrayObject> arrays = {{nullptr, 0, ValueType::INT}};
+    size_t bytes = 0;
+
+    ~ArrayHeap() {
+        reset();
+    }
+
+    void reset() {
+        for(auto& array: arrays) {
+            if(array.data) operator delete(array.data, std::align_val_t(arrayAlignment));
+        }
+        arrays.resize(1);
+        bytes = 0;
+    }
+};
+
+thread_local ArrayHeap heap;
+
+void reset_arrays() {
+    heap.reset();
+}
+
+static ArrayObject& array_object(HInt array) {
+    if((uint32_t)array >= heap.arrays.size()) hlang_error("Invalid array %d", array);
+    return heap.arrays[(uint32_t)array];
+}
+
+// Buffers are padded to whole cache lines, kernels never read or write past length
+static size_t buffer_bytes(size_t length) {
+    return (length * sizeof(HInt) + arrayAlignment - 1) & ~(arrayAlignment - 1);
+}
+
+// New array with length elements left uninitialized, the empty array for length 0
+static HInt allocate(ValueType elementType, size_t length) {
+    if(length == 0) return 0;
+    size_t bytes = buffer_bytes(length);
+    if(length > UINT32_MAX || heap.bytes + bytes > maxArrayBytes) hlang_error("Out of memory for arrays");
+    auto data = (HInt*)operator new(bytes, std::align_val_t(arrayAlignment));
+    heap.arrays.push_back({data, (uint32_t)length, elementType});
+    heap.bytes += bytes;
+    return (HInt)(heap.arrays.size() - 1);
+}
+
+// Frees a temporary that was used up. Handles at the end of the table are given out again
+static void release(HInt array) {
+    if(array == 0) return;
+    auto& object = heap.arrays[array];
+    heap.bytes -= buffer_bytes(object.length);
+    operator delete(object.data, std::align_val_t(arrayAlignment));
+    object = {nullptr, 0, ValueType::INT};
+    while(heap.arrays.size() > 1 && !heap.arrays.back().data) heap.arrays.pop_back();
+}
+
+// Where the result of an element wise operation goes. The first temporary operand is written over, every kernel reads
+// element i of its operands before it writes element i of the result
+static HInt result_array(ValueType elementType, uint32_t length, std::initializer_list<std::pair<HInt, uint32_t>> operands) {
+    for(auto& [array, flags]: operands) {
+        if(flags & operandTemporary) {
+            heap.arrays[array].elementType = elementType;
+            return array;
+        }
+    }
+    return allocate(elementType, length);
+}
+
+// Frees the temporary operands result was not written to
+static void release_operands(HInt result, std::initializer_list<std::pair<HInt, uint32_t>> operands) {
+    for(auto& [array, flags]: operands) {
+        if((flags & operandTemporary) && array != result) release(array);
+    }
+}
+
+// Operand shapes of binary kernels, a scalar operand points at a single value
+enum BinaryShape {
+    BOTH_ARRAYS,
+    LEFT_SCALAR,
+    RIGHT_SCALAR
+};
+
+// Select kernel shapes are a mask of these
+enum SelectShape {
+    TRUE_SCALAR = 1,
+    FALSE_SCALAR = 2
+};
+
+// What every kernel computes for one element, the vector kernels have to give the same results.
+// Arithmetic wraps around, division by zero is checked before any kernel runs
+template<OperatorType op>
+static inline HInt scalar_op(HInt left, HInt right) {
+    if constexpr(op == OperatorType::ADD) return wrapping_add(left, right);
+    else if constexpr(op == OperatorType::SUB) return wrapping_sub(left, right);
+    else if constexpr(op == OperatorType::MUL) return wrapping_mul(left, right);
+    else if constexpr(op == OperatorType::DIV) return wrapping_div(left, right);
+    else if constexpr(op == OperatorType::EQUALS) return left == right;
+    else if constexpr(op == OperatorType::LESS_EQUALS) return left <= right;
+    else if constexpr(op == OperatorType::LARGER_EQUALS) return left >= right;
+    else if constexpr(op == OperatorType::LESS_THAN) return left < right;
+    else if constexpr(op == OperatorType::LARGER_THAN) return left > right;
+    else return left != right;
+}
+
+template<OperatorType op, int shape>
+static void binary_scalar(HInt* out, const HInt* left, const HInt* right, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        out[i] = scalar_op<op>(left[shape == LEFT_SCALAR ? 0 : i], right[shape == RIGHT_SCALAR ? 0 : i]);
+    }
+}
+
+template<int shape>
+static void select_scalar(HInt* out, const HInt* mask, const HInt* whenTrue, const HInt* whenFalse, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        out[i] = mask[i] != 0 ? whenTrue[shape & TRUE_SCALAR ? 0 : i] : whenFalse[shape & FALSE_SCALAR ? 0 : i];
+    }
+}
+
+static HInt sum_scalar(const HInt* data, size_t count) {
+    uint32_t sum = 0;
+    for(size_t i = 0; i < count; i++) sum += (uint32_t)data[i];
+    return (HInt)sum;
+}
+
+template<bool isMax>
+static HInt extreme_scalar(const HInt* data, size_t count) {
+    HInt result = data[0];
+    for(size_t i = 1; i < count; i++) result = isMax ? std::max(result, data[i]) : std::min(result, data[i]);
+    return result;
+}
+
+#if HLANG_SIMD_X86
+
+// Every loop starts at element 0 and steps over whole vectors, buffers are aligned so every load and store is too
+
+// SSE2 has no 32 bit multiply, the even and odd lanes are multiplied to 64 bits and the low halves put back together
+static inline __m128i sse2_mul(__m128i left, __m128i right) {
+    __m128i even = _mm_mul_epu32(left, right);
+    __m128i odd = _mm_mul_epu32(_mm_srli_epi64(left, 32), _mm_srli_epi64(right, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// Comparisons give all ones lanes, masked down to 1. Division has no vector instruction and is not used
+template<OperatorType op>
+static inline __m128i sse2_op(__m128i left, __m128i right) {
+    const __m128i one = _mm_set1_epi32(1);
+    if constexpr(op == OperatorType::ADD) return _mm_add_epi32(left, right);
+    else if constexpr(op == OperatorType::SUB) return _mm_sub_epi32(left, right);
+    else if constexpr(op == OperatorType::MUL) return sse2_mul(left, right);
+    else if constexpr(op == OperatorType::EQUALS) return _mm_and_si128(_mm_cmpeq_epi32(left, right), one);
+    else if constexpr(op == OperatorType::LESS_EQUALS) return _mm_andnot_si128(_mm_cmpgt_epi32(left, right), one);
+    else if constexpr(op == OperatorType::LARGER_EQUALS) return _mm_andnot_si128(_mm_cmplt_epi32(left, right), one);
+    else if constexpr(op == OperatorType::LESS_THAN) return _mm_and_si128(_mm_cmplt_epi32(left, right), one);
+    else if constexpr(op == OperatorType::LARGER_THAN) return _mm_and_si128(_mm_cmpgt_epi32(left, right), one);
+    else return _mm_andnot_si128(_mm_cmpeq_epi32(left, right), one);
+}
+
+template<OperatorType op, int shape>
+static void binary_sse2(HInt* out, const HInt* left, const HInt* right, size_t count) {
+    const __m128i leftScalar = _mm_set1_epi32(left[0]);
+    const __m128i rightScalar = _mm_set1_epi32(right[0]);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128i a = shape == LEFT_SCALAR ? leftScalar : _mm_load_si128((const __m128i*)(left + i));
+        __m128i b = shape == RIGHT_SCALAR ? rightScalar : _mm_load_si128((const __m128i*)(right + i));
+        _mm_store_si128((__m128i*)(out + i), sse2_op<op>(a, b));
+    }
+    binary_scalar<op, shape>(out + i, shape == LEFT_SCALAR ? left : left + i, shape == RIGHT_SCALAR ? right : right + i, count - i);
+}
+
+template<int shape>
+static void select_sse2(HInt* out, const HInt* mask, const HInt* whenTrue, const HInt* whenFalse, size_t count) {
+    const __m128i trueScalar = _mm_set1_epi32(whenTrue[0]);
+    const __m128i falseScalar = _mm_set1_epi32(whenFalse[0]);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128i isFalse = _mm_cmpeq_epi32(_mm_load_si128((const __m128i*)(mask + i)), _mm_setzero_si128());
+        __m128i a = shape & TRUE_SCALAR ? trueScalar : _mm_load_si128((const __m128i*)(whenTrue + i));
+        __m128i b = shape & FALSE_SCALAR ? falseScalar : _mm_load_si128((const __m128i*)(whenFalse + i));
+        _mm_store_si128((__m128i*)(out + i), _mm_or_si128(_mm_and_si128(isFalse, b), _mm_andnot_si128(isFalse, a)));
+    }
+    select_scalar<shape>(out + i, mask + i, shape & TRUE_SCALAR ? whenTrue : whenTrue + i,
+                         shape & FALSE_SCALAR ? whenFalse : whenFalse + i, count - i);
+}
+
+static HInt sum_sse2(const HInt* data, size_t count) {
+    __m128i sum = _mm_setzero_si128();
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) sum = _mm_add_epi32(sum, _mm_load_si128((const __m128i*)(data + i)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return (HInt)((uint32_t)_mm_cvtsi128_si32(sum) + (uint32_t)sum_scalar(data + i, count - i));
+}
+
+// SSE2 has no 32 bit min or max, lanes are picked with a compare mask
+template<bool isMax>
+static HInt extreme_sse2(const HInt* data, size_t count) {
+    __m128i result = _mm_set1_epi32(data[0]);
+    size_t i = 0;
+    for(; i + 4 <= count; i += 4) {
+        __m128i values = _mm_load_si128((const __m128i*)(data + i));
+        __m128i take = isMax ? _mm_cmpgt_epi32(values, result) : _mm_cmplt_epi32(values, result);
+        result = _mm_or_si128(_mm_and_si128(take, values), _mm_andnot_si128(take, result));
+    }
+    alignas(16) HInt lanes[5];
+    _mm_store_si128((__m128i*)lanes, result);
+    lanes[4] = extreme_scalar<isMax>(data + (i < count ? i : 0), i < count ? count - i : 1);
+    return extreme_scalar<isMax>(lanes, 5);
+}
+
+template<OperatorType op>
+HLANG_TARGET_AVX2 static inline __m256i avx2_op(__m256i left, __m256i right) {
+    const __m256i one = _mm256_set1_epi32(1);
+    if constexpr(op == OperatorType::ADD) return _mm256_add_epi32(left, right);
+    else if constexpr(op == OperatorType::SUB) return _mm256_sub_epi32(left, right);
+    else if constexpr(op == OperatorType::MUL) return _mm256_mullo_epi32(left, right);
+    else if constexpr(op == OperatorType::EQUALS) return _mm256_and_si256(_mm256_cmpeq_epi32(left, right), one);
+    else if constexpr(op == OperatorType::LESS_EQUALS) return _mm256_andnot_si256(_mm256_cmpgt_epi32(left, right), one);
+    else if constexpr(op == OperatorType::LARGER_EQUALS) return _mm256_andnot_si256(_mm256_cmpgt_epi32(right, left), one);
+    else if constexpr(op == OperatorType::LESS_THAN) return _mm256_and_si256(_mm256_cmpgt_epi32(right, left), one);
+    else if constexpr(op == OperatorType::LARGER_THAN) return _mm256_and_si256(_mm256_cmpgt_epi32(left, right), one);
+    else return _mm256_andnot_si256(_mm256_cmpeq_epi32(left, right), one);
+}
+
+template<OperatorType op, int shape>
+HLANG_TARGET_AVX2 static void binary_avx2(HInt* out, const HInt* left, const HInt* right, size_t count) {
+    const __m256i leftScalar = _mm256_set1_epi32(left[0]);
+    const __m256i rightScalar = _mm256_set1_epi32(right[0]);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i a = shape == LEFT_SCALAR ? leftScalar : _mm256_load_si256((const __m256i*)(left + i));
+        __m256i b = shape == RIGHT_SCALAR ? rightScalar : _mm256_load_si256((const __m256i*)(right + i));
+        _mm256_store_si256((__m256i*)(out + i), avx2_op<op>(a, b));
+    }
+    binary_sse2<op, shape>(out + i, shape == LEFT_SCALAR ? left : left + i, shape == RIGHT_SCALAR ? right : right + i, count - i);
+}
+
+template<int shape>
+HLANG_TARGET_AVX2 static void select_avx2(HInt* out, const HInt* mask, const HInt* whenTrue, const HInt* whenFalse, size_t count) {
+    const __m256i trueScalar = _mm256_set1_epi32(whenTrue[0]);
+    const __m256i falseScalar = _mm256_set1_epi32(whenFalse[0]);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i isFalse = _mm256_cmpeq_epi32(_mm256_load_si256((const __m256i*)(mask + i)), _mm256_setzero_si256());
+        __m256i a = shape & TRUE_SCALAR ? trueScalar : _mm256_load_si256((const __m256i*)(whenTrue + i));
+        __m256i b = shape & FALSE_SCALAR ? falseScalar : _mm256_load_si256((const __m256i*)(whenFalse + i));
+        _mm256_store_si256((__m256i*)(out + i), _mm256_blendv_epi8(a, b, isFalse));
+    }
+    select_sse2<shape>(out + i, mask + i, shape & TRUE_SCALAR ? whenTrue : whenTrue + i,
+                       shape & FALSE_SCALAR ? whenFalse : whenFalse + i, count - i);
+}
+
+HLANG_TARGET_AVX2 static HInt sum_avx2(const HInt* data, size_t count) {
+    __m256i sum = _mm256_setzero_si256();
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) sum = _mm256_add_epi32(sum, _mm256_load_si256((const __m256i*)(data + i)));
+    alignas(32) HInt lanes[8];
+    _mm256_store_si256((__m256i*)lanes, sum);
+    return (HInt)((uint32_t)sum_scalar(lanes, 8) + (uint32_t)sum_sse2(data + i, count - i));
+}
+
+template<bool isMax>
+HLANG_TARGET_AVX2 static HInt extreme_avx2(const HInt* data, size_t count) {
+    __m256i result = _mm256_set1_epi32(data[0]);
+    size_t i = 0;
+    for(; i + 8 <= count; i += 8) {
+        __m256i values = _mm256_load_si256((const __m256i*)(data + i));
+        result = isMax ? _mm256_max_epi32(result, values) : _mm256_min_epi32(result, values);
+    }
+    alignas(32) HInt lanes[9];
+    _mm256_store_si256((__m256i*)lanes, result);
+    lanes[8] = i < count ? extreme_sse2<isMax>(data + i, count - i) : lanes[0];
+    return extreme_scalar<isMax>(lanes, 9);
+}
+
+#endif
+
+typedef void (*BinaryKernel)(HInt* out, const HInt* left, const HInt* right, size_t count);
+typedef void (*SelectKernel)(HInt* out, const HInt* mask, const HInt* whenTrue, const HInt* whenFalse, size_t count);
+typedef HInt (*ReduceKernel)(const HInt* data, size_t count);
+
+struct ArrayKernels {
+    BinaryKernel binary[10][3]; // By OperatorType from ADD on, then BinaryShape
+    SelectKernel select[4]; // By SelectShape mask
+    ReduceKernel sum;
+    ReduceKernel min;
+    ReduceKernel max;
+    const char* name;
+};
+
+// Same order as OperatorType. Division always runs the scalar kernel
+#define BINARY_SHAPES(kernel, op) {kernel<op, BOTH_ARRAYS>, kernel<op, LEFT_SCALAR>, kernel<op, RIGHT_SCALAR>}
+#define BINARY_KERNELS(kernel) { \
+        BINARY_SHAPES(kernel, OperatorType::ADD), BINARY_SHAPES(kernel, OperatorType::MUL), \
+        BINARY_SHAPES(binary_scalar, OperatorType::DIV), BINARY_SHAPES(kernel, OperatorType::SUB), \
+        BINARY_SHAPES(kernel, OperatorType::EQUALS), BINARY_SHAPES(kernel, OperatorType::LESS_EQUALS), \
+        BINARY_SHAPES(kernel, OperatorType::LARGER_EQUALS), BINARY_SHAPES(kernel, OperatorType::LESS_THAN), \
+        BINARY_SHAPES(kernel, OperatorType::LARGER_THAN), BINARY_SHAPES(kernel, OperatorType::NOT_EQUALS)}
+#define SELECT_KERNELS(kernel) {kernel<0>, kernel<TRUE_SCALAR>, kernel<FALSE_SCALAR>, kernel<TRUE_SCALAR | FALSE_SCALAR>}
+
+static const ArrayKernels scalarKernels = {
+    BINARY_KERNELS(binary_scalar), SELECT_KERNELS(select_scalar), sum_scalar, extreme_scalar<false>, extreme_scalar<true>, "scalar"
+};
+
+#if HLANG_SIMD_X86
+static const ArrayKernels sse2Kernels = {
+    BINARY_KERNELS(binary_sse2), SELECT_KERNELS(select_sse2), sum_sse2, extreme_sse2<false>, extreme_sse2<true>, "sse2"
+};
+
+static const ArrayKernels avx2Kernels = {
+    BINARY_KERNELS(binary_avx2), SELECT_KERNELS(select_avx2), sum_avx2, extreme_avx2<false>, extreme_avx2<true>, "avx2"
+};
+#endif
+
+#undef BINARY_SHAPES
+#undef BINARY_KERNELS
+#undef SELECT_KERNELS
+
+static const ArrayKernels* select_kernels() {
+#if HLANG_SIMD_X86
+    if(cpu_has_avx2()) return &avx2Kernels;
+    return &sse2Kernels;
+#else
+    return &scalarKernels;
+#endif
+}
+
+static std::atomic<const ArrayKernels*>& active_kernels() {
+    static std::atomic<const ArrayKernels*> kernels(select_kernels());
+    return kernels;
+}
+
+static const ArrayKernels& kernels() {
+    return *active_kernels().load(std::memory_order_relaxed);
+}
+
+const char* array_kernels_name() {
+    return kernels().name;
+}
+
+bool select_array_kernels(const char* name) {
+    const ArrayKernels* candidates[] = {
+        &scalarKernels,
+#if HLANG_SIMD_X86
+        &sse2Kernels,
+        cpu_has_avx2() ? &avx2Kernels : nullptr,
+#endif
+    };
+    for(auto candidate: candidates) {
+        if(candidate && strcmp(candidate->name, name) == 0) {
+            active_kernels().store(candidate, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+HInt array_new(ValueType elementType, HInt length) {
+    if(length < 0) hlang_error("Negative array length %d", length);
+    HInt array = allocate(elementType, (size_t)length);
+    if(length > 0) memset(heap.arrays[array].data, 0, length * sizeof(HInt));
+    return array;
+}
+
+HInt array_length(HInt array) {
+    return (HInt)array_object(array).length;
+}
+
+static void check_index(const ArrayObject& array, HInt index) {
+    if((uint32_t)index >= array.length) hlang_error("Index %d is out of bounds for an array of length %u", index, array.length);
+}
+
+HInt array_get(HInt array, HInt index) {
+    auto& object = array_object(array);
+    check_index(object, index);
+    return object.data[index];
+}
+
+void array_set(HInt array, HInt index, HInt value) {
+    auto& object = array_object(array);
+    check_index(object, index);
+    object.data[index] = object.elementType == ValueType::BOOL ? value != 0 : value;
+}
+
+const HInt* array_data(HInt array) {
+    return array_object(array).data;
+}
+
+uint32_t operand_flags(const AstArena& ast, NodeRef<Node> node) {
+    if(!is_array_type(expression_type(ast, node))) return 0;
+    while(ast[node].type == NodeType::EXPRESSION || ast[node].type == NodeType::PREFIX_EXPRESSION) {
+        node = ast[node.as<ExpressionNode>()].operation;
+    }
+    bool temporary = ast[node].type == NodeType::BINARY_OPERATION;
+    if(ast[node].type == NodeType::FUNCTION_CALL) {
+        auto builtin = ast[node.as<FunctionCallNode>()].builtin;
+        temporary = builtin == Builtin::INT_ARRAY || builtin == Builtin::BOOL_ARRAY || builtin == Builtin::SELECT;
+    }
+    return temporary ? operandArray | operandTemporary : operandArray;
+}
+
+// Length of the result of an element wise operation, every array operand has to have it
+static uint32_t element_count(HInt first, bool firstArray, HInt second, bool secondArray) {
+    if(!firstArray && !secondArray) hlang_error("Whole array operation without an array");
+    uint32_t length = array_object(firstArray ? first : second).length;
+    if(firstArray && secondArray && array_object(second).length != length) {
+        hlang_error("Arrays of length %u and %u do not match", length, array_object(second).length);
+    }
+    return length;
+}
+
+HInt array_binary(OperatorType op, HInt left, uint32_t leftFlags, HInt right, uint32_t rightFlags) {
+    if(op < OperatorType::ADD || op > OperatorType::NOT_EQUALS) hlang_error("Invalid optype recieved");
+    bool leftArray = leftFlags & operandArray;
+    bool rightArray = rightFlags & operandArray;
+    uint32_t length = element_count(left, leftArray, right, rightArray);
+    if(op == OperatorType::DIV) {
+        bool zero = rightArray ? std::find(array_data(right), array_data(right) + length, 0) != array_data(right) + length : right == 0;
+        if(zero) hlang_error("Division by zero");
+    }
+    bool comparison = op >= OperatorType::EQUALS;
+    HInt result = result_array(comparison ? ValueType::BOOL : ValueType::INT, length, {{left, leftFlags}, {right, rightFlags}});
+    if(length == 0) return result;
+    // Looked up after allocating, that may move the array table
+    const HInt* leftData = leftArray ? heap.arrays[left].data : &left;
+    const HInt* rightData = rightArray ? heap.arrays[right].data : &right;
+    int shape = leftArray && rightArray ? BOTH_ARRAYS : leftArray ? RIGHT_SCALAR : LEFT_SCALAR;
+    kernels().binary[(int)op - (int)OperatorType::ADD][shape](heap.arrays[result].data, leftData, rightData, length);
+    release_operands(result, {{left, leftFlags}, {right, rightFlags}});
+    return result;
+}
+
+HInt array_sum(HInt array) {
+    auto& object = array_object(array);
+    return kernels().sum(object.data, object.length);
+}
+
+HInt array_min(HInt array) {
+    auto& object = array_object(array);
+    if(object.length == 0) hlang_error("min of an empty array");
+    return kernels().min(object.data, object.length);
+}
+
+HInt array_max(HInt array) {
+    auto& object = array_object(array);
+    if(object.length == 0) hlang_error("max of an empty array");
+    return kernels().max(object.data, object.length);
+}
+
+HInt array_select(HInt mask, uint32_t maskFlags, HInt whenTrue, uint32_t trueFlags, HInt whenFalse, uint32_t falseFlags) {
+    bool trueArray = trueFlags & operandArray;
+    bool falseArray = falseFlags & operandArray;
+    uint32_t length = array_object(mask).length;
+    if(trueArray || falseArray) {
+        uint32_t valueLength = element_count(whenTrue, trueArray, whenFalse, falseArray);
+        if(valueLength != length) hlang_error("Arrays of length %u and %u do not match", length, valueLength);
+    }
+    bool boolean = trueArray && falseArray && array_object(whenTrue).elementType == ValueType::BOOL &&
+                   array_object(whenFalse).elementType == ValueType::BOOL;
+    auto operands = {std::make_pair(mask, maskFlags), std::make_pair(whenTrue, trueFlags), std::make_pair(whenFalse, falseFlags)};
+    HInt result = result_array(boolean ? ValueType::BOOL : ValueType::INT, length, operands);
+    if(length == 0) return result;
+    const HInt* trueData = trueArray ? heap.arrays[whenTrue].data : &whenTrue;
+    const HInt* falseData = falseArray ? heap.arrays[whenFalse].data : &whenFalse;
+    int shape = (trueArray ? 0 : TRUE_SCALAR) | (falseArray ? 0 : FALSE_SCALAR);
+    kernels().select[shape](heap.arrays[result].data, heap.arrays[mask].data, trueData, falseData, length);
+    release_operands(result, operands);
+    return result;
+}
+
+HInt run_builtin(Builtin builtin, const HInt* arguments, uint32_t operandFlags) {
+    HInt result;
+    switch (builtin) {
+        case Builtin::INT_ARRAY:
+            return array_new(ValueType::INT, arguments[0]);
+        case Builtin::BOOL_ARRAY:
+            return array_new(ValueType::BOOL, arguments[0]);
+        case Builtin::SELECT:
+            return array_select(arguments[0], operandFlags & 3, arguments[1], (operandFlags >> 2) & 3, arguments[2],
+                                (operandFlags >> 4) & 3);
+        case Builtin::LEN:
+            result = array_length(arguments[0]);
+            break;
+        case Builtin::SUM:
+            result = array_sum(arguments[0]);
+            break;
+        case Builtin::MIN:
+            result = array_min(arguments[0]);
+            break;
+        case Builtin::MAX:
+            result = array_max(arguments[0]);
+            break;
+        default:
+            hlang_error("Invalid builtin");
+    }
+    // Reductions use up a temporary argument
+    if(operandFlags & operandTemporary) release(arguments[0]);
+    return result;
+}
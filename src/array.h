@@ -0,0 +1,49 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "interpreter.h"
+
+// Typed arrays. An array is a contiguous, 64 byte aligned buffer of ints, bool arrays hold 0 or 1 in every element.
+// Values refer to arrays by handle so assigning an array shares it. Arrays belong to the thread that made them and
+// live until the next run on it starts, handle 0 is always the empty array. Only the temporaries of an expression, the
+// arrays whole array operators and selects make before anything refers to them, are reused and freed as they go.
+// Whole array operators, reductions and selects run on AVX2, SSE2 or scalar kernels, picked the first time they are
+// needed depending on what the cpu supports. Errors go through hlang_error
+
+// Frees every array of this thread, runs do this before they start
+void reset_arrays();
+
+// What an operand of the whole array operations is, a scalar that goes with every element when neither is set
+constexpr uint32_t operandArray = 1; // A handle
+constexpr uint32_t operandTemporary = 2; // An array nothing refers to, the operation writes over it or frees it
+// Flags of the value of node as an operand
+uint32_t operand_flags(const AstArena& ast, NodeRef<Node> node);
+
+// Zeroed array of length elements, elementType is ValueType::INT or ValueType::BOOL
+HInt array_new(ValueType elementType, HInt length);
+HInt array_length(HInt array);
+HInt array_get(HInt array, HInt index);
+void array_set(HInt array, HInt index, HInt value);
+// Valid until the next reset_arrays
+const HInt* array_data(HInt array);
+
+// left op right for every element, at least one operand is an array. Arithmetic gives an int array, comparisons a bool array
+HInt array_binary(OperatorType op, HInt left, uint32_t leftFlags, HInt right, uint32_t rightFlags);
+HInt array_sum(HInt array); // Wraps around like int arithmetic
+HInt array_min(HInt array);
+HInt array_max(HInt array);
+// mask[i] != 0 ? whenTrue[i] : whenFalse[i], either of the values may be a scalar
+HInt array_select(HInt mask, uint32_t maskFlags, HInt whenTrue, uint32_t trueFlags, HInt whenFalse, uint32_t falseFlags);
+
+// Runs builtin, the operand flags of arguments[i] are at bit 2 * i of operandFlags. Returns a handle for the builtins
+// that make arrays
+HInt run_builtin(Builtin builtin, const HInt* arguments, uint32_t operandFlags);
+
+// "avx2", "sse2" or "scalar"
+const char* array_kernels_name();
+// Makes every thread use the kernels called name, false when the cpu can not run them. Meant for benchmarks
+bool select_array_kernels(const char* name);
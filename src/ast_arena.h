@@ -0,0 +1,150 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "diagnostics.h"
+
+// Byte offset of a node inside its AstArena, 0 is the null reference.
+// Offsets instead of pointers keep references valid while the arena grows and make the arena position independent
+template<typename T>
+struct NodeRef {
+    uint32_t offset = 0;
+
+    NodeRef() = default;
+    explicit NodeRef(uint32_t offset): offset(offset) {}
+    // References convert to references of a base node type
+    template<typename U, typename = typename std::enable_if<std::is_base_of<T, U>::value>::type>
+    NodeRef(NodeRef<U> other): offset(other.offset) {}
+
+    explicit operator bool() const { return offset != 0; }
+    bool operator==(const NodeRef& other) const { return offset == other.offset; }
+    bool operator!=(const NodeRef& other) const { return offset != other.offset; }
+
+    // Nodes share a common Node header so a reference can be viewed as any node type, check Node::type first
+    template<typename U>
+    NodeRef<U> as() const { return NodeRef<U>(offset); }
+};
+
+// Array of node references stored in the arena
+template<typename T>
+struct NodeList {
+    uint32_t offset = 0;
+    uint32_t count = 0;
+};
+
+template<typename T>
+struct NodeSpan {
+    const NodeRef<T>* first;
+    uint32_t count;
+
+    const NodeRef<T>* begin() const { return first; }
+    const NodeRef<T>* end() const { return first + count; }
+    uint32_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    NodeRef<T> operator[](uint32_t index) const { return first[index]; }
+};
+
+// Bump allocator owning every node of a program. Nodes are never freed on their own, the whole arena goes at once.
+// Node pointers returned by get/operator[] are only valid until the next allocation, hold NodeRefs across allocations
+class AstArena {
+public:
+    AstArena() {
+        words.resize(1); // Offset 0 is reserved for null references
+    }
+
+    // Read only arena over size bytes of a previous arena's bytes(), the memory has to outlive the arena.
+    // Nothing can be allocated in it, used to run program images straight from their mapping
+    static AstArena view(const void* bytes, size_t size) {
+        AstArena arena;
+        arena.words.clear();
+        arena.external = (const uint8_t*)bytes;
+        arena.used = size;
+        return arena;
+    }
+    // Owned copy of a previous arena's bytes()
+    static AstArena copy(const void* bytes, size_t size) {
+        AstArena arena;
+        arena.words.resize((size + 7) / sizeof(uint64_t));
+        memcpy(arena.words.data(), bytes, size);
+        arena.used = size;
+        return arena;
+    }
+
+    template<typename T>
+    NodeRef<T> create() {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena nodes are never destructed");
+        static_assert(alignof(T) <= alignof(uint64_t), "Arena nodes can be at most 8 byte aligned");
+        NodeRef<T> ref{allocate(sizeof(T))};
+        new (data() + ref.offset) T();
+        return ref;
+    }
+
+    template<typename T>
+    NodeList<T> createList(const std::vector<NodeRef<T>>& refs) {
+        if(refs.empty()) return {};
+        NodeList<T> list{allocate(refs.size() * sizeof(NodeRef<T>)), (uint32_t)refs.size()};
+        memcpy(data() + list.offset, refs.data(), refs.size() * sizeof(NodeRef<T>));
+        return list;
+    }
+
+    template<typename T>
+    T& operator[](NodeRef<T> ref) { return *(T*)(data() + ref.offset); }
+    template<typename T>
+    const T& operator[](NodeRef<T> ref) const { return *(const T*)(data() + ref.offset); }
+
+    template<typename T>
+    NodeSpan<T> operator[](NodeList<T> list) const {
+        return {(const NodeRef<T>*)(data() + list.offset), list.count};
+    }
+
+    template<typename T>
+    void setListItem(NodeList<T> list, uint32_t index, NodeRef<T> ref) {
+        memcpy(data() + list.offset + index * sizeof(NodeRef<T>), &ref, sizeof(NodeRef<T>));
+    }
+
+    // Copies every node of other to the end of this arena and returns how far other's offsets moved.
+    // References inside the copied nodes keep their old offsets until the caller relocates them
+    uint32_t append(const AstArena& other) {
+        size_t bytes = other.used - sizeof(uint64_t);
+        uint32_t offset = allocate(bytes);
+        memcpy(data() + offset, other.data() + sizeof(uint64_t), bytes);
+        return offset - (uint32_t)sizeof(uint64_t);
+    }
+
+    // Bytes in use
+    size_t size() const { return used; }
+    // Every node with the null reference word in front, offsets index straight into this
+    const uint8_t* bytes() const { return data(); }
+    bool isView() const { return external != nullptr; }
+
+private:
+    uint8_t* data() { return external ? (uint8_t*)external : (uint8_t*)words.data(); }
+    const uint8_t* data() const { return external ? external : (const uint8_t*)words.data(); }
+
+    uint32_t allocate(size_t bytes) {
+        if(external) {
+            hlang_error("Can not add nodes to a read only syntax tree");
+        }
+        size_t offset = used;
+        size_t end = offset + ((bytes + 7) & ~(size_t)7);
+        if(end > UINT32_MAX) {
+            hlang_error("Program is too large, the syntax tree does not fit in 4GB");
+        }
+        if(end > words.size() * sizeof(uint64_t)) {
+            words.resize(std::max(words.size() * 2, end / sizeof(uint64_t)));
+        }
+        used = end;
+        return (uint32_t)offset;
+    }
+
+    std::vector<uint64_t> words;
+    const uint8_t* external = nullptr;
+    size_t used = sizeof(uint64_t);
+};
@@ -0,0 +1,907 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include "char_class.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "aot.h"
+#include "array.h"
+#include "hlang.h"
+#include "jit.h"
+#include "program_image.h"
+#include "resolver.h"
+#include "vm.h"
+
+// Generates a program with roughly lineCount lines mixing declarations, arithmetic and branches
+std::string generate_program(size_t lineCount) {
+    std::string program = "int v0 = 1\n";
+    size_t lines = 1;
+    size_t variables = 1;
+    char line[256];
+    while(lines < lineCount) {
+        switch (lines % 4) {
+            case 0:
+                snprintf(line, sizeof(line), "int v%zu = v%zu * 3 + %zu - (v%zu / 2)\n", variables, variables - 1, lines, variables / 2);
+                variables++;
+                lines++;
+                break;
+            case 1:
+            case 2:
+                snprintf(line, sizeof(line), "v%zu = v%zu + 2 * %zu // update\n", variables - 1, variables / 3, lines);
+                lines++;
+                break;
+            default:
+                snprintf(line, sizeof(line), "if v%zu <= %zu then\n    v%zu = v%zu - 1\nend\n", variables - 1, lines, variables - 1, variables - 1);
+                lines += 3;
+                break;
+        }
+        program += line;
+    }
+    return program;
+}
+
+// Program made of functionCount small functions, changedFunction gets a different body
+std::string generate_functions(size_t functionCount, size_t changedFunction) {
+    std::string program;
+    char function[512];
+    for(size_t i = 0; i < functionCount; i++) {
+        snprintf(function, sizeof(function),
+                 "int f%zu(int a) do\n    int b = a * %zu + 2\n    if b > %zu then\n        b = b - a\n    end\n    return b\nend\n\n",
+                 i, i == changedFunction ? i + 1 : i, i);
+        program += function;
+    }
+    return program;
+}
+
+void write_file(const char* fileName, const std::string& content) {
+    FILE* file = fopen(fileName, "wb");
+    if(!file) {
+        fprintf(stderr, "Could not write %s\n", fileName);
+        exit(-1);
+    }
+    fwrite(content.data(), 1, content.size(), file);
+    fclose(file);
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Behaviour every timing below relies on, checked before anything is timed. Any failure makes hlangbench exit with 1
+int failedChecks = 0;
+
+void check(bool passed, const char* name) {
+    if(passed) return;
+    fprintf(stderr, "Check failed: %s\n", name);
+    failedChecks++;
+}
+
+// Value of the literal the default value of the first top level declaration of script folded to, or 0 if it did not fold
+HInt folded_value(const char* script) {
+    TokenStream tokens(SourceFile::copy(script), true);
+    auto program = parseTokens(tokens);
+    auto& ast = program->ast;
+    auto declaration = ast[ast[program->programBlock].statements][0].as<DeclarationNode>();
+    auto operation = ast[ast[declaration].defaultValueExpression].operation;
+    return ast[operation].type == NodeType::NUMBER ? ast[operation.as<NumberNode>()].value : 0;
+}
+
+// Literal arithmetic folds with the wrapping int semantics of the runtime instead of trapping in the parser
+void check_constant_folding() {
+    check(folded_value("int a = (0-2147483647-1)/(0-1)\n") == INT32_MIN, "folded INT_MIN / -1 is INT_MIN");
+    check(folded_value("int a = 2147483647 + 1\n") == INT32_MIN, "folded + wraps around");
+    check(folded_value("int a = 65536 * 65536 + 7\n") == 7, "folded * wraps around");
+    check(folded_value("int a = 0 - 2147483647 - 2\n") == INT32_MAX, "folded - wraps around");
+}
+
+// Parses script sequentially or on threadCount threads, null when it does not parse
+std::shared_ptr<ProgramNode> parse_script(const char* script, unsigned threadCount) {
+    DiagnosticScope scope;
+    try {
+        TokenStream tokens(SourceFile::copy(script), true);
+        return threadCount > 1 ? parseTokensParallel(tokens, threadCount) : parseTokens(tokens);
+    } catch (HlangError&) {
+        return nullptr;
+    }
+}
+
+HInt read_global(const ProgramNode& program, const char* name);
+
+// Global result after running program on the VM, or INT32_MIN when it fails to compile or run
+HInt run_result(ProgramNode& program) {
+    DiagnosticScope scope;
+    try {
+        run_bytecode(*compileBytecode(program));
+        return read_global(program, "result");
+    } catch (HlangError&) {
+        return INT32_MIN;
+    }
+}
+
+// The parallel parser accepts exactly what the sequential one does and gives the same program. Statements only see
+// declarations made before them, identifiers declared in earlier function bodies included
+void check_parallel_parse() {
+    const char* scripts[] = {
+            "int f() do\n    return g\nend\nint g = 1\nint result = 0\n",
+            "int f(int n) do\n    return h(n)\nend\nint h(int n) do\n    return n\nend\nint result = 0\n",
+            "int result = h(1)\nint h(int n) do\n    return n\nend\n",
+            "int f() do\n    int leaked = 2\n    return leaked\nend\nint g() do\n    return leaked\nend\nint result = 0\n",
+            "int[] xs = int_array(4)\nxs[1] = 5\nint result = sum(xs)\nint sum(int[] a) do\n    return 1\nend\nresult = result + sum(xs)\n",
+            "int base = 10\nint f(int n) do\n    return n + base\nend\nint g(int n) do\n    return f(n) * 2\nend\nint result = g(1)\n",
+    };
+    for(const char* script: scripts) {
+        auto sequential = parse_script(script, 1);
+        auto parallel = parse_script(script, 4);
+        check(!sequential == !parallel, "parallel parse accepts what the sequential parse accepts");
+        if(!sequential || !parallel) continue;
+        check(sequential->declarations == parallel->declarations, "parallel parse leaves the same declarations");
+        check(run_result(*parallel) == run_result(*sequential), "parallel parse runs like the sequential parse");
+    }
+}
+
+// Where edited differs from original, like an editor reports its changes
+SourceEdit find_edit(const std::string& original, const std::string& edited) {
+    size_t prefix = std::mismatch(original.begin(), original.end(), edited.begin(), edited.end()).first - original.begin();
+    size_t suffix = std::mismatch(original.rbegin(), original.rend() - prefix, edited.rbegin(), edited.rend() - prefix).first - original.rbegin();
+    return {prefix, original.size() - prefix - suffix, edited.size() - prefix - suffix};
+}
+
+// A program reparsed edit by edit keeps its statement starts and runs like a full parse of the last version
+void check_reparse() {
+    std::string versions[] = {
+            "int a = 1\nint f(int n) do\n    return n + a\nend\nint b = 2\nint result = f(b)\n",
+            "int a = 5\nint f(int n) do\n    return n + a\nend\nint b = 2\nint result = f(b)\n",
+            "int a = 5\nint c = 7\nint f(int n) do\n    return n + a\nend\nint b = 2\nint result = f(b)\n",
+            "int a = 5\nint c = 7\nint f(int n) do\n    return n * 2 + c\nend\nint b = 2\nint result = f(b)\n",
+            "int a = 5\nint c = 7\nint f(int n) do\n    return n * 2 + c\nend\nint b = 30\nint result = f(b)\n",
+            "int a = 5\nint f(int n) do\n    return n * 2 + a\nend\nint b = 30\nint result = f(b)\n",
+    };
+    TokenStream tokens(SourceFile::copy(versions[0]), true);
+    std::shared_ptr<ProgramNode> program = parseTokens(tokens);
+    for(size_t i = 1; i < sizeof(versions) / sizeof(versions[0]); i++) {
+        program = reparseSource(program, SourceFile::copy(versions[i]), find_edit(versions[i - 1], versions[i]));
+        auto full = parse_script(versions[i].c_str(), 1);
+        bool sameStarts = full && full->statementStarts.size() == program->statementStarts.size();
+        for(size_t j = 0; sameStarts && j < full->statementStarts.size(); j++) {
+            sameStarts = full->statementStarts[j] == program->statementStarts[j];
+        }
+        check(sameStarts, "reparsing an edit leaves the statement starts of a full parse");
+        check(full && run_result(*program) == run_result(*full), "reparsing an edit runs like a full parse");
+    }
+}
+
+// A lazily skipped body that fails to parse leaves the next parse on the thread eager
+void check_lazy_body_error() {
+    TokenStream tokens(SourceFile::copy("int f(int a) do\n    return a +\nend\nint result = 0\n"), true);
+    auto lazy = parseTokens(tokens, true);
+    auto& ast = lazy->ast;
+    auto function = ast[ast[lazy->programBlock].statements][0].as<FunctionDeclarationNode>();
+    {
+        DiagnosticScope scope;
+        try {
+            parseFunctionBody(*lazy, function);
+        } catch (HlangError&) {
+        }
+    }
+    auto eager = parse_script("int g(int a) do\n    return a\nend\nint h(int a) do\n    return a\nend\n", 2);
+    bool parsed = eager != nullptr;
+    for(uint32_t i = 0; parsed && i < eager->ast[eager->programBlock].statements.count; i++) {
+        auto statement = eager->ast[eager->ast[eager->programBlock].statements][i].as<FunctionDeclarationNode>();
+        parsed = (bool)eager->ast[statement].functionBlock;
+    }
+    check(parsed, "a failed lazy body parse does not leave later parses lazy");
+}
+
+// Errors a context reports instead of taking the host down
+void check_context_errors() {
+    HlangContext context;
+    check(!context.compileSource("int x = 99999999999\n"), "out of range literal fails to compile");
+    check(context.lastError().location.line == 1 && context.lastError().location.column == 9,
+          "out of range literal is reported at its location");
+    check(context.compileSource("int x = 2147483647\n"), "largest int literal compiles");
+
+    HlangContext first, second;
+    HInt value = 0;
+    check(first.compileSource("int x = 1\nint y = 2\n") && first.run(), "first context runs");
+    check(second.compileSource("int y = 7\nint x = 8\n") && second.run(), "second context runs");
+    check(first.readInt("x", value) && value == 1, "a context reads its own globals after another context ran");
+    check(!first.readInt("neverDeclaredAnywhere", value), "reading an unknown global fails");
+    SymbolId unused;
+    check(!find_symbol("neverDeclaredAnywhere", unused), "reading an unknown global does not intern its name");
+}
+
+// Overflowing int arithmetic at runtime, every backend has to give these values
+const char* overflowScript =
+        "int m = 0-2147483647-1\nint n = 0-1\nint big = 2147483647\n"
+        "int quotient = m / n\nint constantQuotient = m / (0-1)\nint g = m\ng = g / (0-1)\n"
+        "int sum = big + 1\nint product = big * n * big\nint difference = m - 1\n"
+        "int negate() do\n    g = g / (0-1)\n    sum = sum - 1\n    return 0\nend\nint negated = negate()\n";
+const std::pair<const char*, HInt> overflowResults[] = {
+        {"quotient", INT32_MIN}, {"constantQuotient", INT32_MIN}, {"g", INT32_MIN},
+        {"sum", INT32_MAX}, {"product", -1}, {"difference", INT32_MAX}
+};
+
+void check_int_semantics() {
+    TokenStream tokens(SourceFile::copy(overflowScript), true);
+    auto program = parseTokens(tokens);
+    run_program(program);
+    for(auto& expected: overflowResults) {
+        check(get_int_var(expected.first) == expected.second, "tree interpreter wraps int arithmetic");
+    }
+    run_bytecode(*compileBytecode(*program));
+    for(auto& expected: overflowResults) {
+        check(read_global(*program, expected.first) == expected.second, "vm wraps int arithmetic");
+    }
+}
+
+// Divisions by -1 in functions hot enough to run as native code, INT_MIN / -1 must not trap there
+const char* jitDivisionScript =
+        "int divide(int a, int b) do\n    return a / b\nend\n"
+        "int negate(int a) do\n    return a / (0-1)\nend\n"
+        "int m = 0-2147483647-1\nint quotient = 0\nint negated = 0\nint i = 0\n"
+        "while i < 5000 do\n    quotient = divide(m, 0-1) + divide(7, 0-1) - divide(7, 2)\n"
+        "    negated = negate(m) + negate(5)\n    i = i + 1\nend\n";
+
+void check_jit_division() {
+    if(!jit_supported()) return;
+    TokenStream tokens(SourceFile::copy(jitDivisionScript), true);
+    auto program = parseTokens(tokens);
+    auto bytecode = compileBytecode(*program);
+    set_vm_jit(true);
+    run_bytecode(*bytecode);
+    check(vm_jit_compiled_count() >= 2, "hot division functions are compiled");
+    set_vm_jit(false);
+    check(read_global(*program, "quotient") == wrapping_sub(INT32_MIN, 10), "native INT_MIN / -1 register divisor");
+    check(read_global(*program, "negated") == wrapping_add(INT32_MIN, -5), "native INT_MIN / -1 immediate divisor");
+}
+
+// Globals read before a call that sets them keep the value they had when read, on every backend
+const char* operandOrderScript =
+        "int x = 1\nint i = 1\nint k = 0\nint[] xs = int_array(4)\n"
+        "int f() do\n    x = 100\n    return 0\nend\n"
+        "int g() do\n    i = 2\n    return 5\nend\n"
+        "int h() do\n    x = 0-5\n    return 0\nend\n"
+        "int bump() do\n    k = k + 1000\n    return 0\nend\n"
+        "int y = x + f()\nxs[i] = g()\nint stored = xs[1]\nint taken = 0\n"
+        "if x < h() then\n    taken = 1\nend\n"
+        "int total = 0\nint n = 0\nwhile n < 3000 do\n    total = k + bump() + total\n    n = n + 1\nend\n";
+const char* operandOrderGlobals[] = {"y", "stored", "taken", "total", "k"};
+
+void check_operand_order() {
+    TokenStream tokens(SourceFile::copy(operandOrderScript), true);
+    auto program = parseTokens(tokens);
+    run_program(program);
+    HInt expected[sizeof(operandOrderGlobals) / sizeof(operandOrderGlobals[0])];
+    for(size_t i = 0; i < sizeof(operandOrderGlobals) / sizeof(operandOrderGlobals[0]); i++) {
+        expected[i] = get_int_var(operandOrderGlobals[i]);
+    }
+    check(expected[0] == 1 && expected[1] == 5 && expected[2] == 0, "tree interpreter reads operands in order");
+    auto bytecode = compileBytecode(*program);
+    for(bool jit: {false, true}) {
+        if(jit && !jit_supported()) continue;
+        set_vm_jit(jit, 100);
+        run_bytecode(*bytecode);
+        for(size_t i = 0; i < sizeof(operandOrderGlobals) / sizeof(operandOrderGlobals[0]); i++) {
+            check(read_global(*program, operandOrderGlobals[i]) == expected[i],
+                  jit ? "tiered vm reads operands like the tree interpreter" : "vm reads operands like the tree interpreter");
+        }
+    }
+    set_vm_jit(false);
+}
+
+// Skipped bodies are compiled on their first call. broken is never called so its parse error never comes up, outer
+// is first called from native code of hot and declares a global and a function
+const char* lazyCallScript =
+        "int broken() do\n    return 1 +\nend\n"
+        "int outer(int n) do\n    global int seen = n\n    int inner(int m) do\n        return m * 2\n    end\n"
+        "    return inner(n) + 1\nend\n"
+        "int hot(int n) do\n    if n > 2900 then\n        return outer(n)\n    end\n    return n\nend\n"
+        "int result = 0\nint i = 0\nwhile i < 3000 do\n    result = result + hot(i)\n    i = i + 1\nend\n";
+
+void check_lazy_calls() {
+    HInt expected = 0;
+    for(HInt i = 0; i < 3000; i++) expected += i > 2900 ? i * 2 + 1 : i;
+    {
+        TokenStream tokens(SourceFile::copy(lazyCallScript), true);
+        auto program = parseTokens(tokens, true);
+        DiagnosticScope scope;
+        try {
+            run_program(program);
+            check(!program->ast[program->functions[0]].functionBlock, "run_program leaves uncalled bodies unparsed");
+            check(get_int_var("result") == expected, "tree interpreter parses bodies on their first call");
+            check(get_int_var("seen") == 2999, "tree interpreter keeps room for globals of bodies parsed late");
+        } catch (HlangError&) {
+            check(false, "an uncalled body that does not parse is no error for the tree interpreter");
+        }
+    }
+    for(bool jit: {false, true}) {
+        if(jit && !jit_supported()) continue;
+        TokenStream tokens(SourceFile::copy(lazyCallScript), true);
+        auto program = parseTokens(tokens, true);
+        DiagnosticScope scope;
+        try {
+            auto bytecode = compileBytecode(*program);
+            check(!program->ast[program->functions[0]].functionBlock, "compiling bytecode leaves bodies unparsed");
+            set_vm_jit(jit, 100);
+            run_bytecode(*bytecode);
+            check(read_global(*program, "result") == expected, "functions compiled on their first call run");
+            check(read_global(*program, "seen") == 2999, "a global declared in a body compiled on its first call");
+        } catch (HlangError&) {
+            check(false, "an uncalled body that does not parse is no error");
+        }
+        set_vm_jit(false);
+    }
+
+    TokenStream tokens(SourceFile::copy("int broken() do\n    return 1 +\nend\nint result = broken()\n"), true);
+    auto program = parseTokens(tokens, true);
+    DiagnosticScope scope;
+    bool raised = false;
+    try {
+        run_bytecode(*compileBytecode(*program));
+    } catch (HlangError&) {
+        raised = true;
+    }
+    check(raised, "a called body that does not parse is an error");
+    raised = false;
+    try {
+        run_program(program);
+    } catch (HlangError&) {
+        raised = true;
+    }
+    check(raised, "a called body that does not parse is an error for the tree interpreter");
+}
+
+// The overflow script compiled ahead of time, scalar division by -1 included. Skipped without a C compiler.
+// The library name would mean something to a shell, the compiler has to get it as it is
+void check_aot_int_semantics(const char* fileName) {
+    TokenStream tokens(SourceFile::copy(overflowScript), true);
+    auto program = parseTokens(tokens);
+    std::string cFile = std::string(fileName) + ".c";
+    std::string library = std::string(fileName) + " \"$(exit 1)\";'.so";
+    write_file(cFile.c_str(), compileToC(*program, "overflow"));
+    auto module = buildSharedObject(cFile.c_str(), library.c_str()) ? AotModule::load(library.c_str()) : nullptr;
+    if(!module) {
+        std::string plainLibrary = std::string(fileName) + ".so";
+        check(!buildSharedObject(cFile.c_str(), plainLibrary.c_str()), "library names are passed to the C compiler as they are");
+        remove(plainLibrary.c_str());
+    }
+    remove(cFile.c_str());
+    if(module) {
+        module->run();
+        for(auto& expected: overflowResults) {
+            HInt value = 0;
+            check(module->readInt(expected.first, value) && value == expected.second, "ahead of time compiled C wraps int arithmetic");
+        }
+    }
+    module = nullptr;
+    remove(library.c_str());
+}
+
+void bench_front_end(const char* fileName, size_t lineCount) {
+    std::string program = generate_program(lineCount);
+    write_file(fileName, program);
+
+    auto start = std::chrono::steady_clock::now();
+    TokenStream tokens = tokenize(fileName);
+    double tokenizeTime = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    auto ast = parseTokens(tokens);
+    double parseTime = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    TokenStream streamed = stream_tokens(fileName);
+    auto streamedAst = parseTokens(streamed);
+    double streamTime = elapsed_ms(start);
+
+    printf("%9zu lines %10zu bytes | tokenize %9.2f ms | parse %9.2f ms | streamed %9.2f ms | %7.1f ns/line\n",
+           lineCount, program.size(), tokenizeTime, parseTime, streamTime, (tokenizeTime + parseTime) * 1e6 / lineCount);
+}
+
+// Reparsing a one line edit should not depend on how many other functions there are. Finding the edit by comparing
+// both versions does, it is timed on its own
+void bench_reload(const char* fileName, size_t functionCount) {
+    std::string original = generate_functions(functionCount, SIZE_MAX);
+    std::string changed = generate_functions(functionCount, functionCount / 2);
+    write_file(fileName, original);
+    TokenStream tokens = tokenize(fileName);
+    auto program = parseTokens(tokens);
+    TokenStream diffTokens = tokenize(fileName);
+    auto diffProgram = parseTokens(diffTokens);
+
+    // Written next to the original, rewriting a mapped file in place would change the previous source under us
+    std::string editedFileName = std::string(fileName) + ".edited";
+    write_file(editedFileName.c_str(), changed);
+    auto edited = SourceFile::map(editedFileName.c_str());
+    SourceEdit edit = find_edit(original, changed);
+    auto start = std::chrono::steady_clock::now();
+    auto reparsed = reparseSource(program, edited, edit);
+    double reloadTime = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    reparseSource(diffProgram, edited);
+    double diffTime = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    TokenStream fullTokens = tokenize(editedFileName.c_str());
+    auto fullProgram = parseTokens(fullTokens);
+    double fullTime = elapsed_ms(start);
+    remove(editedFileName.c_str());
+
+    printf("%9zu functions | one line edit reparse %9.3f ms | found by comparing %9.3f ms | full parse %9.2f ms\n",
+           functionCount, reloadTime, diffTime, fullTime);
+}
+
+// Startup with lazy bodies only pays for the functions that end up being called, here one in a hundred
+void bench_lazy_parse(const char* fileName, size_t functionCount) {
+    write_file(fileName, generate_functions(functionCount, SIZE_MAX));
+
+    auto start = std::chrono::steady_clock::now();
+    TokenStream tokens = stream_tokens(fileName);
+    auto program = parseTokens(tokens);
+    double eagerTime = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    TokenStream lazyTokens = stream_tokens(fileName);
+    auto lazyProgram = parseTokens(lazyTokens, true);
+    double lazyTime = elapsed_ms(start);
+
+    // Bodies are left for their first call
+    start = std::chrono::steady_clock::now();
+    auto eagerBytecode = compileBytecode(*program);
+    double eagerCompileTime = elapsed_ms(start);
+    start = std::chrono::steady_clock::now();
+    auto lazyBytecode = compileBytecode(*lazyProgram);
+    double lazyCompileTime = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    auto& ast = lazyProgram->ast;
+    auto statements = ast[ast[lazyProgram->programBlock].statements];
+    for(size_t i = 0; i < statements.size(); i += 100) {
+        parseFunctionBody(*lazyProgram, statements[i].as<FunctionDeclarationNode>());
+    }
+    double bodyTime = elapsed_ms(start);
+
+    printf("%9zu functions | eager parse %9.2f ms | lazy parse %9.2f ms | 1%% of bodies %7.2f ms | bytecode compile eager %7.2f ms lazy %7.2f ms\n",
+           functionCount, eagerTime, lazyTime, bodyTime, eagerCompileTime, lazyCompileTime);
+}
+
+void bench_parallel_parse(const char* fileName, size_t functionCount) {
+    write_file(fileName, generate_functions(functionCount, SIZE_MAX));
+    TokenStream tokens = tokenize(fileName);
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for(unsigned threadCount = 1; threadCount <= maxThreads; threadCount *= 2) {
+        auto start = std::chrono::steady_clock::now();
+        auto program = parseTokensParallel(tokens, threadCount);
+        printf("%9zu functions | %2u threads | parse %9.2f ms\n", functionCount, threadCount, elapsed_ms(start));
+    }
+}
+
+// Cold start from a program image against compiling the source, the symbols are already interned by the compile
+// so the image is loaded through the copy and rewrite path here, a fresh process maps it as is
+void bench_program_image(const char* fileName, size_t lineCount) {
+    write_file(fileName, generate_program(lineCount));
+    std::string imageFileName = std::string(fileName) + ".image";
+    auto source = SourceFile::map(fileName);
+
+    auto start = std::chrono::steady_clock::now();
+    TokenStream tokens(source, true);
+    auto program = parseTokens(tokens);
+    double compileTime = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    writeProgramImage(*program, imageFileName.c_str());
+    double writeTime = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    auto loaded = loadProgramImage(imageFileName.c_str(), *source);
+    double loadTime = elapsed_ms(start);
+    remove(imageFileName.c_str());
+
+    printf("%9zu lines | compile %9.2f ms | write image %7.2f ms | load image %7.2f ms%s\n",
+           lineCount, compileTime, writeTime, loadTime, loaded ? "" : " (failed)");
+}
+
+// Name resolution is paid once per compile, every run after that reads variables by slot.
+// Declarations, arithmetic and branches like vardec.hlang and branching.hlang, scaled up
+void bench_run(const char* fileName, size_t lineCount) {
+    write_file(fileName, generate_program(lineCount));
+    TokenStream tokens = tokenize(fileName);
+    auto program = parseTokens(tokens);
+
+    auto start = std::chrono::steady_clock::now();
+    resolveNames(*program);
+    double resolveTime = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    run_program(program);
+    double runTime = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    auto bytecode = compileBytecode(*program);
+    double compileTime = elapsed_ms(start);
+
+    start = std::chrono::steady_clock::now();
+    run_bytecode(*bytecode);
+    double vmTime = elapsed_ms(start);
+
+    printf("%9zu lines | resolve %9.2f ms | run_program %9.2f ms | bytecode compile %9.2f ms | vm %9.2f ms\n",
+           lineCount, resolveTime, runTime, compileTime, vmTime);
+}
+
+// Recursive calls like factorial.hlang and function_call_params_return.hlang, scaled up. Every call counts itself in a global
+std::string generate_calls(int fibArgument) {
+    char script[512];
+    snprintf(script, sizeof(script),
+             "int calls = 0\n\n"
+             "int fib(int n) do\n    calls = calls + 1\n    if n < 2 then\n        return n\n    end\n    return fib(n - 1) + fib(n - 2)\nend\n\n"
+             "int factorial(int num) do\n    calls = calls + 1\n    if num == 1 then\n        return num\n    end\n    return num * factorial(num - 1)\nend\n\n"
+             "int result = fib(%d) + factorial(12)\n", fibArgument);
+    return script;
+}
+
+HInt read_global(const ProgramNode& program, const char* name) {
+    HInt value = 0;
+    uint32_t slot;
+    if(findGlobalSlot(program, intern_symbol(name), slot)) read_bytecode_global(slot, value);
+    return value;
+}
+
+void bench_calls(int fibArgument) {
+    TokenStream tokens(SourceFile::copy(generate_calls(fibArgument)), true);
+    auto program = parseTokens(tokens);
+
+    auto start = std::chrono::steady_clock::now();
+    run_program(program);
+    double runTime = elapsed_ms(start);
+    HInt treeResult = get_int_var("result");
+
+    auto bytecode = compileBytecode(*program);
+    start = std::chrono::steady_clock::now();
+    run_bytecode(*bytecode);
+    double vmTime = elapsed_ms(start);
+
+    HInt calls = read_global(*program, "calls");
+    printf("fib(%d) | run_program %9.2f ms %6.1f ns/call | vm %9.2f ms %6.1f ns/call | result %d %d\n", fibArgument,
+           runTime, runTime * 1e6 / calls, vmTime, vmTime * 1e6 / calls, treeResult, read_global(*program, "result"));
+}
+
+// Tail calls reuse the frame of the caller, the depth is far beyond what either call stack would allow
+void bench_tail_calls(int depth) {
+    char script[256];
+    snprintf(script, sizeof(script),
+             "int count(int n, int acc) do\n    if n == 0 then\n        return acc\n    end\n    return count(n - 1, acc + 1)\nend\n\n"
+             "int result = count(%d, 0)\n", depth);
+    TokenStream tokens(SourceFile::copy(script), true);
+    auto program = parseTokens(tokens);
+
+    auto start = std::chrono::steady_clock::now();
+    run_program(program);
+    double runTime = elapsed_ms(start);
+    HInt treeResult = get_int_var("result");
+
+    auto bytecode = compileBytecode(*program);
+    start = std::chrono::steady_clock::now();
+    run_bytecode(*bytecode);
+    double vmTime = elapsed_ms(start);
+
+    printf("count(%d) tail calls | run_program %9.2f ms | vm %9.2f ms | result %d %d\n", depth, runTime, vmTime,
+           treeResult, read_global(*program, "result"));
+}
+
+// Arithmetic in a tail recursive loop. acc stays below 1000 so nothing overflows
+std::string generate_arithmetic_loop(int iterations) {
+    char script[512];
+    snprintf(script, sizeof(script),
+             "int mix(int n, int acc) do\n    if n == 0 then\n        return acc\n    end\n"
+             "    int next = (acc * 31 + n) - ((acc * 31 + n) / 1000) * 1000\n    return mix(n - 1, next)\nend\n\n"
+             "int result = mix(%d, 1)\n", iterations);
+    return script;
+}
+
+// The same arithmetic as a while loop in the top level code
+std::string generate_while_loop(int iterations) {
+    char script[512];
+    snprintf(script, sizeof(script),
+             "int result = 1\nint n = %d\n"
+             "while n > 0 do\n    int next = (result * 31 + n) - ((result * 31 + n) / 1000) * 1000\n"
+             "    result = next\n    n = n - 1\nend\n", iterations);
+    return script;
+}
+
+// One run of the script does every iteration, a host used to enter the interpreter once per iteration instead.
+// The tiered run starts interpreting and finishes the loop in native code once it is hot
+void bench_loop(int iterations) {
+    TokenStream tokens(SourceFile::copy(generate_while_loop(iterations)), true);
+    auto program = parseTokens(tokens);
+
+    auto start = std::chrono::steady_clock::now();
+    run_program(program);
+    double runTime = elapsed_ms(start);
+    HInt treeResult = get_int_var("result");
+
+    auto bytecode = compileBytecode(*program);
+    start = std::chrono::steady_clock::now();
+    run_bytecode(*bytecode);
+    double vmTime = elapsed_ms(start);
+
+    set_vm_jit(true);
+    start = std::chrono::steady_clock::now();
+    run_bytecode(*bytecode);
+    double jitTime = elapsed_ms(start);
+    set_vm_jit(false);
+
+    uint64_t counted = vm_loop_iterations(0);
+    printf("while %d | run_program %9.2f ms %6.2f ns/iteration | vm %9.2f ms %6.2f ns/iteration | tiered %9.2f ms %6.2f ns/iteration | "
+           "%llu iterations counted | result %d %d\n", iterations, runTime, runTime * 1e6 / iterations, vmTime,
+           vmTime * 1e6 / iterations, jitTime, jitTime * 1e6 / iterations, (unsigned long long)counted, treeResult,
+           read_global(*program, "result"));
+}
+
+// The VM interpreting everything against tiered runs that compile hot functions to native code
+void bench_jit(const char* name, const std::string& script) {
+    TokenStream tokens(SourceFile::copy(script), true);
+    auto program = parseTokens(tokens);
+    auto bytecode = compileBytecode(*program);
+
+    set_vm_jit(false);
+    auto start = std::chrono::steady_clock::now();
+    run_bytecode(*bytecode);
+    double vmTime = elapsed_ms(start);
+    HInt vmResult = read_global(*program, "result");
+
+    set_vm_jit(true);
+    start = std::chrono::steady_clock::now();
+    run_bytecode(*bytecode);
+    double jitTime = elapsed_ms(start);
+    uint32_t compiled = vm_jit_compiled_count();
+    set_vm_jit(false);
+
+    printf("%-16s | vm %9.2f ms | tiered %9.2f ms, %u functions compiled | %5.2fx | result %d %d\n", name, vmTime,
+           jitTime, compiled, vmTime / jitTime, vmResult, read_global(*program, "result"));
+}
+
+// Tiered VM against the script compiled ahead of time with the system C compiler and loaded as a shared object
+void bench_aot(const char* fileName, const char* name, const std::string& script) {
+    TokenStream tokens(SourceFile::copy(script), true);
+    auto program = parseTokens(tokens);
+    auto bytecode = compileBytecode(*program);
+
+    set_vm_jit(true);
+    auto start = std::chrono::steady_clock::now();
+    run_bytecode(*bytecode);
+    double jitTime = elapsed_ms(start);
+    set_vm_jit(false);
+
+    std::string cFile = std::string(fileName) + ".c";
+    std::string library = std::string(fileName) + ".so";
+    write_file(cFile.c_str(), compileToC(*program, name));
+    start = std::chrono::steady_clock::now();
+    bool built = buildSharedObject(cFile.c_str(), library.c_str());
+    double buildTime = elapsed_ms(start);
+    auto module = built ? AotModule::load(library.c_str()) : nullptr;
+    remove(cFile.c_str());
+    if(!module) {
+        printf("%-16s | tiered %9.2f ms | no C compiler or the library did not load\n", name, jitTime);
+        remove(library.c_str());
+        return;
+    }
+    start = std::chrono::steady_clock::now();
+    module->run();
+    double aotTime = elapsed_ms(start);
+    HInt aotResult = 0;
+    module->readInt("result", aotResult);
+    module = nullptr;
+    remove(library.c_str());
+
+    printf("%-16s | tiered %9.2f ms | cc -O2 %9.2f ms, build %7.0f ms | result %d %d\n", name, jitTime, aotTime,
+           buildTime, read_global(*program, "result"), aotResult);
+}
+
+// Best of a few runs, straight line code only runs once and is noisy
+double best_vm_time(BytecodeProgram& bytecode) {
+    double best = 0;
+    for(int i = 0; i < 5; i++) {
+        auto start = std::chrono::steady_clock::now();
+        run_bytecode(bytecode);
+        double time = elapsed_ms(start);
+        if(i == 0 || time < best) best = time;
+    }
+    return best;
+}
+
+// Plain single operations against fused superinstructions, with the opcode pairs of the plain code they were picked from
+void bench_superinstructions(const char* name, ProgramNode& program) {
+    auto plain = compileBytecode(program, false);
+    auto fused = compileBytecode(program, true);
+    double plainTime = best_vm_time(*plain);
+    double fusedTime = best_vm_time(*fused);
+
+    size_t plainSize = 0, fusedSize = 0;
+    for(auto& function: plain->functions) plainSize += function.code.size();
+    for(auto& function: fused->functions) fusedSize += function.code.size();
+    printf("%-10s | plain %9.2f ms %8zu instructions | superinstructions %9.2f ms %8zu instructions\n",
+           name, plainTime, plainSize, fusedTime, fusedSize);
+    auto pairs = countOpcodePairs(*plain);
+    for(size_t i = 0; i < pairs.size() && i < 4; i++) {
+        printf("    %8u x %s, %s\n", pairs[i].first, opcode_name(pairs[i].second.first), opcode_name(pairs[i].second.second));
+    }
+}
+
+void bench_dispatch(const char* fileName) {
+    write_file(fileName, generate_program(1000000));
+    TokenStream tokens = tokenize(fileName);
+    auto program = parseTokens(tokens);
+    bench_superinstructions("generated", *program);
+
+    TokenStream callTokens(SourceFile::copy(generate_calls(30)), true);
+    auto calls = parseTokens(callTokens);
+    bench_superinstructions("fib(30)", *calls);
+}
+
+// Sum of the positive values of xs * 3 + 1, rounds times over an array of length elements. The element loop and the
+// whole array version give the same total
+std::string generate_array_program(int length, int rounds, bool wholeArrays) {
+    char script[1024];
+    snprintf(script, sizeof(script),
+             "int[] xs = int_array(%d)\nint i = 0\nwhile i < len(xs) do\n    xs[i] = (i * 7) - (i / 3) * 20\n    i = i + 1\nend\n"
+             "int result = 0\nint round = 0\nwhile round < %d do\n%s    round = round + 1\nend\n", length, rounds,
+             wholeArrays ? "    int[] ys = xs * 3 + 1\n    result = result + sum(select(ys > 0, ys, 0))\n" :
+                           "    i = 0\n    while i < len(xs) do\n        int y = xs[i] * 3 + 1\n"
+                           "        if y > 0 then\n            result = result + y\n        end\n        i = i + 1\n    end\n");
+    return script;
+}
+
+// Element at a time in hlang against whole array operators running the vector kernels, both tiered
+void bench_array_program(int length, int rounds) {
+    double times[2];
+    HInt results[2];
+    set_vm_jit(true);
+    for(int wholeArrays = 0; wholeArrays < 2; wholeArrays++) {
+        TokenStream tokens(SourceFile::copy(generate_array_program(length, rounds, wholeArrays)), true);
+        auto program = parseTokens(tokens);
+        auto bytecode = compileBytecode(*program);
+        auto start = std::chrono::steady_clock::now();
+        run_bytecode(*bytecode);
+        times[wholeArrays] = elapsed_ms(start);
+        results[wholeArrays] = read_global(*program, "result");
+    }
+    set_vm_jit(false);
+    double elements = (double)length * rounds;
+    printf("%d x %d elements | element loop %9.2f ms %6.2f ns/element | whole arrays %9.2f ms %6.2f ns/element | %5.2fx | "
+           "result %d %d\n", rounds, length, times[0], times[0] * 1e6 / elements, times[1], times[1] * 1e6 / elements,
+           times[0] / times[1], results[0], results[1]);
+}
+
+// Copy of array that array operations may write over, outside of the timings so they do not pay for touching new memory
+HInt scratch_copy(HInt array) {
+    return array_binary(OperatorType::ADD, array, operandArray, 0, 0);
+}
+
+// ns per element of every kernel family on each instruction set the cpu has. Results are written over temporaries
+void bench_array_kernels(int length, int rounds) {
+    const uint32_t temporary = operandArray | operandTemporary;
+    std::string selected = array_kernels_name();
+    for(const char* kernels: {"scalar", "sse2", "avx2"}) {
+        if(!select_array_kernels(kernels)) {
+            printf("%-6s | not supported\n", kernels);
+            continue;
+        }
+        double add = 0, mul = 0, compare = 0, sum = 0, extreme = 0, select = 0;
+        HInt check = 0;
+        for(int round = 0; round < rounds; round++) {
+            reset_arrays();
+            HInt values = array_new(ValueType::INT, length);
+            for(HInt i = 0; i < length; i++) array_set(values, i, i * 7 - length);
+            HInt product = scratch_copy(values);
+            HInt mask = scratch_copy(values);
+            HInt picked = scratch_copy(values);
+            auto start = std::chrono::steady_clock::now();
+            product = array_binary(OperatorType::ADD, values, operandArray, product, temporary);
+            add += elapsed_ms(start);
+            start = std::chrono::steady_clock::now();
+            product = array_binary(OperatorType::MUL, product, temporary, 3, 0);
+            mul += elapsed_ms(start);
+            start = std::chrono::steady_clock::now();
+            mask = array_binary(OperatorType::LESS_THAN, product, operandArray, mask, temporary);
+            compare += elapsed_ms(start);
+            start = std::chrono::steady_clock::now();
+            check += array_sum(product);
+            sum += elapsed_ms(start);
+            start = std::chrono::steady_clock::now();
+            check += array_min(product) + array_max(product);
+            extreme += elapsed_ms(start) / 2;
+            start = std::chrono::steady_clock::now();
+            picked = array_select(mask, operandArray, picked, temporary, 0, 0);
+            select += elapsed_ms(start);
+            check += array_sum(picked);
+        }
+        double elements = (double)length * rounds / 1e6;
+        printf("%-6s | add %5.2f | mul %5.2f | less than %5.2f | sum %5.2f | min/max %5.2f | select %5.2f ns/element | check %d\n",
+               kernels, add / elements, mul / elements, compare / elements, sum / elements, extreme / elements,
+               select / elements, check);
+    }
+    reset_arrays();
+    select_array_kernels(selected.c_str());
+}
+
+// Many small scripts through one warm context, every tenth one fails to compile
+void bench_context(size_t scriptCount) {
+    HlangContext context;
+    size_t failures = 0;
+    HInt sum = 0;
+    char script[256];
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < scriptCount; i++) {
+        if(i % 10 == 9) {
+            snprintf(script, sizeof(script), "int a = %zu\nint b = a / (3 - 3)\n", i);
+        } else {
+            snprintf(script, sizeof(script), "int a = %zu\nint b = a * 2 + (a - 1)\nbool big = b > 1000\n", i);
+        }
+        if(!context.compileSource(script) || !context.run()) {
+            failures++;
+            continue;
+        }
+        HInt value;
+        if(context.readInt("a", value)) sum += value;
+    }
+    double time = elapsed_ms(start);
+    printf("%9zu scripts | %7.2f ms | %9.0f scripts/s | %zu failed, last error: %s\n",
+           scriptCount, time, scriptCount * 1000.0 / time, failures, context.lastError().message.c_str());
+}
+
+int main(int argc, char* argv[]) {
+    const char* fileName = argc > 1 ? argv[1] : "hlangbench.hlang";
+    check_constant_folding();
+    check_parallel_parse();
+    check_reparse();
+    check_lazy_body_error();
+    check_context_errors();
+    check_int_semantics();
+    check_jit_division();
+    check_operand_order();
+    check_lazy_calls();
+    check_aot_int_semantics(fileName);
+    if(failedChecks > 0) return 1;
+    printf("Front end scaling, character scanner: %s\n", char_scanner_name());
+    for(size_t lineCount = 1000; lineCount <= 1000000; lineCount *= 10) {
+        bench_front_end(fileName, lineCount);
+    }
+    printf("Reload\n");
+    for(size_t functionCount = 100; functionCount <= 100000; functionCount *= 10) {
+        bench_reload(fileName, functionCount);
+    }
+    printf("Lazy function bodies\n");
+    bench_lazy_parse(fileName, 100000);
+    printf("Interpreter\n");
+    bench_run(fileName, 1000000);
+    bench_calls(30);
+    bench_tail_calls(10000000);
+    bench_loop(10000000);
+    printf("Dispatch: %s\n", vm_dispatch_name());
+    bench_dispatch(fileName);
+    printf("Baseline JIT: %s\n", jit_supported() ? "x86-64" : "not supported, both run the interpreter");
+    bench_jit("fib(32)", generate_calls(32));
+    bench_jit("mix(50000000)", generate_arithmetic_loop(50000000));
+    bench_jit("while 50000000", generate_while_loop(50000000));
+    printf("Ahead of time compiled C\n");
+    bench_aot(fileName, "fib(32)", generate_calls(32));
+    bench_aot(fileName, "mix(50000000)", generate_arithmetic_loop(50000000));
+    bench_aot(fileName, "while 50000000", generate_while_loop(50000000));
+    printf("Arrays, kernels: %s\n", array_kernels_name());
+    bench_array_program(1 << 16, 200);
+    bench_array_kernels(1 << 20, 20);
+    printf("Program image\n");
+    bench_program_image(fileName, 100000);
+    printf("Embedded context\n");
+    bench_context(100000);
+    printf("Parallel parse\n");
+    bench_parallel_parse(fileName, 100000);
+    remove(fileName);
+}
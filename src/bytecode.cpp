@@ -0,0 +1,471 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "bytecode.h"
+#include "array.h"
+#include "diagnostics.h"
+#include "resolver.h"
+#include <algorithm>
+#include <unordered_map>
+
+// first is the ADD opcode of the family the operator is looked up in
+Opcode operator_opcode(OperatorType op, Opcode first) {
+    if(op == OperatorType::INVALID) hlang_error("Invalid optype recieved");
+    return (Opcode)((int)first + (int)op - (int)OperatorType::ADD);
+}
+
+bool is_comparison(OperatorType op) {
+    return op >= OperatorType::EQUALS && op <= OperatorType::NOT_EQUALS;
+}
+
+// Opcode jumping when the comparison op is false, first is JUMP_UNLESS_EQUALS or JUMP_UNLESS_EQUALS_CONSTANT
+Opcode branch_opcode(OperatorType op, Opcode first) {
+    return (Opcode)((int)first + (int)op - (int)OperatorType::EQUALS);
+}
+
+// Compiles one function at a time. Temporaries are allocated above the variable slots like a stack and released
+// once the expression that needed them is done
+class BytecodeCompiler {
+public:
+    BytecodeCompiler(const AstArena& ast, const std::unordered_map<SymbolId, uint32_t>& functionIndices, BytecodeProgram& program,
+                     bool superinstructions)
+        : ast(ast), functionIndices(functionIndices), program(program), superinstructions(superinstructions) {}
+
+    void compileFunction(uint32_t index, NodeRef<BlockNode> block, bool topLevel) {
+        function = &program.functions[index];
+        isTopLevel = topLevel;
+        // Temporaries of the top level code go above the globals skipped bodies may still declare
+        top = topLevel ? program.globalCount : ast[block].frameSize;
+        function->registerCount = top;
+        compileStatements(block);
+        emit(Opcode::RETURN_VOID, 0);
+        function->compiled = true;
+    }
+
+private:
+    void emit(Opcode op, uint32_t a, uint32_t b = 0, uint32_t c = 0) {
+        Instruction instruction;
+        instruction.op = (uint32_t)op;
+        instruction.a = a;
+        instruction.b = b;
+        instruction.c = c;
+        function->code.push_back(instruction);
+    }
+
+    uint32_t allocateRegister() {
+        if(top >= (1u << 24)) hlang_error("Function needs too many registers");
+        function->registerCount = std::max(function->registerCount, top + 1);
+        return top++;
+    }
+
+    // Globals are plain registers of the top level code
+    bool isRegister(VariableSlot slot) const {
+        return !slot.global || isTopLevel;
+    }
+
+    NodeRef<Node> unwrap(NodeRef<Node> node) const {
+        while(ast[node].type == NodeType::EXPRESSION || ast[node].type == NodeType::PREFIX_EXPRESSION) {
+            node = ast[node.as<ExpressionNode>()].operation;
+        }
+        return node;
+    }
+
+    // Only calls change variables while an expression runs
+    bool containsCall(NodeRef<Node> node) const {
+        switch (ast[node].type) {
+            case NodeType::EXPRESSION:
+            case NodeType::PREFIX_EXPRESSION:
+                return containsCall(ast[node.as<ExpressionNode>()].operation);
+            case NodeType::BINARY_OPERATION:
+                return containsCall(ast[node.as<BinaryOperation>()].left) || containsCall(ast[node.as<BinaryOperation>()].right);
+            case NodeType::FUNCTION_CALL:
+                return true;
+            case NodeType::INDEX:
+                return containsCall(ast[node.as<IndexNode>()].index);
+            default:
+                return false;
+        }
+    }
+
+    // Like compileOperand for an operand evaluated before later. A global's own register is read only when the
+    // instruction runs, a call in later may have set it by then, so it is copied to a temporary first
+    uint32_t compileOperandBefore(NodeRef<Node> node, NodeRef<Node> later) {
+        auto operand = unwrap(node);
+        if(ast[operand].type == NodeType::IDENTIFIER && ast[operand.as<IdentifierNode>()].slot.global &&
+           isRegister(ast[operand.as<IdentifierNode>()].slot) && containsCall(later)) {
+            uint32_t copy = allocateRegister();
+            compileInto(operand, copy);
+            return copy;
+        }
+        return compileOperand(node);
+    }
+
+    // Returns the register holding the value of node, the variable's own register when it is one
+    uint32_t compileOperand(NodeRef<Node> node) {
+        switch (ast[node].type) {
+            case NodeType::EXPRESSION:
+            case NodeType::PREFIX_EXPRESSION:
+                return compileOperand(ast[node.as<ExpressionNode>()].operation);
+            case NodeType::IDENTIFIER: {
+                auto slot = ast[node.as<IdentifierNode>()].slot;
+                if(isRegister(slot)) return slot.index;
+                break;
+            }
+            case NodeType::FUNCTION_CALL:
+                return compileCall(node.as<FunctionCallNode>());
+            default:
+                break;
+        }
+        uint32_t target = allocateRegister();
+        compileInto(node, target);
+        return target;
+    }
+
+    void compileInto(NodeRef<Node> node, uint32_t target) {
+        switch (ast[node].type) {
+            case NodeType::EXPRESSION:
+            case NodeType::PREFIX_EXPRESSION:
+                compileInto(ast[node.as<ExpressionNode>()].operation, target);
+                break;
+            case NodeType::NUMBER:
+                emit(Opcode::LOAD_CONSTANT, target, (uint32_t)ast[node.as<NumberNode>()].value);
+                break;
+            case NodeType::IDENTIFIER: {
+                auto slot = ast[node.as<IdentifierNode>()].slot;
+                if(!isRegister(slot)) {
+                    emit(Opcode::GET_GLOBAL, target, slot.index);
+                } else if(slot.index != target) {
+                    emit(Opcode::MOVE, target, slot.index);
+                }
+                break;
+            }
+            case NodeType::BINARY_OPERATION: {
+                auto& operation = ast[node.as<BinaryOperation>()];
+                uint32_t saved = top;
+                uint32_t left = compileOperandBefore(operation.left, operation.right);
+                if(is_array_type(operation.dataType)) {
+                    uint32_t right = compileOperand(operation.right);
+                    uint32_t packed = right | ((uint32_t)operation.op - (uint32_t)OperatorType::ADD) << arrayOpShift |
+                                      operand_flags(ast, operation.left) << arrayOpLeftShift |
+                                      operand_flags(ast, operation.right) << arrayOpRightShift;
+                    emit(Opcode::ARRAY_OP, target, left, packed);
+                } else if(ast[operation.right].type == NodeType::NUMBER) {
+                    emit(operator_opcode(operation.op, Opcode::ADD_CONSTANT), target, left, (uint32_t)ast[operation.right.as<NumberNode>()].value);
+                } else {
+                    uint32_t right = compileOperand(operation.right);
+                    emit(operator_opcode(operation.op, Opcode::ADD), target, left, right);
+                }
+                top = saved;
+                break;
+            }
+            case NodeType::FUNCTION_CALL: {
+                uint32_t saved = top;
+                uint32_t result = compileCall(node.as<FunctionCallNode>());
+                if(result != target) emit(Opcode::MOVE, target, result);
+                top = saved;
+                break;
+            }
+            case NodeType::INDEX: {
+                // The index runs first, calls in it may set the array variable
+                auto& index = ast[node.as<IndexNode>()];
+                uint32_t saved = top;
+                uint32_t element = compileOperandBefore(index.index, index.array);
+                uint32_t array = compileOperand(index.array);
+                emit(Opcode::ARRAY_GET, target, array, element);
+                top = saved;
+                break;
+            }
+            default:
+                hlang_error("Node type is not supported as expression operand");
+        }
+    }
+
+    // Arguments go to the top registers, which become the callee's parameters. Returns the result register
+    uint32_t compileCall(NodeRef<FunctionCallNode> call, Opcode op = Opcode::CALL) {
+        if(ast[call].builtin != Builtin::NONE) return compileBuiltin(call);
+        auto it = functionIndices.find(ast[call].functionIdentifier);
+        if(it == functionIndices.end()) {
+            auto name = symbol_name(ast[call].functionIdentifier);
+            hlang_error("%.*s is not a function", (int)name.size(), name.data());
+        }
+        auto arguments = ast[ast[call].argumentsList];
+        if(arguments.size() != program.functions[it->second].paramCount) {
+            auto name = symbol_name(ast[call].functionIdentifier);
+            hlang_error("%.*s takes %u arguments, %u given", (int)name.size(), name.data(),
+                        program.functions[it->second].paramCount, arguments.size());
+        }
+        uint32_t base = allocateRegister();
+        for(uint32_t i = 1; i < arguments.size(); i++) allocateRegister();
+        for(uint32_t i = 0; i < arguments.size(); i++) {
+            uint32_t saved = top;
+            compileInto(arguments[i], base + i);
+            top = saved;
+        }
+        emit(op, base, it->second, arguments.size());
+        return base;
+    }
+
+    // Arguments go to consecutive registers like for calls, the result replaces the first
+    uint32_t compileBuiltin(NodeRef<FunctionCallNode> call) {
+        auto arguments = ast[ast[call].argumentsList];
+        uint32_t base = allocateRegister();
+        for(uint32_t i = 1; i < arguments.size(); i++) allocateRegister();
+        uint32_t operandFlags = 0;
+        for(uint32_t i = 0; i < arguments.size(); i++) {
+            uint32_t saved = top;
+            compileInto(arguments[i], base + i);
+            top = saved;
+            operandFlags |= operand_flags(ast, arguments[i]) << (2 * i);
+        }
+        emit(Opcode::BUILTIN, base, (uint32_t)ast[call].builtin, operandFlags);
+        return base;
+    }
+
+    // name[index] = expression, the array is read after both ran like the tree interpreter does
+    void compileElementStore(VariableSlot slot, NodeRef<ExpressionNode> index, NodeRef<ExpressionNode> expression) {
+        uint32_t saved = top;
+        uint32_t element = compileOperandBefore(index, expression);
+        uint32_t value = compileOperand(expression);
+        uint32_t array = slot.index;
+        if(!isRegister(slot)) {
+            array = allocateRegister();
+            emit(Opcode::GET_GLOBAL, array, slot.index);
+        }
+        emit(Opcode::ARRAY_SET, array, element, value);
+        top = saved;
+    }
+
+    void compileStore(VariableSlot slot, NodeRef<ExpressionNode> expression) {
+        uint32_t saved = top;
+        if(isRegister(slot)) {
+            if(expression) {
+                compileInto(expression, slot.index);
+            } else {
+                emit(Opcode::LOAD_CONSTANT, slot.index, 0);
+            }
+        } else if(expression && compileGlobalUpdate(slot, expression)) {
+            // Fused into a single load-op-store
+        } else {
+            uint32_t value = expression ? compileOperand(expression) : allocateRegister();
+            if(!expression) emit(Opcode::LOAD_CONSTANT, value, 0);
+            emit(Opcode::SET_GLOBAL, slot.index, value);
+        }
+        top = saved;
+    }
+
+    // global = global op N never touches a register
+    bool compileGlobalUpdate(VariableSlot slot, NodeRef<ExpressionNode> expression) {
+        if(!superinstructions) return false;
+        auto node = unwrap(expression);
+        if(ast[node].type != NodeType::BINARY_OPERATION) return false;
+        auto& operation = ast[node.as<BinaryOperation>()];
+        if(is_array_type(operation.dataType)) return false;
+        if(ast[operation.left].type != NodeType::IDENTIFIER || ast[operation.right].type != NodeType::NUMBER) return false;
+        auto source = ast[operation.left.as<IdentifierNode>()].slot;
+        if(isRegister(source)) return false;
+        emit(operator_opcode(operation.op, Opcode::GLOBAL_ADD_CONSTANT), slot.index, source.index,
+             (uint32_t)ast[operation.right.as<NumberNode>()].value);
+        return true;
+    }
+
+    // Emits the jump taken when condition is false and returns its index for patching
+    size_t compileBranchCondition(NodeRef<Node> condition) {
+        uint32_t saved = top;
+        auto node = unwrap(condition);
+        if(superinstructions && ast[node].type == NodeType::BINARY_OPERATION && is_comparison(ast[node.as<BinaryOperation>()].op)) {
+            auto& operation = ast[node.as<BinaryOperation>()];
+            uint32_t left = compileOperandBefore(operation.left, operation.right);
+            if(ast[operation.right].type == NodeType::NUMBER) {
+                emit(branch_opcode(operation.op, Opcode::JUMP_UNLESS_EQUALS_CONSTANT), left, 0, (uint32_t)ast[operation.right.as<NumberNode>()].value);
+            } else {
+                uint32_t right = compileOperand(operation.right);
+                emit(branch_opcode(operation.op, Opcode::JUMP_UNLESS_EQUALS), left, 0, right);
+            }
+        } else {
+            emit(Opcode::JUMP_IF_FALSE, compileOperand(condition));
+        }
+        top = saved;
+        return function->code.size() - 1;
+    }
+
+    void compileStatements(NodeRef<BlockNode> block) {
+        for(auto statement: ast[ast[block].statements]) {
+            uint32_t saved = top;
+            switch (ast[statement].type) {
+                case NodeType::DECLARATION: {
+                    auto& declaration = ast[statement.as<DeclarationNode>()];
+                    compileStore(declaration.slot, declaration.defaultValueExpression);
+                    break;
+                }
+                case NodeType::ASSIGNMENT: {
+                    auto& assignment = ast[statement.as<AssignmentNode>()];
+                    if(assignment.index) {
+                        compileElementStore(assignment.slot, assignment.index, assignment.expression);
+                    } else {
+                        compileStore(assignment.slot, assignment.expression);
+                    }
+                    break;
+                }
+                case NodeType::BRANCH: {
+                    auto& branch = ast[statement.as<BranchNode>()];
+                    size_t skipTrue = compileBranchCondition(branch.expression);
+                    compileStatements(branch.trueBlock);
+                    if(branch.falseBlock) {
+                        size_t skipFalse = function->code.size();
+                        emit(Opcode::JUMP, 0);
+                        function->code[skipTrue].b = (uint32_t)function->code.size();
+                        compileStatements(branch.falseBlock);
+                        function->code[skipFalse].b = (uint32_t)function->code.size();
+                    } else {
+                        function->code[skipTrue].b = (uint32_t)function->code.size();
+                    }
+                    break;
+                }
+                case NodeType::LOOP: {
+                    // The condition is tested at the top, the jump back to it is the only backward jump a function has
+                    auto& loop = ast[statement.as<LoopNode>()];
+                    uint32_t start = (uint32_t)function->code.size();
+                    size_t exit = compileBranchCondition(loop.expression);
+                    loopBreaks.emplace_back();
+                    compileStatements(loop.body);
+                    emit(Opcode::JUMP, 0, start);
+                    function->code[exit].b = (uint32_t)function->code.size();
+                    for(size_t jump: loopBreaks.back()) function->code[jump].b = (uint32_t)function->code.size();
+                    loopBreaks.pop_back();
+                    break;
+                }
+                case NodeType::FUNCTION_CALL:
+                    compileCall(statement.as<FunctionCallNode>());
+                    break;
+                case NodeType::LAST_STATEMENT: {
+                    if(ast[statement.as<LastStatementNode>()].isBreak) {
+                        loopBreaks.back().push_back(function->code.size());
+                        emit(Opcode::JUMP, 0);
+                        break;
+                    }
+                    auto returnExpr = ast[statement.as<LastStatementNode>()].returnExpr;
+                    // The top level window is the global frame, only functions can give theirs away
+                    if(returnExpr && !isTopLevel && ast[unwrap(returnExpr)].type == NodeType::FUNCTION_CALL &&
+                       ast[unwrap(returnExpr).as<FunctionCallNode>()].builtin == Builtin::NONE) {
+                        compileCall(unwrap(returnExpr).as<FunctionCallNode>(), Opcode::TAIL_CALL);
+                    } else if(returnExpr) {
+                        emit(Opcode::RETURN, compileOperand(returnExpr));
+                    } else {
+                        emit(Opcode::RETURN_VOID, 0);
+                    }
+                    break;
+                }
+                default:
+                    break; // Function declarations are compiled on their own
+            }
+            top = saved;
+        }
+    }
+
+    const AstArena& ast;
+    const std::unordered_map<SymbolId, uint32_t>& functionIndices;
+    BytecodeProgram& program;
+    BytecodeFunction* function = nullptr;
+    bool superinstructions;
+    bool isTopLevel = false;
+    uint32_t top = 0; // First free register
+    std::vector<std::vector<size_t>> loopBreaks; // Jumps of the break statements of every open loop, patched to its end
+};
+
+struct LazyBytecode {
+    ProgramNode& program;
+    bool superinstructions;
+    std::unordered_map<SymbolId, uint32_t> functionIndices;
+    uint32_t known = 0; // Functions of program.functions that have their index in functionIndices
+};
+
+// Gives every function the resolver found since the last call its index, before any code calling it is compiled
+void indexFunctions(LazyBytecode& lazy, BytecodeProgram& bytecode) {
+    auto& functions = lazy.program.functions;
+    auto& ast = lazy.program.ast;
+    if(functions.size() + 1 > bytecode.functions.size() || ast[lazy.program.programBlock].frameSize > bytecode.globalCount) {
+        hlang_error("A function body declared more than its skipped tokens allowed for");
+    }
+    for(; lazy.known < functions.size(); lazy.known++) {
+        auto& function = bytecode.functions[lazy.known + 1];
+        function.name = ast[functions[lazy.known]].functionName;
+        function.paramCount = ast[ast[functions[lazy.known]].paramDeclarations].size();
+        lazy.functionIndices[function.name] = lazy.known + 1;
+    }
+}
+
+std::shared_ptr<BytecodeProgram> compileBytecode(ProgramNode& program, bool superinstructions) {
+    resolveNames(program);
+
+    auto& ast = program.ast;
+    auto bytecode = std::make_shared<BytecodeProgram>();
+    bytecode->functions.resize(program.functions.size() + program.skippedFunctions + 1);
+    bytecode->globalCount = ast[program.programBlock].frameSize + program.skippedGlobals;
+    bytecode->lazy = std::make_shared<LazyBytecode>(LazyBytecode{program, superinstructions});
+    // Every function is known before any code is compiled so calls can go forward
+    LazyBytecode& lazy = *bytecode->lazy;
+    indexFunctions(lazy, *bytecode);
+
+    BytecodeCompiler compiler(ast, lazy.functionIndices, *bytecode, superinstructions);
+    compiler.compileFunction(0, program.programBlock, true);
+    for(uint32_t i = 0; i < program.functions.size(); i++) {
+        auto block = ast[program.functions[i]].functionBlock;
+        if(block) compiler.compileFunction(i + 1, block, false);
+    }
+    return bytecode;
+}
+
+void compileBytecodeFunction(BytecodeProgram& program, uint32_t function) {
+    if(program.functions[function].compiled) return;
+    LazyBytecode& lazy = *program.lazy;
+    auto block = parseFunctionBody(lazy.program, lazy.program.functions[function - 1]);
+    // Functions declared in the body can be called from it
+    indexFunctions(lazy, program);
+    BytecodeCompiler compiler(lazy.program.ast, lazy.functionIndices, program, lazy.superinstructions);
+    compiler.compileFunction(function, block, false);
+}
+
+const char* opcode_name(Opcode op) {
+    static const char* names[] = {
+        "load_constant", "move", "get_global", "set_global",
+        "add", "mul", "div", "sub", "equals", "less_equals", "larger_equals", "less_than", "larger_than", "not_equals",
+        "add_constant", "mul_constant", "div_constant", "sub_constant", "equals_constant", "less_equals_constant",
+        "larger_equals_constant", "less_than_constant", "larger_than_constant", "not_equals_constant",
+        "global_add_constant", "global_mul_constant", "global_div_constant", "global_sub_constant", "global_equals_constant",
+        "global_less_equals_constant", "global_larger_equals_constant", "global_less_than_constant",
+        "global_larger_than_constant", "global_not_equals_constant",
+        "jump_unless_equals", "jump_unless_less_equals", "jump_unless_larger_equals", "jump_unless_less_than",
+        "jump_unless_larger_than", "jump_unless_not_equals",
+        "jump_unless_equals_constant", "jump_unless_less_equals_constant", "jump_unless_larger_equals_constant",
+        "jump_unless_less_than_constant", "jump_unless_larger_than_constant", "jump_unless_not_equals_constant",
+        "array_get", "array_set", "array_op", "builtin",
+        "jump", "jump_if_false", "call", "tail_call", "return", "return_void"
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == (size_t)Opcode::RETURN_VOID + 1, "Every opcode needs a name");
+    return names[(int)op];
+}
+
+std::vector<std::pair<uint32_t, std::pair<Opcode, Opcode>>> countOpcodePairs(const BytecodeProgram& program) {
+    std::unordered_map<uint32_t, uint32_t> counts;
+    for(auto& function: program.functions) {
+        for(size_t pc = 1; pc < function.code.size(); pc++) {
+            counts[function.code[pc - 1].op << 8 | function.code[pc].op]++;
+        }
+    }
+    std::vector<std::pair<uint32_t, std::pair<Opcode, Opcode>>> pairs;
+    for(auto& [pair, count]: counts) pairs.push_back({count, {(Opcode)(pair >> 8), (Opcode)(pair & 0xFF)}});
+    std::sort(pairs.begin(), pairs.end(), [](auto& a, auto& b) { return a.first > b.first; });
+    return pairs;
+}
+
+void debugBytecode(const BytecodeProgram& program) {
+    for(size_t i = 0; i < program.functions.size(); i++) {
+        auto& function = program.functions[i];
+        auto name = i == 0 ? std::string_view("[top_level]") : symbol_name(function.name);
+        printf("[function] %.*s params=%u registers=%u\n", (int)name.size(), name.data(), function.paramCount, function.registerCount);
+        for(size_t pc = 0; pc < function.code.size(); pc++) {
+            auto& instruction = function.code[pc];
+            printf(" %4zu %-22s %u %d %d\n", pc, opcode_name((Opcode)instruction.op), (uint32_t)instruction.a, (int)instruction.b, (int)instruction.c);
+        }
+    }
+}
@@ -0,0 +1,131 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "parser.h"
+#include "interpreter.h"
+
+// Register machine code. Every function runs in a window of the register file, its first registers are the
+// variable slots resolveNames gave out, parameters first, temporaries follow. The top level code is function 0
+// and its window is the global frame, other functions reach globals through GET_GLOBAL and SET_GLOBAL.
+// A call passes its arguments in consecutive registers of the caller that become the first registers of the
+// callee's window, the result comes back in the first of them.
+enum class Opcode: uint8_t {
+    LOAD_CONSTANT, // r[a] = b
+    MOVE, // r[a] = r[b]
+    GET_GLOBAL, // r[a] = global[b]
+    SET_GLOBAL, // global[a] = r[b]
+
+    // r[a] = r[b] op r[c], same order as OperatorType
+    ADD,
+    MUL,
+    DIV,
+    SUB,
+    EQUALS,
+    LESS_EQUALS,
+    LARGER_EQUALS,
+    LESS_THAN,
+    LARGER_THAN,
+    NOT_EQUALS,
+
+    // r[a] = r[b] op c, for literal right hand operands
+    ADD_CONSTANT,
+    MUL_CONSTANT,
+    DIV_CONSTANT,
+    SUB_CONSTANT,
+    EQUALS_CONSTANT,
+    LESS_EQUALS_CONSTANT,
+    LARGER_EQUALS_CONSTANT,
+    LESS_THAN_CONSTANT,
+    LARGER_THAN_CONSTANT,
+    NOT_EQUALS_CONSTANT,
+
+    // global[a] = global[b] op c, load-op-store superinstructions for num = num + 2 on a global inside a function
+    GLOBAL_ADD_CONSTANT,
+    GLOBAL_MUL_CONSTANT,
+    GLOBAL_DIV_CONSTANT,
+    GLOBAL_SUB_CONSTANT,
+    GLOBAL_EQUALS_CONSTANT,
+    GLOBAL_LESS_EQUALS_CONSTANT,
+    GLOBAL_LARGER_EQUALS_CONSTANT,
+    GLOBAL_LESS_THAN_CONSTANT,
+    GLOBAL_LARGER_THAN_CONSTANT,
+    GLOBAL_NOT_EQUALS_CONSTANT,
+
+    // if !(r[a] op r[c]) pc = b, compare-branch superinstructions for if x <= y then
+    JUMP_UNLESS_EQUALS,
+    JUMP_UNLESS_LESS_EQUALS,
+    JUMP_UNLESS_LARGER_EQUALS,
+    JUMP_UNLESS_LESS_THAN,
+    JUMP_UNLESS_LARGER_THAN,
+    JUMP_UNLESS_NOT_EQUALS,
+
+    // if !(r[a] op c) pc = b, for if x <= N then
+    JUMP_UNLESS_EQUALS_CONSTANT,
+    JUMP_UNLESS_LESS_EQUALS_CONSTANT,
+    JUMP_UNLESS_LARGER_EQUALS_CONSTANT,
+    JUMP_UNLESS_LESS_THAN_CONSTANT,
+    JUMP_UNLESS_LARGER_THAN_CONSTANT,
+    JUMP_UNLESS_NOT_EQUALS_CONSTANT,
+
+    // Typed arrays, see array.h. Registers hold array handles
+    ARRAY_GET, // r[a] = r[b][r[c]]
+    ARRAY_SET, // r[a][r[b]] = r[c]
+    ARRAY_OP, // r[a] = r[b] op r[c & arrayOpRegister] for every element, the rest of c holds op and the operand flags
+    BUILTIN, // r[a] = builtin b(r[a] ..), c holds the operand flags of the arguments like run_builtin takes them
+
+    JUMP, // pc = b, jumping backwards closes a loop
+    JUMP_IF_FALSE, // if r[a] == 0 pc = b
+    CALL, // r[a] = functions[b](r[a] .. r[a + c - 1])
+    TAIL_CALL, // return functions[b](r[a] .. r[a + c - 1]), the callee takes over the window
+    RETURN, // Returns r[a]
+    RETURN_VOID
+};
+
+// How ARRAY_OP packs its operator and the operand flags of array.h into c above the right hand register
+constexpr uint32_t arrayOpRegister = (1u << 24) - 1;
+constexpr uint32_t arrayOpShift = 24; // (c >> arrayOpShift) & 0xF is the operator, counted from OperatorType::ADD
+constexpr uint32_t arrayOpLeftShift = 28; // (c >> arrayOpLeftShift) & 3 are the flags of the left operand
+constexpr uint32_t arrayOpRightShift = 30;
+
+struct Instruction {
+    uint32_t op : 8; // Opcode
+    uint32_t a : 24; // Destination register
+    uint32_t b; // Register, constant, function or jump target depending on op
+    uint32_t c;
+};
+
+struct BytecodeFunction {
+    std::vector<Instruction> code;
+    SymbolId name = 0;
+    uint32_t paramCount = 0;
+    uint32_t registerCount = 0;
+    bool compiled = false; // Functions with skipped bodies are compiled on their first call, see compileBytecodeFunction
+};
+
+struct LazyBytecode;
+
+struct BytecodeProgram {
+    // functions[0] is the top level code. Slots for the functions skipped bodies may declare are kept at the end, so
+    // the vector never grows and pointers into it stay valid while the VM runs
+    std::vector<BytecodeFunction> functions;
+    uint32_t globalCount = 0; // Global slots, the ones skipped bodies may declare included
+    std::shared_ptr<LazyBytecode> lazy; // What compiling functions on their first call needs
+};
+
+// Compiles program to bytecode after resolving its names. Function bodies skipped by a lazy parse stay unparsed, they
+// are parsed, resolved and compiled on their first call. program has to outlive the bytecode and must not be parsed
+// again while it is used.
+// Without superinstructions every statement compiles to plain single operations, for measuring what fusing gains
+std::shared_ptr<BytecodeProgram> compileBytecode(ProgramNode& program, bool superinstructions = true);
+// Compiles functions[function] if it is not yet, parsing its body first. Errors in the body are raised now through
+// hlang_error. Not thread safe
+void compileBytecodeFunction(BytecodeProgram& program, uint32_t function);
+void debugBytecode(const BytecodeProgram& program);
+// Static counts of adjacent opcode pairs over all functions, most frequent first. Superinstructions are picked from these
+std::vector<std::pair<uint32_t, std::pair<Opcode, Opcode>>> countOpcodePairs(const BytecodeProgram& program);
+const char* opcode_name(Opcode op);
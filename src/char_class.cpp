@@ -0,0 +1,232 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "char_class.h"
+#include "simd.h"
+#include <cstdint>
+
+enum CharClass : uint8_t {
+    CHAR_SEPARATOR = 1,
+    CHAR_BLANK = 2
+};
+
+// Must match is_separator in tokenizer.cpp with \0 added so scans stop at embedded terminators
+constexpr bool is_separator_char(unsigned char c) {
+    switch (c) {
+        case '\0':
+        case '=': case '+': case '-': case '/': case '*':
+        case '<': case '>': case '!': case '(': case ')':
+        case '[': case ']': case ',': case ';':
+        case ' ': case '\t': case '\r': case '\n':
+            return true;
+        default:
+            return false;
+    }
+}
+
+constexpr bool is_blank_char(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+struct CharClassTable {
+    uint8_t classes[256];
+};
+
+constexpr CharClassTable build_char_class_table() {
+    CharClassTable table{};
+    for(int c = 0; c < 256; c++) {
+        uint8_t charClass = 0;
+        if(is_separator_char(c)) charClass |= CHAR_SEPARATOR;
+        if(is_blank_char(c)) charClass |= CHAR_BLANK;
+        table.classes[c] = charClass;
+    }
+    return table;
+}
+
+constexpr CharClassTable charClasses = build_char_class_table();
+
+static size_t find_separator_scalar(const char* data, size_t len, size_t offset) {
+    while(offset < len && !(charClasses.classes[(uint8_t)data[offset]] & CHAR_SEPARATOR)) offset++;
+    return offset;
+}
+
+static size_t skip_blanks_scalar(const char* data, size_t len, size_t offset) {
+    while(offset < len && (charClasses.classes[(uint8_t)data[offset]] & CHAR_BLANK)) offset++;
+    return offset;
+}
+
+#if HLANG_SIMD_X86
+
+static inline unsigned first_set_bit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+// SSE2 has no byte shuffle so separators are matched with two range compares and single byte compares
+static inline __m128i sse2_in_range(__m128i chars, char low, char high) {
+    // Bytes above 0x7f compare as negative and fall outside every range used here
+    return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(low - 1)), _mm_cmplt_epi8(chars, _mm_set1_epi8(high + 1)));
+}
+
+static inline __m128i sse2_separators(__m128i chars) {
+    __m128i match = sse2_in_range(chars, '(', '-'); // ( ) * + , -
+    match = _mm_or_si128(match, sse2_in_range(chars, ';', '>')); // ; < = >
+    match = _mm_or_si128(match, sse2_in_range(chars, ' ', '!'));
+    match = _mm_or_si128(match, sse2_in_range(chars, '\t', '\n'));
+    match = _mm_or_si128(match, _mm_cmpeq_epi8(chars, _mm_set1_epi8('\r')));
+    match = _mm_or_si128(match, _mm_cmpeq_epi8(chars, _mm_set1_epi8('/')));
+    match = _mm_or_si128(match, _mm_cmpeq_epi8(chars, _mm_set1_epi8('[')));
+    match = _mm_or_si128(match, _mm_cmpeq_epi8(chars, _mm_set1_epi8(']')));
+    match = _mm_or_si128(match, _mm_cmpeq_epi8(chars, _mm_setzero_si128()));
+    return match;
+}
+
+static inline __m128i sse2_blanks(__m128i chars) {
+    __m128i match = _mm_cmpeq_epi8(chars, _mm_set1_epi8(' '));
+    match = _mm_or_si128(match, _mm_cmpeq_epi8(chars, _mm_set1_epi8('\t')));
+    match = _mm_or_si128(match, _mm_cmpeq_epi8(chars, _mm_set1_epi8('\r')));
+    return match;
+}
+
+static size_t find_separator_sse2(const char* data, size_t len, size_t offset) {
+    while(offset + 16 <= len) {
+        __m128i chars = _mm_loadu_si128((const __m128i*)&data[offset]);
+        uint32_t mask = _mm_movemask_epi8(sse2_separators(chars));
+        if(mask) return offset + first_set_bit(mask);
+        offset += 16;
+    }
+    return find_separator_scalar(data, len, offset);
+}
+
+static size_t skip_blanks_sse2(const char* data, size_t len, size_t offset) {
+    while(offset + 16 <= len) {
+        __m128i chars = _mm_loadu_si128((const __m128i*)&data[offset]);
+        uint32_t mask = ~_mm_movemask_epi8(sse2_blanks(chars)) & 0xFFFF;
+        if(mask) return offset + first_set_bit(mask);
+        offset += 16;
+    }
+    return skip_blanks_scalar(data, len, offset);
+}
+
+// AVX2 classifies each byte with two nibble lookups. Every bit in the low nibble table names a high nibble row
+// the character is valid in, the high nibble table selects that row so (low & high) != 0 means the class matches.
+enum NibbleClass : uint8_t {
+    SEPARATOR_ROW_0 = 0x01, // \0 \t \n \r
+    SEPARATOR_ROW_2 = 0x02, // space ! ( ) * + , - /
+    SEPARATOR_ROW_3 = 0x04, // ; < = >
+    BLANK_ROW_0 = 0x08, // \t \r
+    BLANK_ROW_2 = 0x10, // space
+    SEPARATOR_ROW_5 = 0x20, // [ ]
+    SEPARATOR_ROWS = SEPARATOR_ROW_0 | SEPARATOR_ROW_2 | SEPARATOR_ROW_3 | SEPARATOR_ROW_5,
+    BLANK_ROWS = BLANK_ROW_0 | BLANK_ROW_2
+};
+
+struct NibbleTables {
+    uint8_t low[16];
+    uint8_t high[16];
+};
+
+constexpr NibbleTables build_nibble_tables() {
+    NibbleTables tables{};
+    tables.high[0x0] = SEPARATOR_ROW_0 | BLANK_ROW_0;
+    tables.high[0x2] = SEPARATOR_ROW_2 | BLANK_ROW_2;
+    tables.high[0x3] = SEPARATOR_ROW_3;
+    tables.high[0x5] = SEPARATOR_ROW_5;
+    for(int c = 0; c < 0x60; c++) {
+        uint8_t row = c >> 4;
+        uint8_t charClass = charClasses.classes[c];
+        if(charClass & CHAR_SEPARATOR) {
+            tables.low[c & 0xF] |= row == 0 ? SEPARATOR_ROW_0 : row == 2 ? SEPARATOR_ROW_2
+                : row == 3 ? SEPARATOR_ROW_3 : SEPARATOR_ROW_5;
+        }
+        if(charClass & CHAR_BLANK) {
+            tables.low[c & 0xF] |= row == 0 ? BLANK_ROW_0 : BLANK_ROW_2;
+        }
+    }
+    return tables;
+}
+
+constexpr NibbleTables nibbleTables = build_nibble_tables();
+
+// Every separator and blank lives in row 0, 2, 3 or 5, the tables above depend on that
+constexpr bool nibble_tables_match() {
+    for(int c = 0; c < 256; c++) {
+        uint8_t rows = nibbleTables.low[c & 0xF] & nibbleTables.high[c >> 4];
+        if(((rows & SEPARATOR_ROWS) != 0) != ((charClasses.classes[c] & CHAR_SEPARATOR) != 0)) return false;
+        if(((rows & BLANK_ROWS) != 0) != ((charClasses.classes[c] & CHAR_BLANK) != 0)) return false;
+    }
+    return true;
+}
+static_assert(nibble_tables_match(), "Nibble lookup tables do not match the character classes");
+
+HLANG_TARGET_AVX2 static inline __m256i avx2_classify(__m256i chars) {
+    const __m256i lowTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)nibbleTables.low));
+    const __m256i highTable = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)nibbleTables.high));
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+    __m256i low = _mm256_shuffle_epi8(lowTable, _mm256_and_si256(chars, nibbleMask));
+    __m256i high = _mm256_shuffle_epi8(highTable, _mm256_and_si256(_mm256_srli_epi16(chars, 4), nibbleMask));
+    return _mm256_and_si256(low, high);
+}
+
+HLANG_TARGET_AVX2 static size_t find_separator_avx2(const char* data, size_t len, size_t offset) {
+    const __m256i separatorRows = _mm256_set1_epi8(SEPARATOR_ROWS);
+    while(offset + 32 <= len) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*)&data[offset]);
+        __m256i rows = _mm256_and_si256(avx2_classify(chars), separatorRows);
+        uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(rows, _mm256_setzero_si256()));
+        if(mask) return offset + first_set_bit(mask);
+        offset += 32;
+    }
+    return find_separator_sse2(data, len, offset);
+}
+
+HLANG_TARGET_AVX2 static size_t skip_blanks_avx2(const char* data, size_t len, size_t offset) {
+    const __m256i blankRows = _mm256_set1_epi8(BLANK_ROWS);
+    while(offset + 32 <= len) {
+        __m256i chars = _mm256_loadu_si256((const __m256i*)&data[offset]);
+        __m256i rows = _mm256_and_si256(avx2_classify(chars), blankRows);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(rows, _mm256_setzero_si256()));
+        if(mask) return offset + first_set_bit(mask);
+        offset += 32;
+    }
+    return skip_blanks_sse2(data, len, offset);
+}
+
+#endif
+
+struct CharScanner {
+    size_t (*findSeparator)(const char* data, size_t len, size_t offset);
+    size_t (*skipBlanks)(const char* data, size_t len, size_t offset);
+    const char* name;
+};
+
+static CharScanner select_char_scanner() {
+#if HLANG_SIMD_X86
+    if(cpu_has_avx2()) return {find_separator_avx2, skip_blanks_avx2, "avx2"};
+    return {find_separator_sse2, skip_blanks_sse2, "sse2"};
+#else
+    return {find_separator_scalar, skip_blanks_scalar, "scalar"};
+#endif
+}
+
+static const CharScanner& char_scanner() {
+    static const CharScanner scanner = select_char_scanner();
+    return scanner;
+}
+
+size_t find_separator(const char* data, size_t len, size_t offset) {
+    return char_scanner().findSeparator(data, len, offset);
+}
+
+size_t skip_blanks(const char* data, size_t len, size_t offset) {
+    return char_scanner().skipBlanks(data, len, offset);
+}
+
+const char* char_scanner_name() {
+    return char_scanner().name;
+}
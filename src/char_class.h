@@ -0,0 +1,16 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include <cstddef>
+
+// Bulk character class scanning used by the tokenizer. Both functions scan data[offset, len) and pick an
+// AVX2, SSE2 or scalar implementation the first time they are called depending on what the cpu supports.
+
+// Returns the index of the first separator (operator, list separator, whitespace, newline or \0) or len
+size_t find_separator(const char* data, size_t len, size_t offset);
+// Returns the index of the first character that is not a space, tab or carriage return or len
+size_t skip_blanks(const char* data, size_t len, size_t offset);
+
+const char* char_scanner_name();
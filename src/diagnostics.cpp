@@ -0,0 +1,48 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "diagnostics.h"
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+
+thread_local int diagnosticScopes = 0;
+
+[[noreturn]] void report_error(SourceLocation location, const char* format, va_list args) {
+    if(diagnosticScopes == 0) {
+        vfprintf(stderr, format, args);
+        fprintf(stderr, "\n");
+        exit(-1);
+    }
+    va_list length;
+    va_copy(length, args);
+    int size = vsnprintf(nullptr, 0, format, length);
+    va_end(length);
+    HlangError error = {{std::string(size > 0 ? size : 0, '\0'), location}};
+    vsnprintf(&error.diagnostic.message[0], error.diagnostic.message.size() + 1, format, args);
+    throw error;
+}
+
+void hlang_error(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    report_error({0, 0}, format, args);
+}
+
+void hlang_error(SourceLocation location, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    report_error(location, format, args);
+}
+
+bool diagnostics_active() {
+    return diagnosticScopes > 0;
+}
+
+DiagnosticScope::DiagnosticScope() {
+    diagnosticScopes++;
+}
+
+DiagnosticScope::~DiagnosticScope() {
+    diagnosticScopes--;
+}
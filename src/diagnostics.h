@@ -0,0 +1,66 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include <mutex>
+#include <string>
+#include "source_file.h"
+
+struct Diagnostic {
+    std::string message;
+    SourceLocation location; // 0:0 when the error is not tied to a position in the source
+};
+
+// What hlang_error throws while a DiagnosticScope is active on the thread
+struct HlangError {
+    Diagnostic diagnostic;
+};
+
+// Every compile and runtime error ends up here. Outside of a DiagnosticScope the message is printed and the process
+// exits like the command line compiler always did, inside one an HlangError is thrown for the scope owner to catch
+[[noreturn]] void hlang_error(const char* format, ...);
+[[noreturn]] void hlang_error(SourceLocation location, const char* format, ...);
+
+bool diagnostics_active();
+
+class DiagnosticScope {
+public:
+    DiagnosticScope();
+    ~DiagnosticScope();
+    DiagnosticScope(const DiagnosticScope&) = delete;
+    DiagnosticScope& operator=(const DiagnosticScope&) = delete;
+};
+
+// Lets worker threads report errors to the thread that started them. Errors inside run are caught when the creating
+// thread was in a DiagnosticScope, rethrow passes the first one on after the workers are joined
+class WorkerDiagnostics {
+public:
+    WorkerDiagnostics(): active(diagnostics_active()) {}
+
+    template<typename Function>
+    void run(Function&& function) {
+        if(!active) {
+            function();
+            return;
+        }
+        DiagnosticScope scope;
+        try {
+            function();
+        } catch (HlangError& error) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if(!failed) firstError = std::move(error);
+            failed = true;
+        }
+    }
+
+    void rethrow() {
+        if(failed) throw firstError;
+    }
+
+private:
+    bool active;
+    bool failed = false;
+    HlangError firstError;
+    std::mutex mutex;
+};
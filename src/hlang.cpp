@@ -0,0 +1,73 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "hlang.h"
+#include "resolver.h"
+#include "vm.h"
+
+bool HlangContext::compileFile(const char* fileName, bool lazyBodies) {
+    auto source = SourceFile::map(fileName);
+    if(!source) {
+        error = {"Could not open file " + std::string(fileName), {0, 0}};
+        return false;
+    }
+    return compile(source, lazyBodies);
+}
+
+bool HlangContext::compileSource(std::string_view source, bool lazyBodies) {
+    return compile(SourceFile::copy(source), lazyBodies);
+}
+
+bool HlangContext::compile(std::shared_ptr<SourceFile> source, bool lazyBodies) {
+    DiagnosticScope scope;
+    compiled = nullptr;
+    bytecode = nullptr;
+    globals.clear();
+    try {
+        TokenStream tokens(source, true);
+        auto program = parseTokens(tokens, lazyBodies);
+        bytecode = compileBytecode(*program);
+        compiled = program;
+    } catch (HlangError& failure) {
+        bytecode = nullptr;
+        error = std::move(failure.diagnostic);
+        return false;
+    }
+    return true;
+}
+
+bool HlangContext::run() {
+    if(!compiled) {
+        error = {"No program has been compiled", {0, 0}};
+        return false;
+    }
+    DiagnosticScope scope;
+    bool succeeded = true;
+    try {
+        set_vm_jit(jit);
+        run_bytecode(*bytecode);
+    } catch (HlangError& failure) {
+        error = std::move(failure.diagnostic);
+        succeeded = false;
+    }
+    // A failed run keeps the values it got to, like the VM did
+    globals.clear();
+    HInt value;
+    for(uint32_t slot = 0; read_bytecode_global(slot, value); slot++) globals.push_back(value);
+    return succeeded;
+}
+
+bool HlangContext::readInt(const char* name, HInt& value) const {
+    SymbolId symbol;
+    uint32_t slot;
+    if(globals.empty() || !find_symbol(name, symbol) || !findGlobalSlot(*compiled, symbol, slot) || slot >= globals.size()) return false;
+    value = globals[slot];
+    return true;
+}
+
+bool HlangContext::readBool(const char* name, HBool& value) const {
+    HInt intValue;
+    if(!readInt(name, intValue)) return false;
+    value = intValue != 0;
+    return true;
+}
@@ -0,0 +1,45 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string_view>
+#include "diagnostics.h"
+#include "parser.h"
+#include "interpreter.h"
+#include "bytecode.h"
+
+// Embedding entry point for running many scripts in one process. Nothing a context does exits the process,
+// compile and run report failures by returning false and leaving the reason in lastError.
+// Programs are compiled to bytecode and run on the VM. The VM keeps globals per thread, so run copies the values it
+// leaves into the context and later runs of other contexts on the thread do not change what readInt sees.
+// Threading: a context is used by one thread at a time. Contexts on different threads compile and run independently,
+// parser and VM state is per thread. Identifiers are interned in one table for the whole process, which is locked so
+// any thread may intern. Interned names are never freed, a host keeps every distinct identifier it compiled until exit
+class HlangContext {
+public:
+    // With lazyBodies function bodies are parsed on their first call, errors in them fail the run that calls them
+    bool compileFile(const char* fileName, bool lazyBodies = false);
+    bool compileSource(std::string_view source, bool lazyBodies = false);
+    bool run();
+    // Runs compile hot functions to native code, see set_vm_jit
+    void setJit(bool enabled) { jit = enabled; }
+
+    // False when the last run did not leave a global with that name
+    bool readInt(const char* name, HInt& value) const;
+    bool readBool(const char* name, HBool& value) const;
+
+    const Diagnostic& lastError() const { return error; }
+    std::shared_ptr<ProgramNode> program() const { return compiled; }
+
+private:
+    bool compile(std::shared_ptr<SourceFile> source, bool lazyBodies);
+
+    std::shared_ptr<ProgramNode> compiled;
+    std::shared_ptr<BytecodeProgram> bytecode;
+    std::vector<HInt> globals; // By slot, as the last run of compiled left them
+    bool jit = false;
+    Diagnostic error;
+};
@@ -2,36 +2,103 @@
 // Created by idrol on 05/05/2022.
 //
 #include "interpreter.h"
+#include "array.h"
+#include "diagnostics.h"
+#include "resolver.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
 #include <unordered_map>
-#include <stack>
 
-std::vector<std::unordered_map<std::string, Variable>> variableScopes;
+constexpr size_t initialStackSize = 1 << 20;
+constexpr size_t maxStackSize = 1 << 28;
+// Calls that are not in tail position recurse on the native stack, a level takes about 200 bytes of it in release
+// builds. Kept well inside the 1 MB main thread stack of Windows
+constexpr uint32_t maxCallDepth = 1 << 12;
+
+// Contiguous, the global frame starts at 0 and the running function's frame at frameBase
+thread_local std::vector<char> valueStack;
+thread_local size_t stackTop = 0;
+thread_local size_t frameBase = 0;
+thread_local size_t globalFrameSize = 0;
+// The program the global frame belongs to, kept after the run so its globals can be read by name
+thread_local std::shared_ptr<ProgramNode> lastProgram;
+
+thread_local std::unordered_map<SymbolId, NodeRef<FunctionDeclarationNode>> functions;
+thread_local size_t knownFunctions = 0; // Entries of lastProgram->functions that are in functions
+thread_local uint32_t callDepth = 0;
+// Set by a return statement for the call it returns from
+thread_local Value returnValue;
+// Set by a tail call, its arguments already replaced the frame of the function that made it
+thread_local NodeRef<FunctionDeclarationNode> tailCallee;
+
+// How a statement left its block, anything but NEXT unwinds every block up to the running call
+enum class Flow {
+    NEXT,
+    RETURN,
+    TAIL_CALL,
+    BREAK // Unwinds up to the innermost loop
+};
+
+void reserve_stack(size_t size) {
+    if(size <= valueStack.size()) return;
+    if(size > maxStackSize) hlang_error("Stack overflow");
+    valueStack.resize(std::max(size, valueStack.size() * 2));
+}
+
+void hlang_settop(size_t stackTopInBytes) {
+    reserve_stack(stackTopInBytes);
+    stackTop = stackTopInBytes;
+}
+
+void hlang_push(size_t numBytes) {
+    hlang_settop(stackTop + numBytes);
+}
+
+void* hlang_pop(size_t numBytes) {
+    if(numBytes > stackTop) hlang_error("Stack underflow");
+    stackTop -= numBytes;
+    return valueStack.data() + stackTop;
+}
+
+void push_value(Value value) {
+    hlang_push(sizeof(Value));
+    new (valueStack.data() + stackTop - sizeof(Value)) Value(value);
+}
+
+void hlang_pushint(HInt num) {
+    push_value(Value::integer(num));
+}
+
+HInt hlang_popint() {
+    return ((Value*)hlang_pop(sizeof(Value)))->asInt();
+}
+
+Value& slot_value(VariableSlot slot) {
+    return ((Value*)(valueStack.data() + (slot.global ? 0 : frameBase)))[slot.index];
+}
 
 // Valid until next hlang call
-Variable* resolve_variable(std::string varName) {
-    for(int i = variableScopes.size()-1; i >= 0; i--) {
-        auto it = variableScopes[i].find(varName);
-        if(it != variableScopes[i].end()) {
-            return &it->second;
-        }
-    }
-    return nullptr;
+Value* resolve_variable(SymbolId varName) {
+    uint32_t slot;
+    if(!lastProgram || !findGlobalSlot(*lastProgram, varName, slot)) return nullptr;
+    if((slot + 1) * sizeof(Value) > globalFrameSize) return nullptr;
+    return &((Value*)valueStack.data())[slot];
 }
 
 int run_op(int num1, OperatorType opType, int num2) {
     switch (opType) {
         default:
         case OperatorType::INVALID:
-            fprintf(stderr, "Invalid optype recieved\n");
-            exit(-1);
+            hlang_error("Invalid optype recieved");
         case OperatorType::ADD:
-            return num1+num2;
+            return wrapping_add(num1, num2);
         case OperatorType::MUL:
-            return num1*num2;
+            return wrapping_mul(num1, num2);
         case OperatorType::DIV:
-            return num1/num2;
+            return checked_div(num1, num2);
         case OperatorType::SUB:
-            return num1-num2;
+            return wrapping_sub(num1, num2);
         case OperatorType::LESS_THAN:
             return num1<num2;
         case OperatorType::LARGER_THAN:
@@ -47,123 +114,278 @@ int run_op(int num1, OperatorType opType, int num2) {
     }
 }
 
-HInt run_binary_operation(std::shared_ptr<BinaryOperation> binaryOp);
+HInt run_binary_operation(const AstArena& ast, NodeRef<BinaryOperation> binaryOp);
+Value run_call(const AstArena& ast, NodeRef<FunctionCallNode> call);
 
-HInt run_binary_operand(std::shared_ptr<Node> node) {
-    if(node->type == NodeType::NUMBER) {
-        return std::reinterpret_pointer_cast<NumberNode>(node)->value;
-    } else if(node->type == NodeType::IDENTIFIER) {
-        auto identifier = std::reinterpret_pointer_cast<IdentifierNode>(node);
-        auto var = resolve_variable(identifier->identifier);
-        if(!var) {
-            fprintf(stderr, "%s has not been declared\n", identifier->identifier.c_str());
-            exit(-1);
-        }
-        return var->GetValue<HInt>();
-    } else if(node->type == NodeType::BINARY_OPERATION) {
-        return run_binary_operation(std::reinterpret_pointer_cast<BinaryOperation>(node));
-    } else if(node->type == NodeType::PREFIX_EXPRESSION) {
-        return run_expression(std::reinterpret_pointer_cast<ExpressionNode>(node));
+HInt run_binary_operand(const AstArena& ast, NodeRef<Node> node) {
+    if(ast[node].type == NodeType::NUMBER) {
+        return ast[node.as<NumberNode>()].value;
+    } else if(ast[node].type == NodeType::IDENTIFIER) {
+        return slot_value(ast[node.as<IdentifierNode>()].slot).asInt();
+    } else if(ast[node].type == NodeType::BINARY_OPERATION) {
+        return run_binary_operation(ast, node.as<BinaryOperation>());
+    } else if(ast[node].type == NodeType::PREFIX_EXPRESSION) {
+        return run_binary_operand(ast, ast[node.as<PrefixExpression>()].operation);
+    } else if(ast[node].type == NodeType::FUNCTION_CALL) {
+        return run_call(ast, node.as<FunctionCallNode>()).asInt();
+    } else if(ast[node].type == NodeType::INDEX) {
+        auto index = node.as<IndexNode>();
+        HInt element = run_expression(ast, ast[index].index);
+        return array_get(slot_value(ast[ast[index].array].slot).asInt(), element);
     }
-    // TODO add function call
-    fprintf(stderr, "Node type is not supported as expression operand\n");
-    exit(-1);
+    hlang_error("Node type is not supported as expression operand");
 }
 
-HInt run_binary_operation(std::shared_ptr<BinaryOperation> binaryOp) {
-    HInt leftValue = run_binary_operand(binaryOp->left);
-    HInt rightValue = run_binary_operand(binaryOp->right);
+HInt run_binary_operation(const AstArena& ast, NodeRef<BinaryOperation> binaryOp) {
+    HInt leftValue = run_binary_operand(ast, ast[binaryOp].left);
+    HInt rightValue = run_binary_operand(ast, ast[binaryOp].right);
 
-    return run_op(leftValue, binaryOp->op, rightValue);
+    if(is_array_type(ast[binaryOp].dataType)) {
+        return array_binary(ast[binaryOp].op, leftValue, operand_flags(ast, ast[binaryOp].left), rightValue,
+                            operand_flags(ast, ast[binaryOp].right));
+    }
+    return run_op(leftValue, ast[binaryOp].op, rightValue);
 }
 
-HInt run_expression(std::shared_ptr<ExpressionNode> node) {
-    if(node->type != NodeType::EXPRESSION) {
-        fprintf(stderr, "Passed node is not an expression!\n");
-        exit(-1);
+HInt run_expression(const AstArena& ast, NodeRef<ExpressionNode> node) {
+    if(ast[node].type != NodeType::EXPRESSION) {
+        hlang_error("Passed node is not an expression!");
     }
 
-    return run_binary_operand(node->operation);
+    return run_binary_operand(ast, ast[node].operation);
 }
 
-
-Variable allocDataType(DataType type) {
-    switch (type) {
-        case DataType::FLOAT:
-        case DataType::STRING:
-            fprintf(stderr, "Unsupported data type in allocation\n");
-            exit(-1);
+void run_declaration(const AstArena& ast, NodeRef<DeclarationNode> node) {
+    switch (ast[node].dataType) {
         case DataType::INT:
-            return Variable(sizeof(int));
-        case DataType::BOOL:
-            return Variable(sizeof(bool));
+        case DataType::BOOL: // Stored as the HInt its expression evaluated to
+        case DataType::INT_ARRAY:
+        case DataType::BOOL_ARRAY: // Stored as the handle
+            break;
+        default:
+            hlang_error("Unsupported data type in allocation");
     }
+    // Slots are reused by later blocks, a declaration without a value starts from 0.
+    // Calls in the expression can grow the stack so the slot is looked up after running it
+    auto& expression = ast[node].defaultValueExpression;
+    Value value = Value::declared(ast[node].dataType, expression ? run_expression(ast, expression) : 0);
+    slot_value(ast[node].slot) = value;
 }
 
-void run_declaration(std::shared_ptr<DeclarationNode> node) {
-    auto& scope = variableScopes[variableScopes.size()-1];
-    scope[node->name] = allocDataType(node->dataType);
+void run_assignment(const AstArena& ast, NodeRef<AssignmentNode> node) {
+    if(ast[node].index) {
+        HInt index = run_expression(ast, ast[node].index);
+        HInt value = run_expression(ast, ast[node].expression);
+        array_set(slot_value(ast[node].slot).asInt(), index, value);
+        return;
+    }
+    HInt value = run_expression(ast, ast[node].expression);
+    slot_value(ast[node].slot).assign(value);
 }
 
-void run_assignment(std::shared_ptr<AssignmentNode> node) {
-    auto var = resolve_variable(node->name);
-    if(!var) {
-        fprintf(stderr, "%s has not been declared\n", node->name.c_str());
-        exit(-1);
+void run_statement(const AstArena& ast, NodeRef<StatementNode> statementNode) {
+
+    if(ast[statementNode].type == NodeType::DECLARATION) {
+        run_declaration(ast, statementNode.as<DeclarationNode>());
+    } else if(ast[statementNode].type == NodeType::ASSIGNMENT) {
+        run_assignment(ast, statementNode.as<AssignmentNode>());
+    } else {
+        hlang_error("Invalid node found inside of statement node");
     }
-    var->SetValue(run_expression(node->expression));
 }
 
-void run_statement(std::shared_ptr<StatementNode> statementNode) {
+// Makes the functions the resolver reached since the last call callable
+void add_functions(const ProgramNode& program) {
+    for(; knownFunctions < program.functions.size(); knownFunctions++) {
+        auto function = program.functions[knownFunctions];
+        functions[program.ast[function].functionName] = function;
+    }
+}
 
-    if(statementNode->type == NodeType::DECLARATION) {
-        run_declaration(std::reinterpret_pointer_cast<DeclarationNode>(statementNode));
-    } else if(statementNode->type == NodeType::ASSIGNMENT) {
-        run_assignment(std::reinterpret_pointer_cast<AssignmentNode>(statementNode));
-    } else {
-        fprintf(stderr, "Invalid node found inside of statement node\n");
-        exit(-1);
+// Returns the function call calls with its body parsed, a body skipped by a lazy parse is parsed on the first call
+NodeRef<FunctionDeclarationNode> find_function(const AstArena& ast, NodeRef<FunctionCallNode> call) {
+    auto name = ast[call].functionIdentifier;
+    auto it = functions.find(name);
+    if(it == functions.end()) {
+        auto text = symbol_name(name);
+        hlang_error("%.*s is not a function", (int)text.size(), text.data());
+    }
+    auto function = it->second;
+    uint32_t expected = ast[ast[function].paramDeclarations].size();
+    uint32_t given = ast[ast[call].argumentsList].size();
+    if(expected != given) {
+        auto text = symbol_name(name);
+        hlang_error("%.*s takes %u arguments, %u given", (int)text.size(), text.data(), expected, given);
+    }
+    if(!ast[function].functionBlock) {
+        parseFunctionBody(*lastProgram, function);
+        add_functions(*lastProgram);
+    }
+    return function;
+}
+
+// Pushes the arguments of call typed like the parameters of function, they become the first slots of its frame
+void push_arguments(const AstArena& ast, NodeRef<FunctionCallNode> call, NodeRef<FunctionDeclarationNode> function) {
+    auto arguments = ast[call].argumentsList;
+    auto parameters = ast[function].paramDeclarations;
+    for(uint32_t i = 0; i < arguments.count; i++) {
+        HInt value = run_expression(ast, ast[arguments][i]);
+        push_value(Value::declared(ast[ast[parameters][i]].dataType, value));
     }
 }
 
-void run_block(std::shared_ptr<BlockNode> block);
+Flow run_block(const AstArena& ast, NodeRef<BlockNode> block);
+
+Value run_builtin_call(const AstArena& ast, NodeRef<FunctionCallNode> call) {
+    HInt arguments[3];
+    uint32_t operandFlags = 0;
+    auto list = ast[call].argumentsList;
+    for(uint32_t i = 0; i < list.count; i++) {
+        arguments[i] = run_expression(ast, ast[list][i]);
+        operandFlags |= operand_flags(ast, ast[list][i]) << (2 * i);
+    }
+    return Value::declared(ast[call].dataType, run_builtin(ast[call].builtin, arguments, operandFlags));
+}
+
+// Runs function in a frame starting at its arguments. A tail call in it replaces the function and keeps the frame
+Value run_call(const AstArena& ast, NodeRef<FunctionCallNode> call) {
+    if(ast[call].builtin != Builtin::NONE) return run_builtin_call(ast, call);
+    auto function = find_function(ast, call);
+    size_t callBase = stackTop;
+    push_arguments(ast, call, function);
+    if(++callDepth > maxCallDepth) hlang_error("Stack overflow");
+    size_t callerBase = frameBase;
+    frameBase = callBase;
+
+    Flow flow;
+    while((flow = run_block(ast, ast[function].functionBlock)) == Flow::TAIL_CALL) {
+        function = tailCallee;
+    }
 
-void run_branch(std::shared_ptr<BranchNode> branch) {
-    HInt compareValue = run_expression(branch->expression);
+    frameBase = callerBase;
+    stackTop = callBase;
+    callDepth--;
+    return flow == Flow::RETURN ? Value::declared(ast[function].returnType, returnValue.asInt()) : Value();
+}
+
+Flow run_return(const AstArena& ast, NodeRef<LastStatementNode> node) {
+    if(ast[node].isBreak) return Flow::BREAK;
+    auto returnExpr = ast[node].returnExpr;
+    if(returnExpr && callDepth > 0 && ast[ast[returnExpr].operation].type == NodeType::FUNCTION_CALL &&
+       ast[ast[returnExpr].operation.as<FunctionCallNode>()].builtin == Builtin::NONE) {
+        // Nothing of the running function is needed after the call, its arguments take over the frame
+        auto call = ast[returnExpr].operation.as<FunctionCallNode>();
+        auto function = find_function(ast, call);
+        size_t argumentsBase = stackTop;
+        push_arguments(ast, call, function);
+        size_t argumentsSize = stackTop - argumentsBase;
+        memmove(valueStack.data() + frameBase, valueStack.data() + argumentsBase, argumentsSize);
+        stackTop = frameBase + argumentsSize;
+        tailCallee = function;
+        return Flow::TAIL_CALL;
+    }
+    returnValue = returnExpr ? Value::integer(run_expression(ast, returnExpr)) : Value();
+    return Flow::RETURN;
+}
+
+Flow run_branch(const AstArena& ast, NodeRef<BranchNode> branch) {
+    HInt compareValue = run_expression(ast, ast[branch].expression);
     if(compareValue == 0) {
-        run_block(branch->falseBlock);
-    } else {
-        run_block(branch->trueBlock);
+        if(ast[branch].falseBlock) return run_block(ast, ast[branch].falseBlock);
+        return Flow::NEXT;
     }
+    return run_block(ast, ast[branch].trueBlock);
 }
 
-void run_block(std::shared_ptr<BlockNode> block) {
-    variableScopes.emplace_back();
-    for(auto &node: block->statements) {
-        if(node->type == NodeType::STATEMENT) {
-            run_statement(node);
-        } else if(node->type == NodeType::BRANCH) {
-            run_branch(std::reinterpret_pointer_cast<BranchNode>(node));
+Flow run_statements(const AstArena& ast, NodeRef<BlockNode> block);
+
+// Entering a block makes room for its locals above the ones of the blocks around it, leaving it drops them again
+Flow run_block(const AstArena& ast, NodeRef<BlockNode> block) {
+    size_t outerTop = stackTop;
+    size_t blockTop = frameBase + ast[block].blockTop * sizeof(Value);
+    if(blockTop > stackTop) hlang_settop(blockTop);
+    Flow flow = run_statements(ast, block);
+    // A tail call's arguments stay where they are, the next run of the frame raises the top over them again
+    stackTop = outerTop;
+    return flow;
+}
+
+// The body's locals are made room for once, every iteration runs in the same slots
+Flow run_loop(const AstArena& ast, NodeRef<LoopNode> loop) {
+    size_t outerTop = stackTop;
+    auto body = ast[loop].body;
+    size_t bodyTop = frameBase + ast[body].blockTop * sizeof(Value);
+    if(bodyTop > stackTop) hlang_settop(bodyTop);
+    Flow flow = Flow::NEXT;
+    while(run_expression(ast, ast[loop].expression) != 0) {
+        flow = run_statements(ast, body);
+        if(flow != Flow::NEXT) break;
+    }
+    stackTop = outerTop;
+    return flow == Flow::BREAK ? Flow::NEXT : flow;
+}
+
+Flow run_statements(const AstArena& ast, NodeRef<BlockNode> block) {
+    Flow flow = Flow::NEXT;
+    auto statements = ast[block].statements;
+    for(uint32_t i = 0; i < statements.count; i++) {
+        auto node = ast[statements][i];
+        switch (ast[node].type) {
+            case NodeType::DECLARATION:
+            case NodeType::ASSIGNMENT:
+                run_statement(ast, node);
+                break;
+            case NodeType::BRANCH:
+                flow = run_branch(ast, node.as<BranchNode>());
+                break;
+            case NodeType::LOOP:
+                flow = run_loop(ast, node.as<LoopNode>());
+                break;
+            case NodeType::FUNCTION_CALL:
+                run_call(ast, node.as<FunctionCallNode>());
+                break;
+            case NodeType::LAST_STATEMENT:
+                flow = run_return(ast, node.as<LastStatementNode>());
+                break;
+            default:
+                break; // Function declarations only run when called
         }
+        if(flow != Flow::NEXT) break;
     }
-    variableScopes.pop_back();
+    return flow;
 }
 
 void run_program(std::shared_ptr<ProgramNode> node) {
-    variableScopes.emplace_back(); // Setup global scope
-    run_block(node->programBlock);
+    resolveNames(*node);
+    functions.clear();
+    knownFunctions = 0;
+    add_functions(*node);
+    callDepth = 0;
+    reserve_stack(initialStackSize);
+    reset_arrays();
+
+    // The whole global frame is pushed up front, functions set globals declared inside of them while any block is open.
+    // The globals of the previous program stay readable through get_int_var until the next run. Room is kept for the
+    // globals of bodies that get parsed on their first call
+    globalFrameSize = (node->ast[node->programBlock].frameSize + node->skippedGlobals) * sizeof(Value);
+    frameBase = 0;
+    hlang_settop(0);
+    hlang_push(globalFrameSize);
+    std::fill((Value*)valueStack.data(), (Value*)(valueStack.data() + globalFrameSize), Value());
+    lastProgram = node;
+    run_block(node->ast, node->programBlock);
 }
 
 HInt get_int_var(std::string varName) {
-    auto var = resolve_variable(varName);
-    if(var) var->GetValue<HInt>();
+    auto var = resolve_variable(intern_symbol(varName));
+    if(var) return var->asInt();
     fprintf(stderr, "Variable %s does not exist returning 0\n", varName.c_str());
     return 0;
 }
 
 HBool get_bool_var(std::string varName) {
-    auto var = resolve_variable(varName);
-    if(var) return var->GetValue<HBool>();
+    auto var = resolve_variable(intern_symbol(varName));
+    if(var) return var->asBool();
     fprintf(stderr, "Variable %s does not exist returning false\n", varName.c_str());
     return false;
 }
\ No newline at end of file
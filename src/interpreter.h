@@ -3,38 +3,104 @@
 //
 #pragma once
 #include "parser.h"
+#include "diagnostics.h"
 
 typedef int HInt;
 typedef bool HBool;
 
-class Variable {
-public:
-    Variable() {
-        value = nullptr;
+// Int arithmetic of the language, shared by every backend. + - * wrap around on overflow and INT_MIN / -1 is INT_MIN,
+// the wrapped negation. wrapping_div leaves a zero divisor to the caller, checked_div reports it
+inline HInt wrapping_add(HInt left, HInt right) {
+    return (HInt)((uint32_t)left + (uint32_t)right);
+}
+
+inline HInt wrapping_sub(HInt left, HInt right) {
+    return (HInt)((uint32_t)left - (uint32_t)right);
+}
+
+inline HInt wrapping_mul(HInt left, HInt right) {
+    return (HInt)((uint32_t)left * (uint32_t)right);
+}
+
+inline HInt wrapping_div(HInt left, HInt right) {
+    return right == -1 ? wrapping_sub(0, left) : left / right;
+}
+
+inline HInt checked_div(HInt left, HInt right) {
+    if(right == 0) hlang_error("Division by zero");
+    return wrapping_div(left, right);
+}
+
+enum class ValueType: uint32_t {
+    INT,
+    BOOL,
+    ARRAY // intValue is the handle of an array, see array.h
+};
+
+// Fixed size value held inline by frame slots and VM registers, nothing is allocated per variable.
+// Bools keep the HInt their expression evaluated to so arithmetic and branches read every value the same way
+struct Value {
+    ValueType type = ValueType::INT;
+    union {
+        HInt intValue = 0;
+    };
+
+    static Value integer(HInt num) {
+        Value value;
+        value.intValue = num;
+        return value;
     }
-    Variable(size_t variableSize) {
-        value = malloc(variableSize);
+
+    static Value boolean(HInt truth) {
+        Value value;
+        value.type = ValueType::BOOL;
+        value.intValue = truth;
+        return value;
+    }
+
+    static Value array(HInt handle) {
+        Value value;
+        value.type = ValueType::ARRAY;
+        value.intValue = handle;
+        return value;
+    }
+
+    // Value of a variable declared as type
+    static Value declared(DataType type, HInt num) {
+        if(type == DataType::INT_ARRAY || type == DataType::BOOL_ARRAY) return array(num);
+        return type == DataType::BOOL ? boolean(num) : integer(num);
+    }
+
+    HInt asInt() const {
+        return intValue;
     }
 
-    template<typename T> void SetValue(T val) {
-        *((T*)value) = val;
+    HBool asBool() const {
+        return intValue != 0;
     }
 
-    template<typename T> T GetValue() {
-        return *(T*)value;
+    // Stores num keeping the type the variable was declared with
+    void assign(HInt num) {
+        intValue = num;
     }
-    void* value;
 };
+static_assert(sizeof(Value) == 8, "Values are copied around as two words");
 
-HInt run_expression(std::shared_ptr<ExpressionNode> node);
-void run_statement(std::shared_ptr<StatementNode> node);
+// Evaluates one operator, also used by the parser to fold literal operands
+int run_op(int num1, OperatorType opType, int num2);
+HInt run_expression(const AstArena& ast, NodeRef<ExpressionNode> node);
+void run_statement(const AstArena& ast, NodeRef<StatementNode> node);
+// Runs node after resolving its names. Function bodies skipped by a lazy parse are parsed on their first call, which
+// grows the arena, so nothing of it is held across running an expression
 void run_program(std::shared_ptr<ProgramNode> node);
-Variable* resolve_variable(std::string var);
+Value* resolve_variable(SymbolId var);
 HInt get_int_var(std::string var);
 HBool get_bool_var(std::string var);
 
-void hlang_pushint(HInt num);
-HInt hland_popint(HInt num);
+// The value stack of this thread. Frames are laid out by resolveNames, a variable lives slot * sizeof(Value) bytes above
+// its frame base, globals above 0. Pointers into the stack are valid until it next grows
+void hlang_pushint(HInt num); // Pushes and pops a whole Value
+HInt hlang_popint();
 void hlang_push(size_t numBytes);
-void* hland_pop(size_t numBytes);
+void* hlang_pop(size_t numBytes);
 void hlang_settop(size_t stackTopInBytes);
\ No newline at end of file
@@ -0,0 +1,546 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "jit.h"
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define HLANG_JIT_X86 1
+#else
+#define HLANG_JIT_X86 0
+#endif
+
+#if HLANG_JIT_X86
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+JitCode::~JitCode() {
+#if HLANG_JIT_X86
+    if(!memory) return;
+#ifdef _WIN32
+    VirtualFree(memory, 0, MEM_RELEASE);
+#else
+    munmap(memory, length);
+#endif
+#endif
+}
+
+bool jit_supported() {
+    return HLANG_JIT_X86;
+}
+
+#if HLANG_JIT_X86
+
+static_assert(sizeof(Value) == 8, "Templates move whole values as one 64 bit word");
+
+enum Reg: uint8_t {
+    RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+    R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15
+};
+
+// Only registers that are callee saved or scratch in both the System V and the Windows x64 convention are used.
+// rbx: window, r12: byte offset of the window, r13: JitRuntime, r14: globals
+#ifdef _WIN32
+constexpr Reg ARG0 = RCX;
+constexpr Reg ARG1 = RDX;
+constexpr Reg ARG2 = R8;
+#else
+constexpr Reg ARG0 = RDI;
+constexpr Reg ARG1 = RSI;
+constexpr Reg ARG2 = RDX;
+#endif
+
+// Condition codes of jcc and setcc, the opposite condition is cc ^ 1
+enum Condition: uint8_t {
+    CC_ABOVE_EQUAL = 0x3,
+    CC_EQUAL = 0x4,
+    CC_NOT_EQUAL = 0x5,
+    CC_ABOVE = 0x7,
+    CC_LESS = 0xC,
+    CC_GREATER_EQUAL = 0xD,
+    CC_LESS_EQUAL = 0xE,
+    CC_GREATER = 0xF
+};
+
+class Assembler {
+public:
+    std::vector<uint8_t> code;
+
+    size_t offset() const { return code.size(); }
+
+    void byte(uint8_t value) { code.push_back(value); }
+
+    void dword(uint32_t value) {
+        for(int i = 0; i < 4; i++) byte((uint8_t)(value >> (i * 8)));
+    }
+
+    void qword(uint64_t value) {
+        for(int i = 0; i < 8; i++) byte((uint8_t)(value >> (i * 8)));
+    }
+
+    void patch(size_t at, uint32_t value) {
+        for(int i = 0; i < 4; i++) code[at + i] = (uint8_t)(value >> (i * 8));
+    }
+
+    // opcode reg, [base + disp], always with a 32 bit displacement
+    void memory(std::initializer_list<uint8_t> opcode, bool wide, int reg, Reg base, int32_t disp) {
+        rex(wide, reg, base);
+        for(uint8_t op: opcode) byte(op);
+        byte((uint8_t)(0x80 | ((reg & 7) << 3) | (base & 7)));
+        if((base & 7) == RSP) byte(0x24);
+        dword((uint32_t)disp);
+    }
+
+    // opcode reg, rm between registers
+    void registers(std::initializer_list<uint8_t> opcode, bool wide, int reg, Reg rm) {
+        rex(wide, reg, rm);
+        for(uint8_t op: opcode) byte(op);
+        byte((uint8_t)(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+    }
+
+    void push(Reg reg) {
+        rex(false, 0, reg);
+        byte((uint8_t)(0x50 | (reg & 7)));
+    }
+
+    void pop(Reg reg) {
+        rex(false, 0, reg);
+        byte((uint8_t)(0x58 | (reg & 7)));
+    }
+
+    void moveImmediate(Reg reg, uint32_t value) {
+        rex(false, 0, reg);
+        byte((uint8_t)(0xB8 | (reg & 7)));
+        dword(value);
+    }
+
+    void moveImmediate64(Reg reg, uint64_t value) {
+        rex(true, 0, reg);
+        byte((uint8_t)(0xB8 | (reg & 7)));
+        qword(value);
+    }
+
+    // Jumps with a rel32 placeholder, returns where the placeholder is for patching
+    size_t jump() {
+        byte(0xE9);
+        dword(0);
+        return offset() - 4;
+    }
+
+    size_t jump(Condition condition) {
+        byte(0x0F);
+        byte((uint8_t)(0x80 | condition));
+        dword(0);
+        return offset() - 4;
+    }
+
+    void bind(size_t placeholder, size_t target) {
+        patch(placeholder, (uint32_t)(target - (placeholder + 4)));
+    }
+
+private:
+    void rex(bool wide, int reg, int rm) {
+        uint8_t prefix = (uint8_t)(0x40 | (wide ? 8 : 0) | ((reg & 8) >> 1) | ((rm & 8) >> 3));
+        if(prefix != 0x40) byte(prefix);
+    }
+};
+
+static int32_t slot(uint32_t reg) {
+    return (int32_t)(reg * sizeof(Value));
+}
+
+static int32_t int_slot(uint32_t reg) {
+    return slot(reg) + (int32_t)offsetof(Value, intValue);
+}
+
+// Template compiler of one function
+class FunctionCompiler {
+public:
+    FunctionCompiler(const BytecodeProgram& program, uint32_t functionIndex, JitCallHandler call, JitInstructionHandler handler):
+        program(program), function(program.functions[functionIndex]), functionIndex(functionIndex), call(call), handler(handler) {}
+
+    std::vector<uint8_t> compile() {
+        prologue();
+        size_t body = as.offset();
+
+        std::vector<size_t> starts(function.code.size());
+        for(size_t pc = 0; pc < function.code.size(); pc++) {
+            starts[pc] = as.offset();
+            instruction(function.code[pc], (uint32_t)pc, body);
+        }
+
+        // Every deoptimization hands its pc to the VM through the status
+        for(auto& exit: deoptimizations) {
+            as.bind(exit.first, as.offset());
+            as.moveImmediate(RAX, (uint32_t)(JIT_DEOPTIMIZED + exit.second));
+            exits.push_back(as.jump());
+        }
+
+        size_t epilogue = as.offset();
+        for(size_t exit: exits) as.bind(exit, epilogue);
+        as.registers({0x81}, true, 0, RSP); // add rsp, 40
+        as.dword(40);
+        as.pop(R14);
+        as.pop(R13);
+        as.pop(R12);
+        as.pop(RBX);
+        as.byte(0xC3); // ret
+
+        // Loop entry, dispatches on the header pc to the code of the header
+        std::vector<uint32_t> headers;
+        for(size_t pc = 0; pc < function.code.size(); pc++) {
+            auto& instruction = function.code[pc];
+            if((Opcode)instruction.op == Opcode::JUMP && instruction.b <= pc) headers.push_back(instruction.b);
+        }
+        if(!headers.empty()) {
+            loopOffset = as.offset();
+            prologue();
+            as.memory({0x8B}, false, RAX, R13, offsetof(JitRuntime, loopEntry)); // mov eax, [r13 + loopEntry]
+            for(uint32_t header: headers) {
+                as.registers({0x81}, false, 7, RAX); // cmp eax, header
+                as.dword(header);
+                jumps.push_back({as.jump(CC_EQUAL), header});
+            }
+            // Not a loop header, the VM carries on from there
+            as.registers({0x81}, false, 0, RAX); // add eax, JIT_DEOPTIMIZED
+            as.dword((uint32_t)JIT_DEOPTIMIZED);
+            as.bind(as.jump(), epilogue);
+        }
+
+        for(auto& jump: jumps) as.bind(jump.first, starts[jump.second]);
+        return std::move(as.code);
+    }
+
+    size_t loopEntryOffset() const { return loopOffset; }
+
+private:
+    void prologue() {
+        // Four pushes and 40 bytes keep calls 16 byte aligned and leave the Windows shadow space
+        as.push(RBX);
+        as.push(R12);
+        as.push(R13);
+        as.push(R14);
+        as.registers({0x81}, true, 5, RSP); // sub rsp, 40
+        as.dword(40);
+        as.registers({0x89}, true, ARG0, R12); // mov r12, arg0
+        as.registers({0x89}, true, ARG1, R13); // mov r13, arg1
+        reloadWindow();
+    }
+
+    // rbx and r14 from the register file pointer, after every call
+    void reloadWindow() {
+        as.memory({0x8B}, true, R14, R13, offsetof(JitRuntime, registers)); // mov r14, [r13 + registers]
+        as.registers({0x89}, true, R14, RBX); // mov rbx, r14
+        as.registers({0x01}, true, R12, RBX); // add rbx, r12
+    }
+
+    void loadInt(Reg reg, Reg window, uint32_t source) {
+        as.memory({0x8B}, false, reg, window, int_slot(source));
+    }
+
+    void storeValue(Reg window, uint32_t destination, ValueType type) {
+        as.memory({0x89}, false, RAX, window, int_slot(destination));
+        as.memory({0xC7}, false, 0, window, slot(destination));
+        as.dword((uint32_t)type);
+    }
+
+    void copyValue(Reg toWindow, uint32_t destination, Reg fromWindow, uint32_t source) {
+        as.memory({0x8B}, true, RAX, fromWindow, slot(source));
+        as.memory({0x89}, true, RAX, toWindow, slot(destination));
+    }
+
+    void deoptimize(size_t placeholder, uint32_t pc) {
+        deoptimizations.push_back({placeholder, pc});
+    }
+
+    // eax = eax op right, right is a register of window or an immediate. False when the VM has to run it
+    bool arithmetic(OperatorType op, Reg window, uint32_t right, bool immediate, uint32_t pc) {
+        switch (op) {
+            case OperatorType::ADD:
+            case OperatorType::SUB: {
+                int extension = op == OperatorType::ADD ? 0 : 5;
+                if(immediate) {
+                    as.registers({0x81}, false, extension, RAX);
+                    as.dword(right);
+                } else {
+                    as.memory({(uint8_t)(op == OperatorType::ADD ? 0x03 : 0x2B)}, false, RAX, window, int_slot(right));
+                }
+                return true;
+            }
+            case OperatorType::MUL:
+                if(immediate) {
+                    as.registers({0x69}, false, RAX, RAX);
+                    as.dword(right);
+                } else {
+                    as.memory({0x0F, 0xAF}, false, RAX, window, int_slot(right));
+                }
+                return true;
+            case OperatorType::DIV: {
+                // Division by zero is reported by the VM. A divisor of -1 negates instead, idiv traps on INT_MIN / -1
+                // where wrapping_div gives INT_MIN
+                if(immediate) {
+                    if(right == 0) return false;
+                    if((HInt)right == -1) {
+                        as.registers({0xF7}, false, 3, RAX); // neg eax
+                        return true;
+                    }
+                    as.moveImmediate(RCX, right);
+                    as.byte(0x99); // cdq
+                    as.registers({0xF7}, false, 7, RCX); // idiv ecx
+                    return true;
+                }
+                loadInt(RCX, window, right);
+                as.registers({0x85}, false, RCX, RCX); // test ecx, ecx
+                deoptimize(as.jump(CC_EQUAL), pc);
+                as.registers({0x81}, false, 7, RCX); // cmp ecx, -1
+                as.dword(0xFFFFFFFF);
+                size_t divide = as.jump(CC_NOT_EQUAL);
+                as.registers({0xF7}, false, 3, RAX); // neg eax
+                size_t done = as.jump();
+                as.bind(divide, as.offset());
+                as.byte(0x99); // cdq
+                as.registers({0xF7}, false, 7, RCX); // idiv ecx
+                as.bind(done, as.offset());
+                return true;
+            }
+            default:
+                compare(right, window, immediate);
+                as.registers({0x0F, (uint8_t)(0x90 | condition(op))}, false, 0, RAX); // setcc al
+                as.registers({0x0F, 0xB6}, false, RAX, RAX); // movzx eax, al
+                return true;
+        }
+    }
+
+    void compare(uint32_t right, Reg window, bool immediate) {
+        if(immediate) {
+            as.registers({0x81}, false, 7, RAX);
+            as.dword(right);
+        } else {
+            as.memory({0x3B}, false, RAX, window, int_slot(right));
+        }
+    }
+
+    static Condition condition(OperatorType op) {
+        switch (op) {
+            case OperatorType::EQUALS: return CC_EQUAL;
+            case OperatorType::LESS_EQUALS: return CC_LESS_EQUAL;
+            case OperatorType::LARGER_EQUALS: return CC_GREATER_EQUAL;
+            case OperatorType::LESS_THAN: return CC_LESS;
+            case OperatorType::LARGER_THAN: return CC_GREATER;
+            default: return CC_NOT_EQUAL;
+        }
+    }
+
+    static ValueType result_type(OperatorType op) {
+        switch (op) {
+            case OperatorType::ADD:
+            case OperatorType::MUL:
+            case OperatorType::DIV:
+            case OperatorType::SUB:
+                return ValueType::INT;
+            default:
+                return ValueType::BOOL;
+        }
+    }
+
+    void instruction(const Instruction& instruction, uint32_t pc, size_t body) {
+        auto op = (Opcode)instruction.op;
+        if(op >= Opcode::ADD && op <= Opcode::GLOBAL_NOT_EQUALS_CONSTANT) {
+            // The three operator families are laid out like OperatorType
+            uint32_t index = (uint32_t)op - (uint32_t)Opcode::ADD;
+            uint32_t family = index / 10;
+            auto opType = (OperatorType)((uint32_t)OperatorType::ADD + index % 10);
+            Reg window = family == 2 ? R14 : RBX;
+            loadInt(RAX, window, instruction.b);
+            if(!arithmetic(opType, window, instruction.c, family != 0, pc)) {
+                deoptimize(as.jump(), pc);
+                return;
+            }
+            storeValue(window, instruction.a, result_type(opType));
+            return;
+        }
+        if(op >= Opcode::JUMP_UNLESS_EQUALS && op <= Opcode::JUMP_UNLESS_NOT_EQUALS_CONSTANT) {
+            uint32_t index = (uint32_t)op - (uint32_t)Opcode::JUMP_UNLESS_EQUALS;
+            auto opType = (OperatorType)((uint32_t)OperatorType::EQUALS + index % 6);
+            loadInt(RAX, RBX, instruction.a);
+            compare(instruction.c, RBX, index >= 6);
+            jumps.push_back({as.jump((Condition)(condition(opType) ^ 1)), instruction.b});
+            return;
+        }
+        switch (op) {
+            case Opcode::LOAD_CONSTANT:
+                as.moveImmediate(RAX, instruction.b);
+                storeValue(RBX, instruction.a, ValueType::INT);
+                break;
+            case Opcode::MOVE:
+                copyValue(RBX, instruction.a, RBX, instruction.b);
+                break;
+            case Opcode::GET_GLOBAL:
+                copyValue(RBX, instruction.a, R14, instruction.b);
+                break;
+            case Opcode::SET_GLOBAL:
+                copyValue(R14, instruction.a, RBX, instruction.b);
+                break;
+            case Opcode::JUMP:
+                if(instruction.b <= pc) {
+                    as.memory({0x8B}, true, RAX, R13, offsetof(JitRuntime, loopIterations)); // mov rax, [r13 + loopIterations]
+                    as.memory({0xFF}, true, 0, RAX, (int32_t)(functionIndex * sizeof(uint64_t))); // inc qword [rax + function * 8]
+                }
+                jumps.push_back({as.jump(), instruction.b});
+                break;
+            case Opcode::JUMP_IF_FALSE:
+                as.memory({0x83}, false, 7, RBX, int_slot(instruction.a)); // cmp dword [rbx + a], 0
+                as.byte(0);
+                jumps.push_back({as.jump(CC_EQUAL), instruction.b});
+                break;
+            case Opcode::ARRAY_GET:
+            case Opcode::ARRAY_SET:
+            case Opcode::ARRAY_OP:
+            case Opcode::BUILTIN:
+                // Loops over arrays stay native, the element work is done by the array kernels anyway
+                as.registers({0x89}, true, R12, ARG0); // mov arg0, r12
+                as.moveImmediate64(ARG1, (uint64_t)&instruction);
+                as.moveImmediate64(RAX, (uint64_t)handler);
+                as.registers({0xFF}, false, 2, RAX); // call rax
+                as.registers({0x85}, true, RAX, RAX);
+                exits.push_back(as.jump(CC_NOT_EQUAL));
+                break;
+            case Opcode::CALL:
+                compileCall(instruction);
+                break;
+            case Opcode::TAIL_CALL:
+                // Tail calls to other functions may need a bigger window, the VM makes room for it
+                if(instruction.b != functionIndex) {
+                    deoptimize(as.jump(), pc);
+                    break;
+                }
+                for(uint32_t i = 0; i < instruction.c; i++) copyValue(RBX, i, RBX, instruction.a + i);
+                as.bind(as.jump(), body);
+                break;
+            // The window of the top level code is the global frame, it has no result register
+            case Opcode::RETURN:
+                if(functionIndex != 0) copyValue(RBX, 0, RBX, instruction.a);
+                as.registers({0x31}, false, RAX, RAX); // xor eax, eax
+                exits.push_back(as.jump());
+                break;
+            case Opcode::RETURN_VOID:
+                if(functionIndex != 0) {
+                    as.memory({0xC7}, true, 0, RBX, 0); // mov qword [rbx], 0
+                    as.dword(0);
+                }
+                as.registers({0x31}, false, RAX, RAX);
+                exits.push_back(as.jump());
+                break;
+            default:
+                deoptimize(as.jump(), pc);
+                break;
+        }
+    }
+
+    // Calls native code of the callee directly when it has some, the depth allows it and its window fits in the register
+    // file. Everything else, a deoptimized callee included, goes through the call handler
+    void compileCall(const Instruction& instruction) {
+        const BytecodeFunction& callee = program.functions[instruction.b];
+        uint32_t calleeBytes = callee.registerCount * (uint32_t)sizeof(Value);
+        std::vector<size_t> slowPath;
+        // A callee compiled on its first call had no window size yet, the call handler makes room for it every time
+        if(!callee.compiled) slowPath.push_back(as.jump());
+        as.memory({0x8B}, true, RAX, R13, offsetof(JitRuntime, entries)); // mov rax, [r13 + entries]
+        as.memory({0x8B}, true, RAX, RAX, slot(instruction.b)); // mov rax, [rax + b * 8]
+        as.registers({0x85}, true, RAX, RAX); // test rax, rax
+        slowPath.push_back(as.jump(CC_EQUAL));
+        as.memory({0x81}, false, 7, R13, offsetof(JitRuntime, depth)); // cmp dword [r13 + depth], maxJitDepth
+        as.dword(maxJitDepth);
+        slowPath.push_back(as.jump(CC_ABOVE_EQUAL));
+        calleeWindow(ARG0, instruction.a);
+        as.registers({0x89}, true, ARG0, R10); // mov r10, arg0
+        as.registers({0x81}, true, 0, R10); // add r10, calleeBytes
+        as.dword(calleeBytes);
+        as.memory({0x3B}, true, R10, R13, offsetof(JitRuntime, registerBytes)); // cmp r10, [r13 + registerBytes]
+        slowPath.push_back(as.jump(CC_ABOVE));
+
+        as.memory({0xFF}, false, 0, R13, offsetof(JitRuntime, depth)); // inc dword [r13 + depth]
+        as.registers({0x89}, true, R13, ARG1); // mov arg1, r13
+        as.registers({0xFF}, false, 2, RAX); // call rax
+        as.memory({0xFF}, false, 1, R13, offsetof(JitRuntime, depth)); // dec dword [r13 + depth]
+        as.registers({0x85}, true, RAX, RAX);
+        size_t returned = as.jump(CC_EQUAL);
+        as.registers({0x81}, true, 7, RAX); // cmp rax, JIT_FAILED
+        as.dword((uint32_t)JIT_FAILED);
+        exits.push_back(as.jump(CC_EQUAL));
+        as.registers({0x89}, true, RAX, ARG2); // mov arg2, rax, the handler finishes the deoptimized callee
+        size_t handler = as.jump();
+
+        for(size_t jump: slowPath) as.bind(jump, as.offset());
+        as.registers({0x31}, false, ARG2, ARG2); // xor arg2, arg2
+        as.bind(handler, as.offset());
+        calleeWindow(ARG0, instruction.a);
+        as.moveImmediate(ARG1, instruction.b);
+        as.moveImmediate64(RAX, (uint64_t)call);
+        as.registers({0xFF}, false, 2, RAX); // call rax
+        as.registers({0x85}, true, RAX, RAX);
+        exits.push_back(as.jump(CC_NOT_EQUAL));
+
+        as.bind(returned, as.offset());
+        reloadWindow();
+    }
+
+    // reg = byte offset of the window starting at register first
+    void calleeWindow(Reg reg, uint32_t first) {
+        as.registers({0x89}, true, R12, reg); // mov reg, r12
+        as.registers({0x81}, true, 0, reg); // add reg, first * 8
+        as.dword((uint32_t)slot(first));
+    }
+
+    const BytecodeProgram& program;
+    const BytecodeFunction& function;
+    uint32_t functionIndex;
+    JitCallHandler call;
+    JitInstructionHandler handler;
+    Assembler as;
+    std::vector<std::pair<size_t, uint32_t>> jumps; // rel32 placeholder, target pc
+    std::vector<std::pair<size_t, uint32_t>> deoptimizations; // rel32 placeholder, pc the VM continues at
+    std::vector<size_t> exits; // rel32 placeholders jumping to the epilogue with the status in rax
+    size_t loopOffset = 0;
+};
+
+std::unique_ptr<JitCode> JitCode::compile(const BytecodeProgram& program, uint32_t function, JitCallHandler call,
+                                          JitInstructionHandler handler) {
+    FunctionCompiler compiler(program, function, call, handler);
+    std::vector<uint8_t> code = compiler.compile();
+    std::unique_ptr<JitCode> jit(new JitCode());
+    jit->loopOffset = compiler.loopEntryOffset();
+    // Written while writable, then switched to executable so the memory is never both
+#ifdef _WIN32
+    void* memory = VirtualAlloc(nullptr, code.size(), MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if(!memory) return nullptr;
+    jit->memory = memory;
+    jit->length = code.size();
+    memcpy(memory, code.data(), code.size());
+    DWORD oldProtection;
+    if(!VirtualProtect(memory, code.size(), PAGE_EXECUTE_READ, &oldProtection)) return nullptr;
+    FlushInstructionCache(GetCurrentProcess(), memory, code.size());
+#else
+    void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) return nullptr;
+    jit->memory = memory;
+    jit->length = code.size();
+    memcpy(memory, code.data(), code.size());
+    if(mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) return nullptr;
+#endif
+    return jit;
+}
+
+#else
+
+std::unique_ptr<JitCode> JitCode::compile(const BytecodeProgram&, uint32_t, JitCallHandler, JitInstructionHandler) {
+    return nullptr;
+}
+
+#endif
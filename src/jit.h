@@ -0,0 +1,73 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "bytecode.h"
+
+// Baseline compiler from bytecode to x86-64 machine code. Every instruction becomes a fixed template that reads and
+// writes the register file in memory, nothing stays in machine registers from one instruction to the next. Native code
+// and the VM see the same window at every instruction boundary, so native code can hand a call back to the VM
+// (deoptimize) at any instruction and the VM carries on from there.
+
+struct JitRuntime;
+
+// Native code of a function. window is the byte offset of the function's window in the register file
+typedef uint64_t (*JitEntry)(size_t window, JitRuntime* runtime);
+// Called by native code for calls it can not make itself, runs functions[function] to completion in the window at byte
+// offset window. resume is 0 for a new call or the status of a callee that deoptimized. Returns JIT_RETURNED or JIT_FAILED
+typedef uint64_t (*JitCallHandler)(size_t window, uint32_t function, uint64_t resume);
+// Called by native code for instructions it has no template for, runs instruction in the window at byte offset window
+// without moving the register file. Returns JIT_RETURNED or JIT_FAILED
+typedef uint64_t (*JitInstructionHandler)(size_t window, const Instruction* instruction);
+
+// What native code reads of the VM, one per thread. Native code reads registers again after every call because calls
+// may move the register file
+struct JitRuntime {
+    Value* registers = nullptr; // First register of the register file
+    size_t registerBytes = 0;
+    const JitEntry* entries = nullptr; // Native code of every function of the running program, null while interpreted
+    uint64_t* loopIterations = nullptr; // Backward jumps taken per function, native code counts its own
+    uint32_t depth = 0; // Native calls nested on the native stack
+    uint32_t loopEntry = 0; // Loop header pc JitCode::loopEntry starts at
+};
+
+// Native code calls native code directly up to this depth, deeper calls go through the call handler
+constexpr uint32_t maxJitDepth = 1 << 11;
+
+// What native code returns
+constexpr uint64_t JIT_RETURNED = 0; // The result is in the first register of the window
+constexpr uint64_t JIT_FAILED = 1; // A call raised an error, the call handler kept it
+constexpr uint64_t JIT_DEOPTIMIZED = 2; // JIT_DEOPTIMIZED + pc, the VM has to continue the call at instruction pc
+
+// Executable memory holding the native code of one function
+class JitCode {
+public:
+    ~JitCode();
+    JitCode(const JitCode&) = delete;
+    JitCode& operator=(const JitCode&) = delete;
+
+    // Compiles program.functions[function]. Null when this build has no code generator for the cpu or no executable
+    // memory could be had
+    static std::unique_ptr<JitCode> compile(const BytecodeProgram& program, uint32_t function, JitCallHandler call,
+                                            JitInstructionHandler handler);
+
+    JitEntry entry() const { return (JitEntry)memory; }
+    // Enters the function at the loop header runtime->loopEntry with the window the VM left there, so a loop that got
+    // hot in the interpreter finishes natively. Null when the function has no loops
+    JitEntry loopEntry() const { return loopOffset ? (JitEntry)((uint8_t*)memory + loopOffset) : nullptr; }
+    size_t size() const { return length; }
+
+private:
+    JitCode() = default;
+
+    void* memory = nullptr;
+    size_t length = 0;
+    size_t loopOffset = 0;
+};
+
+// False when JitCode::compile always fails on this build
+bool jit_supported();
@@ -1,24 +1,106 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "tokenizer.h"
 #include "parser.h"
 #include "interpreter.h"
+#include "program_image.h"
+#include "resolver.h"
+#include "vm.h"
+#include "aot.h"
+
+// --emit-c writes the program as C to outputFile. --shared builds outputFile as a shared object from outputFile.c and
+// runs it in place of the VM
+static int compile_ahead_of_time(const char* srcFile, const char* outputFile, bool shared) {
+    auto source = SourceFile::map(srcFile);
+    if(!source) exit(-1);
+    TokenStream tokens(source, true);
+    auto ast = parseTokens(tokens);
+    std::string code = compileToC(*ast, srcFile);
+
+    std::string cFile = shared ? std::string(outputFile) + ".c" : outputFile;
+    FILE* file = fopen(cFile.c_str(), "wb");
+    if(!file || fwrite(code.data(), 1, code.size(), file) != code.size()) {
+        fprintf(stderr, "Could not write %s\n", cFile.c_str());
+        if(file) fclose(file);
+        exit(-1);
+    }
+    fclose(file);
+    if(!shared) return 0;
+
+    if(!buildSharedObject(cFile.c_str(), outputFile)) {
+        fprintf(stderr, "Could not compile %s\n", cFile.c_str());
+        exit(-1);
+    }
+    auto module = AotModule::load(outputFile);
+    if(!module) {
+        fprintf(stderr, "Could not load %s\n", outputFile);
+        exit(-1);
+    }
+    module->run();
+    HInt isTrue = 0;
+    if(!module->readInt("isTrue", isTrue)) {
+        fprintf(stderr, "Variable isTrue does not exist returning false\n");
+    }
+    printf("isTrue: %i\n", isTrue != 0);
+    return 0;
+}
 
 int main(int argc, char* argv[]) {
     printf("%i\n", argc);
-    if(argc != 3) {
-        fprintf(stderr, "Usage mylangc <srcFile> <outputFile>");
+    unsigned threadCount = 0;
+    bool emitC = false;
+    bool shared = false;
+    int arg = 1;
+    while(argc > arg && strncmp(argv[arg], "--", 2) == 0) {
+        if(strcmp(argv[arg], "--jit") == 0) {
+            set_vm_jit(true);
+        } else if(strcmp(argv[arg], "--emit-c") == 0) {
+            emitC = true;
+        } else if(strcmp(argv[arg], "--shared") == 0) {
+            shared = true;
+        } else {
+            break;
+        }
+        arg++;
+    }
+    if(argc > arg && strncmp(argv[arg], "-j", 2) == 0) {
+        threadCount = (unsigned)atoi(argv[arg] + 2);
+        arg++;
+    }
+    if(argc - arg != 2) {
+        fprintf(stderr, "Usage mylangc [--jit | --emit-c | --shared] [-j<threads>] <srcFile> <outputFile>");
         exit(-1);
     }
+    if(emitC || shared) return compile_ahead_of_time(argv[arg], argv[arg + 1], shared);
 
-    std::vector<Token> tokens = tokenize(argv[1]);
+    auto source = SourceFile::map(argv[arg]);
+    if(!source) exit(-1);
+    // outputFile holds the program image of the last compile, it is run as is while the source is unchanged
+    auto ast = loadProgramImage(argv[arg + 1], *source);
+    if(!ast) {
+        // Parallel lexing and parsing materialize every token up front, otherwise tokens are streamed into the parser
+        TokenStream tokens(source, threadCount == 0);
+        if(threadCount > 1) {
+            tokens.fillParallel(threadCount);
+        } else if(threadCount == 1) {
+            tokens.fill();
+        }
 
-    auto ast = parseTokens(tokens);
+        ast = threadCount > 1 ? parseTokensParallel(tokens, threadCount) : parseTokens(tokens);
+        if(!writeProgramImage(*ast, argv[arg + 1])) {
+            fprintf(stderr, "Could not write %s\n", argv[arg + 1]);
+        }
+    }
 
     debugAst(ast);
 
-    //run_program(ast);
+    run_bytecode(*compileBytecode(*ast));
 
-    auto var = get_bool_var("isTrue");
-    printf("isTrue: %i\n", var);
+    uint32_t slot;
+    HInt isTrue = 0;
+    if(!findGlobalSlot(*ast, intern_symbol("isTrue"), slot) || !read_bytecode_global(slot, isTrue)) {
+        fprintf(stderr, "Variable isTrue does not exist returning false\n");
+    }
+    printf("isTrue: %i\n", isTrue != 0);
 }
@@ -2,34 +2,92 @@
 // Created by idrol on 01/05/2022.
 //
 #include "parser.h"
-#include <unordered_map>
+#include "diagnostics.h"
+#include "interpreter.h"
+#include "resolver.h"
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
+#include <thread>
 #include <unordered_set>
 
-std::unordered_map<std::string, size_t> operatorPrecedence {
-        {"==", 1}, {"!=", 1}, {">=", 1}, {"<=", 1}, {"<", 1}, {">", 1},
-        {"+", 2}, {"-", 2},
-        {"*", 3}, {"/", 3}
+// Indexed by OperatorType
+const size_t operatorPrecedence[] = {
+        0, // INVALID
+        2, // ADD
+        3, // MUL
+        3, // DIV
+        2, // SUB
+        1, // EQUALS
+        1, // LESS_EQUALS
+        1, // LARGER_EQUALS
+        1, // LESS_THAN
+        1, // LARGER_THAN
+        1 // NOT_EQUALS
 };
 
-enum class IdentifierType {
-    INVALID,
-    FUNCTION,
-    VARIABLE
+// Keyed by SymbolId. A map rather than a vector indexed by id since the symbol table is shared by every program
+// the process parses, a small script would otherwise pay for every symbol interned before it.
+// Per thread so parallel parse workers each get their own copy
+thread_local DeclarationMap declaredIdentifiers;
+
+// Declarations of every top level statement of a program parsed in parallel, in statement order. A parse worker only
+// sees what statements before statementIndex declared on top of what it declared itself, like a sequential parse
+struct DeclarationHistory {
+    // Per symbol the statements that declared it, in increasing order, with the type each statement left it as
+    std::unordered_map<SymbolId, std::vector<std::pair<size_t, IdentifierType>>> statements;
+};
+
+thread_local const DeclarationHistory* declarationHistory = nullptr;
+thread_local size_t statementIndex = 0;
+
+// Set while parsing a program with lazy function bodies, bodies skipped are in ProgramNode::bodySources[lazyBodySource]
+thread_local bool lazyFunctionBodies = false;
+thread_local uint32_t lazyBodySource = 0;
+
+// Lends the declarations of a program to the parser of this thread while more of that program is parsed.
+// Swapped rather than copied, a program with many functions would otherwise copy every declaration per body
+struct ParsingDeclarations {
+    explicit ParsingDeclarations(DeclarationMap& program): program(program) {
+        declaredIdentifiers.swap(program);
+    }
+    ~ParsingDeclarations() {
+        declaredIdentifiers.swap(program);
+    }
+    DeclarationMap& program;
+};
+
+// Sets whether function bodies are skipped for one parse and restores the previous state when it ends, also when the
+// parse ends in an error that a DiagnosticScope recovers from
+struct LazyBodyScope {
+    LazyBodyScope(bool lazy, uint32_t bodySource): lazy(lazyFunctionBodies), bodySource(lazyBodySource) {
+        lazyFunctionBodies = lazy;
+        lazyBodySource = bodySource;
+    }
+    ~LazyBodyScope() {
+        lazyFunctionBodies = lazy;
+        lazyBodySource = bodySource;
+    }
+    bool lazy;
+    uint32_t bodySource;
 };
 
-std::unordered_map<std::string, IdentifierType> declaredIdentifiers;
+void add_declaration(SymbolId symbol, IdentifierType type) {
+    declaredIdentifiers[symbol] = type;
+}
 
-void add_declaration(const std::string& str, IdentifierType type) {
-    declaredIdentifiers[str] = type;
+[[noreturn]] void token_error(const Token& token) {
+    auto location = token.location();
+    hlang_error(location, "Unexpected token at line:column %zu:%zu", location.line, location.column);
 }
 
-void token_error(const Token& token) {
-    fprintf(stderr, "Unexpected token at line:column %zu:%zu\n", token.line, token.column);
-    exit(-1);
+bool is_symbol(const Token& token, Symbol symbol) {
+    return token.symbol == symbol_id(symbol);
 }
 
-void assert_token(const Token& token, const EToken& eToken, const std::string& value) {
-    if(token.token != eToken || token.value != value) {
+void assert_token(const Token& token, const EToken& eToken, Symbol symbol) {
+    if(token.token != eToken || !is_symbol(token, symbol)) {
         token_error(token);
     }
 }
@@ -40,88 +98,76 @@ void assert_token_type(const Token& token, const EToken& eToken) {
     }
 }
 
-IdentifierType get_identifier_declaration(const std::string& str) {
-    auto it = declaredIdentifiers.find(str);
-    if(it == declaredIdentifiers.end()) return IdentifierType::INVALID;
-    return it->second;
+IdentifierType get_identifier_declaration(SymbolId symbol) {
+    auto it = declaredIdentifiers.find(symbol);
+    if(it != declaredIdentifiers.end()) return it->second;
+    if(!declarationHistory) return IdentifierType::INVALID;
+    auto history = declarationHistory->statements.find(symbol);
+    if(history == declarationHistory->statements.end()) return IdentifierType::INVALID;
+    auto& statements = history->second;
+    auto later = std::lower_bound(statements.begin(), statements.end(), statementIndex,
+                                  [](const std::pair<size_t, IdentifierType>& declared, size_t index) { return declared.first < index; });
+    return later == statements.begin() ? IdentifierType::INVALID : std::prev(later)->second;
 }
 
 void assert_declaration_type(const Token& token, const IdentifierType& type) {
     assert_token_type(token, EToken::IDENTIFIER);
-    auto it = declaredIdentifiers.find(token.value);
-    if(it != declaredIdentifiers.end()) {
-        if(it->second == type) {
-            return;
-        }
+    if(get_identifier_declaration(token.symbol) == type) {
+        return;
     }
     token_error(token);
 }
 
-bool is_declared(const std::string& str) {
-    return get_identifier_declaration(str) != IdentifierType::INVALID;
+bool is_declared(SymbolId symbol) {
+    return get_identifier_declaration(symbol) != IdentifierType::INVALID;
 }
 
-size_t lengthUntilNewLine(std::vector<Token> tokens, size_t offset) {
+size_t lengthUntilNewLine(const TokenCursor& tokens) {
     size_t newLineNum = 0;
-    while(tokens[offset+newLineNum].token != EToken::NEWLINE && offset+newLineNum != tokens.size()) newLineNum++;
+    while(!tokens.atEnd(newLineNum) && tokens.peek(newLineNum).token != EToken::NEWLINE) newLineNum++;
     return newLineNum;
 }
 
-void parserError(const char* error) {
-    fprintf(stderr, "Parser error: %s\n", error);
-    exit(-1);
+[[noreturn]] void parserError(const char* error) {
+    hlang_error("Parser error: %s", error);
 }
 
-OperatorType parseOperator(Token token) {
-    if(token.token != EToken::OPERATOR) {
-        return OperatorType::INVALID;
-    }
-    if(token.value == "+") {
-        return OperatorType::ADD;
-    } else if(token.value == "-") {
-        return OperatorType::SUB;
-    } else if(token.value == "*") {
-        return OperatorType::MUL;
-    } else if(token.value == "/") {
-        return OperatorType::DIV;
-    } else if(token.value == "==") {
-        return OperatorType::EQUALS;
-    } else if(token.value == "!=") {
-        return OperatorType::NOT_EQUALS;
-    } else if(token.value == "<=") {
-        return OperatorType::LESS_EQUALS;
-    } else if(token.value == ">=") {
-        return OperatorType::LARGER_EQUALS;
-    } else if(token.value == "<") {
-        return OperatorType::LESS_THAN;
-    } else if(token.value == ">") {
-        return OperatorType::LARGER_THAN;
+OperatorType parseOperator(const Token& token) {
+    switch ((Symbol)token.symbol) {
+        case Symbol::ADD:
+            return OperatorType::ADD;
+        case Symbol::SUB:
+            return OperatorType::SUB;
+        case Symbol::MUL:
+            return OperatorType::MUL;
+        case Symbol::DIV:
+            return OperatorType::DIV;
+        case Symbol::EQUALS:
+            return OperatorType::EQUALS;
+        case Symbol::NOT_EQUALS:
+            return OperatorType::NOT_EQUALS;
+        case Symbol::LESS_EQUALS:
+            return OperatorType::LESS_EQUALS;
+        case Symbol::LARGER_EQUALS:
+            return OperatorType::LARGER_EQUALS;
+        case Symbol::LESS_THAN:
+            return OperatorType::LESS_THAN;
+        case Symbol::LARGER_THAN:
+            return OperatorType::LARGER_THAN;
+        default:
+            return OperatorType::INVALID;
     }
-    return OperatorType::INVALID;
 }
 
-size_t getOperatorPrecedence(std::string op1) {
-    auto it1 = operatorPrecedence.find(op1);
-    if(it1 == operatorPrecedence.end()) {
-        fprintf(stderr, "Unexpected operator %s\n", op1.c_str());
-        exit(-1);
+size_t getOperatorPrecedence(OperatorType op1) {
+    if(op1 == OperatorType::INVALID) {
+        hlang_error("Unexpected operator");
     }
-    return it1->second;
+    return operatorPrecedence[(size_t)op1];
 }
 
-bool hasOperatorPrecedence(std::string op1, std::string op2) {
-    auto it1 = operatorPrecedence.find(op1);
-    if(it1 == operatorPrecedence.end()) {
-        fprintf(stderr, "Unexpected operator %s\n", op1.c_str());
-        exit(-1);
-    }
-    auto it2 = operatorPrecedence.find(op2);
-    if(it2 == operatorPrecedence.end()) {
-        fprintf(stderr, "Unexpected operator %s\n", op2.c_str());
-        exit(-1);
-    }
-
-    return it1->second >= it2->second;
+bool hasOperatorPrecedence(OperatorType op1, OperatorType op2) {
+    return getOperatorPrecedence(op1) >= getOperatorPrecedence(op2);
 }
 
 bool is_valid_expression_operand(EToken operand) {
@@ -134,36 +180,81 @@ bool is_valid_expression_operand(EToken operand) {
     }
 }
 
-std::shared_ptr<FunctionCallNode> parseFunctionCall(std::vector<Token> tokens, size_t& offset);
+NodeRef<FunctionCallNode> parseFunctionCall(TokenCursor& tokens, AstArena& ast);
+NodeRef<ExpressionNode> parseExpression(TokenCursor& tokens, AstArena& ast);
+
+// Builtin called symbol, NONE for every other name. Only looked up for names that are not declared
+Builtin find_builtin(SymbolId symbol) {
+    static const std::pair<std::string_view, Builtin> builtins[] = {
+        {"int_array", Builtin::INT_ARRAY}, {"bool_array", Builtin::BOOL_ARRAY}, {"len", Builtin::LEN},
+        {"sum", Builtin::SUM}, {"min", Builtin::MIN}, {"max", Builtin::MAX}, {"select", Builtin::SELECT}
+    };
+    auto name = symbol_name(symbol);
+    for(auto& builtin: builtins) {
+        if(builtin.first == name) return builtin.second;
+    }
+    return Builtin::NONE;
+}
 
-std::shared_ptr<Node> parse_expression_operand(std::vector<Token> tokens, size_t& offset) {
-    auto token = tokens[offset];
+NodeRef<FunctionCallNode> parseBuiltinCall(TokenCursor& tokens, AstArena& ast, Builtin builtin) {
+    auto call = parseFunctionCall(tokens, ast);
+    ast[call].builtin = builtin;
+    return call;
+}
+
+// [index] after an array name, the brackets included
+NodeRef<ExpressionNode> parseIndex(TokenCursor& tokens, AstArena& ast) {
+    assert_token(tokens.peek(), EToken::OPERATOR, Symbol::OPEN_BRACKET);
+    tokens.advance();
+    auto index = parseExpression(tokens, ast);
+    assert_token(tokens.peek(), EToken::OPERATOR, Symbol::CLOSE_BRACKET);
+    tokens.advance();
+    return index;
+}
+
+// Consumes the operand, including the argument list of a function call
+NodeRef<Node> parse_expression_operand(TokenCursor& tokens, AstArena& ast) {
+    auto token = tokens.peek();
 
     if(token.token == EToken::NUMBER) {
-        auto literal = std::make_shared<NumberNode>();
-        literal->value = stoi(token.value);
+        auto literal = ast.create<NumberNode>();
+        auto end = token.value.data() + token.value.size();
+        auto parsed = std::from_chars(token.value.data(), end, ast[literal].value);
+        if(parsed.ec != std::errc() || parsed.ptr != end) {
+            auto location = token.location();
+            hlang_error(location, "Number %.*s does not fit in an int at line:column %zu:%zu", (int)token.value.size(),
+                        token.value.data(), location.line, location.column);
+        }
+        tokens.advance();
         return literal;
     } else if(token.token == EToken::IDENTIFIER) {
-        if(!is_declared(token.value)) {
-            fprintf(stderr, "%s has not been declared\n", token.value.c_str());
-            exit(-1);
+        if(!is_declared(token.symbol)) {
+            Builtin builtin = find_builtin(token.symbol);
+            if(builtin != Builtin::NONE) return parseBuiltinCall(tokens, ast, builtin);
+            hlang_error(token.location(), "%.*s has not been declared", (int)token.value.size(), token.value.data());
         }
-        auto type = get_identifier_declaration(token.value);
+        auto type = get_identifier_declaration(token.symbol);
         if(type == IdentifierType::VARIABLE) {
-            auto identifier = std::make_shared<IdentifierNode>();
-            identifier->identifier = token.value;
+            auto identifier = ast.create<IdentifierNode>();
+            ast[identifier].identifier = token.symbol;
+            tokens.advance();
+            if(is_symbol(tokens.peek(), Symbol::OPEN_BRACKET)) {
+                auto element = ast.create<IndexNode>();
+                ast[element].array = identifier;
+                ast[element].index = parseIndex(tokens, ast);
+                return element;
+            }
             return identifier;
         } else if(type == IdentifierType::FUNCTION) {
-            return parseFunctionCall(tokens, offset);
+            return parseFunctionCall(tokens, ast);
         } else {
             token_error(token);
         }
 
     } else {
-        fprintf(stderr, "Invalid expression operand\n");
-        exit(-1);
+        hlang_error("Invalid expression operand");
     }
-    return nullptr;
+    return {};
 }
 
 bool is_valid_expression_end_token(const Token& token) {
@@ -171,13 +262,13 @@ bool is_valid_expression_end_token(const Token& token) {
         case EToken::NEWLINE:
             return true;
         case EToken::KEYWORD:
-            if(token.value == "then" || token.value == "do") return true;
+            if(is_symbol(token, Symbol::THEN) || is_symbol(token, Symbol::DO)) return true;
             return false;
         case EToken::LIST_SEPARATOR:
-            if(token.value == ",") return true;
+            if(is_symbol(token, Symbol::COMMA)) return true;
             return false;
         case EToken::OPERATOR:
-            if(token.value == ")") return true;
+            if(is_symbol(token, Symbol::CLOSE_PAREN)) return true;
             return false;
         default:
             return false;
@@ -223,206 +314,270 @@ bool is_operand_token_type(const Token& token) {
 // BinOp = 2+3
 
 
-std::shared_ptr<Node> parsePrefixExpression(std::vector<Token> tokens, size_t& offset);
+struct PendingOperator {
+    OperatorType op; // OperatorType::INVALID for an open parenthesis
+    Token token;
+};
 
-std::shared_ptr<Node> parseBinaryOp(std::vector<Token> tokens, size_t& offset) {
-    std::shared_ptr<Node> leftNode;
-    auto leftToken = tokens[offset];
+// Shared by every expression on the thread, function call arguments nest on top of the caller's entries
+thread_local std::vector<NodeRef<Node>> operands;
+thread_local std::vector<PendingOperator> operators;
 
-    if(is_valid_expression_operand(leftToken.token)) {
-        leftNode = parse_expression_operand(tokens, offset);
-        offset++;
+bool is_number(const AstArena& ast, NodeRef<Node> node) {
+    return ast[node].type == NodeType::NUMBER;
+}
 
-        if (tokens[offset].token == EToken::NEWLINE)  {
-            offset++;
-            return leftNode;
-        }
-    } else if(tokens[offset].token == EToken::OPERATOR && tokens[offset].value == "(") {
-        leftNode = parsePrefixExpression(tokens, offset);
-    } else {
-        // Expected valid operand token
-        token_error(leftToken);
-    }
-
-    OperatorType opType = parseOperator(tokens[offset]);
-    if(opType == OperatorType::INVALID) {
-        return leftNode;
-    }
-    size_t operatorPrecedence = getOperatorPrecedence(tokens[offset].value);
-    offset++;
-
-    auto binOp = std::make_shared<BinaryOperation>();
-    binOp->left = leftNode;
-    binOp->op = opType;
-    binOp->precedence = operatorPrecedence;
-
-    auto rightNode = parseBinaryOp(tokens, offset);
-//    if(rightNode->type == NodeType::BINARY_OPERATION) {
-//        auto rightBinOp = std::reinterpret_pointer_cast<BinaryOperation>(rightNode);
-//        if(binOp->precedence > rightBinOp->precedence) {
-//            // Rebalance this operator has higher precedence
-//            binOp->right = rightBinOp->left;
-//            rightBinOp->left = binOp;
-//            return rightBinOp;
-//        }
-//    }
-    binOp->right = rightNode;
-
-    return binOp;
-}
-
-std::shared_ptr<BinaryOperation> balanceBinaryOpTree(std::shared_ptr<BinaryOperation> binaryOp) {
-    auto root = binaryOp;
-    if(root->right->type == NodeType::BINARY_OPERATION) {
-        auto rightBinaryOp = std::reinterpret_pointer_cast<BinaryOperation>(root->right);
-        if(root->precedence >= rightBinaryOp->precedence) {
-            root->right = rightBinaryOp->left;
-            rightBinaryOp->left = root;
-            root = balanceBinaryOpTree(rightBinaryOp);
-        } else {
-            root->right = balanceBinaryOpTree(rightBinaryOp);
+// Pops the top operator and combines the two topmost operands with it.
+// Literal operands are folded right away with the interpreter's run_op so the tree never holds constant arithmetic.
+// Folding wraps on overflow like the runtime does, only a zero divisor is an error
+void reduceOperator(AstArena& ast) {
+    auto pending = operators.back();
+    operators.pop_back();
+    auto right = operands.back();
+    operands.pop_back();
+    auto left = operands.back();
+
+    if(is_number(ast, left) && is_number(ast, right)) {
+        int rightValue = ast[right.as<NumberNode>()].value;
+        if(pending.op == OperatorType::DIV && rightValue == 0) {
+            auto location = pending.token.location();
+            hlang_error(location, "Division by zero in constant expression at line:column %zu:%zu", location.line, location.column);
         }
+        // The left literal is reused for the result, the right one is left unreferenced in the arena
+        auto literal = left.as<NumberNode>();
+        ast[literal].value = run_op(ast[literal].value, pending.op, rightValue);
+        return;
     }
-    return root;
-}
 
-std::shared_ptr<Node> balanceBinaryOp(std::shared_ptr<Node> node) {
-    if(node->type == NodeType::BINARY_OPERATION) return balanceBinaryOpTree(std::reinterpret_pointer_cast<BinaryOperation>(node));
-    return node;
+    auto binOp = ast.create<BinaryOperation>();
+    ast[binOp].op = pending.op;
+    ast[binOp].precedence = getOperatorPrecedence(pending.op);
+    ast[binOp].right = right;
+    ast[binOp].left = left;
+    operands.back() = binOp;
 }
 
+// Precedence climbing over explicit operand and operator stacks, operators of equal precedence associate left.
+// Parentheses push OperatorType::INVALID as a group marker instead of recursing so deeply nested expressions
+// do not depend on the native stack. A newline ending the expression is consumed.
+NodeRef<Node> parseOperation(TokenCursor& tokens, AstArena& ast) {
+    size_t operatorBase = operators.size();
+    size_t openGroups = 0;
 
-std::shared_ptr<Node> parsePrefixExpression(std::vector<Token> tokens, size_t& offset) {
-    assert_token(tokens[offset], EToken::OPERATOR, "(");
-    offset++;
-    auto prefixNode = std::make_shared<PrefixExpression>();
-    prefixNode->operation = balanceBinaryOp(parseBinaryOp(tokens, offset));
-    assert_token(tokens[offset], EToken::OPERATOR, ")");
-    offset++;
-    return prefixNode;
-}
+    while(true) {
+        while(is_symbol(tokens.peek(), Symbol::OPEN_PAREN)) {
+            operators.push_back({OperatorType::INVALID, tokens.peek()});
+            openGroups++;
+            tokens.advance();
+        }
 
-std::shared_ptr<ExpressionNode> parseExpression(std::vector<Token> tokens, size_t& offset) {
-    auto expression = std::make_shared<ExpressionNode>();
+        if(!is_valid_expression_operand(tokens.peek().token)) {
+            // Expected valid operand token
+            token_error(tokens.peek());
+        }
+        operands.push_back(parse_expression_operand(tokens, ast));
+
+        while(openGroups > 0 && is_symbol(tokens.peek(), Symbol::CLOSE_PAREN)) {
+            while(operators.back().op != OperatorType::INVALID) reduceOperator(ast);
+            operators.pop_back();
+            openGroups--;
+            tokens.advance();
+
+            // A parenthesised literal is just the literal
+            if(is_number(ast, operands.back())) continue;
+            auto prefixNode = ast.create<PrefixExpression>();
+            ast[prefixNode].operation = operands.back();
+            operands.back() = prefixNode;
+        }
 
-    switch (tokens[offset].token) {
-        case EToken::IDENTIFIER:
-        case EToken::NUMBER:
-            expression->operation = balanceBinaryOp(parseBinaryOp(tokens, offset));
-            return expression;
-        case EToken::OPERATOR:
-            expression->operation = parsePrefixExpression(tokens, offset);
-            return expression;
-        default:
-            token_error(tokens[offset]);
-            return nullptr;
+        OperatorType opType = parseOperator(tokens.peek());
+        if(opType == OperatorType::INVALID) break;
+
+        while(operators.size() > operatorBase && operators.back().op != OperatorType::INVALID && hasOperatorPrecedence(operators.back().op, opType)) {
+            reduceOperator(ast);
+        }
+        operators.push_back({opType, tokens.peek()});
+        tokens.advance();
+    }
+
+    if(openGroups > 0) {
+        // Missing closing parenthesis
+        token_error(tokens.peek());
     }
+    while(operators.size() > operatorBase) reduceOperator(ast);
+
+    if(tokens.peek().token == EToken::NEWLINE) tokens.advance();
+    auto operation = operands.back();
+    operands.pop_back();
+    return operation;
 }
 
-std::vector<std::shared_ptr<ExpressionNode>> parseExpressionList(std::vector<Token> tokens, size_t& offset) {
-    std::vector<std::shared_ptr<ExpressionNode>> expressionList;
+NodeRef<ExpressionNode> parseExpression(TokenCursor& tokens, AstArena& ast) {
+    auto expression = ast.create<ExpressionNode>();
+    ast[expression].operation = parseOperation(tokens, ast);
+    return expression;
+}
+
+std::vector<NodeRef<ExpressionNode>> parseExpressionList(TokenCursor& tokens, AstArena& ast) {
+    std::vector<NodeRef<ExpressionNode>> expressionList;
 
     while(true) {
-        expressionList.push_back(parseExpression(tokens, offset));
+        expressionList.push_back(parseExpression(tokens, ast));
 
-        if(tokens[offset].token != EToken::OPERATOR || tokens[offset].value != ",") {
+        if(!is_symbol(tokens.peek(), Symbol::COMMA)) {
             break;
         }
+        tokens.advance();
     }
     return expressionList;
 }
 
-DataType parseDataType(std::string type) {
-    if(type == "int") {
+DataType parseDataType(const Token& type) {
+    if(is_symbol(type, Symbol::INT)) {
         return DataType::INT;
-    } else if(type == "bool") {
+    } else if(is_symbol(type, Symbol::BOOL)) {
         return DataType::BOOL;
+    } else if(is_symbol(type, Symbol::VOID)) {
+        return DataType::VOID;
     }
 
-    fprintf(stderr, "Unknown data type %s\n", type.c_str());
-    exit(-1);
+    hlang_error(type.location(), "Unknown data type %.*s", (int)type.value.size(), type.value.data());
+}
+
+// Tokens the type at lookahead takes up, 3 for an array type like int[]
+size_t typeLength(const TokenCursor& tokens, size_t lookahead = 0) {
+    return is_symbol(tokens.peek(lookahead + 1), Symbol::OPEN_BRACKET) ? 3 : 1;
+}
+
+// Consumes a type, int[] and bool[] included
+DataType parseDataType(TokenCursor& tokens) {
+    auto type = tokens.peek();
+    DataType dataType = parseDataType(type);
+    if(typeLength(tokens) == 1) {
+        tokens.advance();
+        return dataType;
+    }
+    assert_token(tokens.peek(2), EToken::OPERATOR, Symbol::CLOSE_BRACKET);
+    tokens.advance(3);
+    if(dataType == DataType::INT) return DataType::INT_ARRAY;
+    if(dataType == DataType::BOOL) return DataType::BOOL_ARRAY;
+    hlang_error(type.location(), "Arrays of %.*s are not supported", (int)type.value.size(), type.value.data());
 }
 
-size_t findNextToken(std::vector<Token> tokens, EToken eToken, std::string value, size_t offset, size_t max = 0) {
-    size_t endOffset = offset+1;
-    while(endOffset < tokens.size()) {
-        if(max > 0 && endOffset == max) return SIZE_MAX;
-        if(tokens[endOffset].token == eToken && tokens[endOffset].value == value) {
-            return endOffset;
+// Lookahead distance to the next matching token or SIZE_MAX, gives up when it reaches max
+size_t findNextToken(const TokenCursor& tokens, EToken eToken, Symbol symbol, size_t max = 0) {
+    size_t lookahead = 1;
+    while(!tokens.atEnd(lookahead)) {
+        if(max > 0 && lookahead == max) return SIZE_MAX;
+        auto token = tokens.peek(lookahead);
+        if(token.token == eToken && is_symbol(token, symbol)) {
+            return lookahead;
         }
-        endOffset++;
+        lookahead++;
     }
     return SIZE_MAX;
 }
 
-size_t findBlockEnd(std::vector<Token> tokens, size_t offset) {
+// Lookahead distance to the end keyword closing the block the cursor is in or SIZE_MAX
+size_t findBlockEnd(const TokenCursor& tokens, FunctionDeclarationNode* skipped = nullptr) {
     size_t activeSubBlocks = 0;
-    size_t currentOffset = offset;
-    while(currentOffset < tokens.size()) {
-        auto token = tokens[currentOffset];
+    size_t lookahead = 0;
+    while(!tokens.atEnd(lookahead)) {
+        auto token = tokens.peek(lookahead);
         if(token.token == EToken::KEYWORD) {
-            if(token.value == "end") {
+            if(is_symbol(token, Symbol::END)) {
                 if(activeSubBlocks == 0) {
-                    return currentOffset;
+                    return lookahead;
                 } else {
                     activeSubBlocks--;
                 }
-            } else if(token.value == "do" || token.value == "then") {
+            } else if(is_symbol(token, Symbol::DO) || is_symbol(token, Symbol::THEN)) {
                 activeSubBlocks++;
+                // Every function body opens with do, loops do too
+                if(skipped && is_symbol(token, Symbol::DO)) skipped->bodyFunctions++;
+            } else if(skipped && is_symbol(token, Symbol::GLOBAL)) {
+                skipped->bodyGlobals++;
             }
         }
-        currentOffset++;
+        lookahead++;
     }
     return SIZE_MAX;
 }
 
-std::shared_ptr<AssignmentNode> parseAssignment(std::vector<Token> tokens, size_t& offset) {
-    assert_token(tokens[offset+1], EToken::OPERATOR, "=");
+// True when every do/then in the remaining tokens is closed by an end and no end closes a block opened before
+bool hasBalancedBlocks(const TokenCursor& tokens) {
+    size_t activeSubBlocks = 0;
+    size_t lookahead = 0;
+    while(!tokens.atEnd(lookahead)) {
+        auto token = tokens.peek(lookahead);
+        if(token.token == EToken::KEYWORD) {
+            if(is_symbol(token, Symbol::END)) {
+                if(activeSubBlocks == 0) return false;
+                activeSubBlocks--;
+            } else if(is_symbol(token, Symbol::DO) || is_symbol(token, Symbol::THEN)) {
+                activeSubBlocks++;
+            }
+        }
+        lookahead++;
+    }
+    return activeSubBlocks == 0;
+}
 
-    auto assignment = std::make_shared<AssignmentNode>();
-    assignment->type = NodeType::ASSIGNMENT;
+NodeRef<AssignmentNode> parseAssignment(TokenCursor& tokens, AstArena& ast) {
+    auto assignment = ast.create<AssignmentNode>();
+    ast[assignment].type = NodeType::ASSIGNMENT;
 
-    if(!is_declared(tokens[offset].value)) {
-        fprintf(stderr, "%s has not been declared\n", tokens[offset].value.c_str());
-        exit(-1);
+    if(!is_declared(tokens.peek().symbol)) {
+        hlang_error(tokens.peek().location(), "%.*s has not been declared", (int)tokens.peek().value.size(), tokens.peek().value.data());
+    }
+    ast[assignment].name = tokens.peek().symbol;
+    tokens.advance();
+    if(is_symbol(tokens.peek(), Symbol::OPEN_BRACKET)) {
+        ast[assignment].index = parseIndex(tokens, ast);
     }
-    assignment->name = tokens[offset].value;
-    offset += 2;
-    assignment->expression = parseExpression(tokens, offset);
+    assert_token(tokens.peek(), EToken::OPERATOR, Symbol::ASSIGN);
+    tokens.advance();
+    ast[assignment].expression = parseExpression(tokens, ast);
     return assignment;
 }
 
-std::shared_ptr<DeclarationNode> parseVariableDeclaration(std::vector<Token> tokens, size_t& offset, bool isGlobal = false) {
-    auto declaration = std::make_shared<DeclarationNode>();
-    declaration->type = NodeType::DECLARATION;
+NodeRef<DeclarationNode> parseVariableDeclaration(TokenCursor& tokens, AstArena& ast, bool isGlobal = false) {
+    auto declaration = ast.create<DeclarationNode>();
+    ast[declaration].type = NodeType::DECLARATION;
 
-    declaration->dataType = parseDataType(tokens[offset].value);
-    declaration->name = tokens[offset+1].value;
-    declaration->isGlobal = isGlobal;
+    auto typeToken = tokens.peek();
+    ast[declaration].dataType = parseDataType(tokens);
+    if(ast[declaration].dataType == DataType::VOID) {
+        hlang_error(typeToken.location(), "Variables can not be void");
+    }
+    assert_token_type(tokens.peek(), EToken::IDENTIFIER);
+    ast[declaration].name = tokens.peek().symbol;
+    ast[declaration].isGlobal = isGlobal;
 
-    add_declaration(declaration->name, IdentifierType::VARIABLE);
+    add_declaration(tokens.peek().symbol, IdentifierType::VARIABLE);
 
-    offset += 2;
+    tokens.advance();
 
-    auto nextToken = tokens[offset];
+    auto nextToken = tokens.peek();
 
-    if(nextToken.token == EToken::OPERATOR && nextToken.value == "=") {
+    if(is_symbol(nextToken, Symbol::ASSIGN)) {
         // Assignment included
-        offset++;
-        declaration->defaultValueExpression = parseExpression(tokens, offset);
+        tokens.advance();
+        ast[declaration].defaultValueExpression = parseExpression(tokens, ast);
     }
     return declaration;
 }
 
-std::vector<std::shared_ptr<DeclarationNode>> parseVariableDeclarationList(std::vector<Token> tokens, size_t& offset) {
-    std::vector<std::shared_ptr<DeclarationNode>> declarationList;
+std::vector<NodeRef<DeclarationNode>> parseVariableDeclarationList(TokenCursor& tokens, AstArena& ast) {
+    std::vector<NodeRef<DeclarationNode>> declarationList;
 
     while(true) {
-        declarationList.push_back(parseVariableDeclaration(tokens, offset));
+        declarationList.push_back(parseVariableDeclaration(tokens, ast));
 
-        if(tokens[offset].token != EToken::OPERATOR || tokens[offset].value != ",") {
+        if(!is_symbol(tokens.peek(), Symbol::COMMA)) {
             break;
         }
+        tokens.advance();
     }
 
     return declarationList;
@@ -430,237 +585,718 @@ std::vector<std::shared_ptr<DeclarationNode>> parseVariableDeclarationList(std::
 
 
 
-std::vector<std::shared_ptr<ExpressionNode>> parseParameters(std::vector<Token> tokens, size_t offset) {
-    assert_token(tokens[offset], EToken::OPERATOR, "(");
-    offset++;
+// Takes the cursor by value, the parameters are only looked at
+std::vector<NodeRef<ExpressionNode>> parseParameters(TokenCursor tokens, AstArena& ast) {
+    assert_token(tokens.peek(), EToken::OPERATOR, Symbol::OPEN_PAREN);
+    tokens.advance();
 
-    auto expressionList = parseExpressionList(tokens, offset);
+    auto expressionList = parseExpressionList(tokens, ast);
 
-    assert_token(tokens[offset], EToken::OPERATOR, ")");
+    assert_token(tokens.peek(), EToken::OPERATOR, Symbol::CLOSE_PAREN);
 
     return expressionList;
 }
 
-std::vector<std::shared_ptr<DeclarationNode>> parseParameterDeclarations(std::vector<Token> tokens, size_t& offset) {
-    assert_token(tokens[offset], EToken::OPERATOR, "(");
-    offset++;
+std::vector<NodeRef<DeclarationNode>> parseParameterDeclarations(TokenCursor& tokens, AstArena& ast) {
+    assert_token(tokens.peek(), EToken::OPERATOR, Symbol::OPEN_PAREN);
+    tokens.advance();
 
-    if(tokens[offset].token == EToken::OPERATOR && tokens[offset].value == ")") {
-        offset++;
+    if(is_symbol(tokens.peek(), Symbol::CLOSE_PAREN)) {
+        tokens.advance();
         return {};
     }
 
-    auto expressionList = parseVariableDeclarationList(tokens, offset);
+    auto expressionList = parseVariableDeclarationList(tokens, ast);
 
-    assert_token(tokens[offset], EToken::OPERATOR, ")");
-    offset++;
+    assert_token(tokens.peek(), EToken::OPERATOR, Symbol::CLOSE_PAREN);
+    tokens.advance();
 
     return expressionList;
 }
 
-std::shared_ptr<BlockNode> parseBlock(std::vector<Token> tokens, size_t& offset);
-
-std::shared_ptr<FunctionDeclarationNode> parseFunctionDeclaration(std::vector<Token> tokens, size_t& offset) {
-    auto declaration = std::make_shared<FunctionDeclarationNode>();
+NodeRef<BlockNode> parseBlock(TokenCursor& tokens, AstArena& ast);
 
-    declaration->returnType = parseDataType(tokens[offset].value);
-    offset++;
-    declaration->functionName = tokens[offset].value;
-    offset++;
+NodeRef<FunctionDeclarationNode> parseFunctionDeclaration(TokenCursor& tokens, AstArena& ast) {
+    auto declaration = ast.create<FunctionDeclarationNode>();
 
-    add_declaration(declaration->functionName, IdentifierType::FUNCTION);
+    ast[declaration].returnType = parseDataType(tokens);
+    ast[declaration].functionName = tokens.peek().symbol;
+    add_declaration(tokens.peek().symbol, IdentifierType::FUNCTION);
+    tokens.advance();
 
-    declaration->paramDeclarations = parseParameterDeclarations(tokens, offset);
+    ast[declaration].paramDeclarations = ast.createList(parseParameterDeclarations(tokens, ast));
 
-    assert_token(tokens[offset], EToken::KEYWORD, "do");
-    offset++;
-    assert_token_type(tokens[offset], EToken::NEWLINE);
-    offset++;
+    assert_token(tokens.peek(), EToken::KEYWORD, Symbol::DO);
+    tokens.advance();
+    assert_token_type(tokens.peek(), EToken::NEWLINE);
+    tokens.advance();
 
-    declaration->functionBlock = parseBlock(tokens, offset);
+    if(lazyFunctionBodies) {
+        size_t blockEnd = findBlockEnd(tokens, &ast[declaration]);
+        if(blockEnd == SIZE_MAX) parserError("Missing end for function body");
+        auto endToken = tokens.peek(blockEnd);
+        ast[declaration].bodyStart = (uint32_t)tokens.peek().offset();
+        ast[declaration].bodyEnd = (uint32_t)(endToken.offset() + endToken.value.size());
+        ast[declaration].bodySource = lazyBodySource;
+        tokens.advance(blockEnd);
+    } else {
+        ast[declaration].functionBlock = parseBlock(tokens, ast);
+    }
 
-    assert_token(tokens[offset], EToken::KEYWORD, "end");
-    offset++;
-    assert_token_type(tokens[offset], EToken::NEWLINE);
-    offset++;
+    assert_token(tokens.peek(), EToken::KEYWORD, Symbol::END);
+    tokens.advance();
+    assert_token_type(tokens.peek(), EToken::NEWLINE);
+    tokens.advance();
 
     return declaration;
 }
 
-std::shared_ptr<StatementNode> parseStatementDeclaration(std::vector<Token> tokens, size_t& offset) {
+NodeRef<StatementNode> parseStatementDeclaration(TokenCursor& tokens, AstArena& ast) {
     bool isGlobal = false;
-    if(tokens[offset].token == EToken::KEYWORD && tokens[offset].value == "global") {
+    if(is_symbol(tokens.peek(), Symbol::GLOBAL)) {
         isGlobal = true;
-        offset++;
-        if(tokens[offset+2].token == EToken::OPERATOR && tokens[offset+2].value == "(") {
-            token_error(tokens[offset+2]); // Global invalid for functions
+        tokens.advance();
+        size_t name = typeLength(tokens);
+        if(is_symbol(tokens.peek(name + 1), Symbol::OPEN_PAREN)) {
+            token_error(tokens.peek(name + 1)); // Global invalid for functions
         }
     }
 
-    assert_token_type(tokens[offset], EToken::TYPE);
-    assert_token_type(tokens[offset+1], EToken::IDENTIFIER);
+    assert_token_type(tokens.peek(), EToken::TYPE);
+    size_t name = typeLength(tokens);
+    assert_token_type(tokens.peek(name), EToken::IDENTIFIER);
 
-    if(tokens[offset+2].token == EToken::OPERATOR) {
-        if (tokens[offset + 2].value == "=") {
-            return parseVariableDeclaration(tokens, offset, isGlobal);
-        } else if (tokens[offset + 2].value == "(") {
-            return parseFunctionDeclaration(tokens, offset);
+    auto next = tokens.peek(name + 1);
+    if(next.token == EToken::OPERATOR) {
+        if (is_symbol(next, Symbol::ASSIGN)) {
+            return parseVariableDeclaration(tokens, ast, isGlobal);
+        } else if (is_symbol(next, Symbol::OPEN_PAREN)) {
+            return parseFunctionDeclaration(tokens, ast);
         }
     }
-    token_error(tokens[offset+2]);
+    token_error(next);
 }
 
-bool is_token_keyword(Token token, std::string keyword) {
+bool is_token_keyword(const Token& token, Symbol keyword) {
     if(token.token != EToken::KEYWORD) return false;
-    if(token.value == keyword) return true;
-    return false;
+    return is_symbol(token, keyword);
 }
 
-std::shared_ptr<StatementNode> parseStatement(std::vector<Token> tokens, size_t& offset);
+NodeRef<StatementNode> parseStatement(TokenCursor& tokens, AstArena& ast);
 
-std::shared_ptr<BlockNode> parseBlock(std::vector<Token> tokens, size_t& offset) {
-    auto blockNode = std::make_shared<BlockNode>();
+NodeRef<BlockNode> parseBlock(TokenCursor& tokens, AstArena& ast) {
+    auto blockNode = ast.create<BlockNode>();
+    std::vector<NodeRef<StatementNode>> statements;
     while(true) {
-        if(tokens[offset].token == EToken::NEWLINE) {
-            offset++;
+        if(tokens.atEnd()) parserError("Unexpected end of file inside block");
+        if(tokens.peek().token == EToken::NEWLINE) {
+            tokens.advance();
             continue;
         }
-        blockNode->statements.push_back(parseStatement(tokens, offset));
-
-        if(tokens[offset].token == EToken::KEYWORD && (tokens[offset].value == "else" || tokens[offset].value == "end")) break;
+        // Checked after skipping newlines, a statement may or may not have consumed the newline ending it
+        if(tokens.peek().token == EToken::KEYWORD && (is_symbol(tokens.peek(), Symbol::ELSE) || is_symbol(tokens.peek(), Symbol::END))) break;
+        tokens.release();
+        statements.push_back(parseStatement(tokens, ast));
     }
+    ast[blockNode].statements = ast.createList(statements);
 
     return blockNode;
 }
 
-std::shared_ptr<BranchNode> parseBranch(std::vector<Token> tokens, size_t& offset) {
-    assert_token(tokens[offset], EToken::KEYWORD, "if");
+NodeRef<BranchNode> parseBranch(TokenCursor& tokens, AstArena& ast) {
+    assert_token(tokens.peek(), EToken::KEYWORD, Symbol::IF);
 
-    auto node = std::make_shared<BranchNode>();
-    offset++; // If keyword consumed
+    auto node = ast.create<BranchNode>();
+    tokens.advance(); // If keyword consumed
 
-    node->expression = parseExpression(tokens, offset);
+    ast[node].expression = parseExpression(tokens, ast);
 
-    assert_token(tokens[offset], EToken::KEYWORD, "then");
-    offset++;
-    assert_token_type(tokens[offset], EToken::NEWLINE);
-    offset++;
+    assert_token(tokens.peek(), EToken::KEYWORD, Symbol::THEN);
+    tokens.advance();
+    assert_token_type(tokens.peek(), EToken::NEWLINE);
+    tokens.advance();
 
-    node->trueBlock = parseBlock(tokens, offset);
+    ast[node].trueBlock = parseBlock(tokens, ast);
 
-    if(tokens[offset].token == EToken::KEYWORD && tokens[offset].value == "else") {
-        offset++;
-        assert_token_type(tokens[offset], EToken::NEWLINE);
-        offset++;
-        node->falseBlock = parseBlock(tokens, offset);
+    if(is_symbol(tokens.peek(), Symbol::ELSE)) {
+        tokens.advance();
+        assert_token_type(tokens.peek(), EToken::NEWLINE);
+        tokens.advance();
+        ast[node].falseBlock = parseBlock(tokens, ast);
     }
 
-    assert_token(tokens[offset], EToken::KEYWORD, "end");
-    offset++;
-    assert_token_type(tokens[offset], EToken::NEWLINE);
-    offset++;
+    assert_token(tokens.peek(), EToken::KEYWORD, Symbol::END);
+    tokens.advance();
+    assert_token_type(tokens.peek(), EToken::NEWLINE);
+    tokens.advance();
 
     return node;
 }
 
-std::shared_ptr<FunctionCallNode> parseFunctionCall(std::vector<Token> tokens, size_t& offset) {
-    auto functionCall = std::make_shared<FunctionCallNode>();
+NodeRef<LoopNode> parseLoop(TokenCursor& tokens, AstArena& ast) {
+    assert_token(tokens.peek(), EToken::KEYWORD, Symbol::WHILE);
+
+    auto node = ast.create<LoopNode>();
+    tokens.advance(); // While keyword consumed
+
+    ast[node].expression = parseExpression(tokens, ast);
+
+    assert_token(tokens.peek(), EToken::KEYWORD, Symbol::DO);
+    tokens.advance();
+    assert_token_type(tokens.peek(), EToken::NEWLINE);
+    tokens.advance();
+
+    ast[node].body = parseBlock(tokens, ast);
+
+    assert_token(tokens.peek(), EToken::KEYWORD, Symbol::END);
+    tokens.advance();
+    assert_token_type(tokens.peek(), EToken::NEWLINE);
+    tokens.advance();
+
+    return node;
+}
 
-    functionCall->functionIdentifier = tokens[offset].value;
-    offset++;
-    assert_token(tokens[offset], EToken::OPERATOR, "(");
-    offset++;
-    functionCall->argumentsList = parseExpressionList(tokens, offset);
-    assert_token(tokens[offset], EToken::OPERATOR, ")");
-    offset++;
+NodeRef<FunctionCallNode> parseFunctionCall(TokenCursor& tokens, AstArena& ast) {
+    auto functionCall = ast.create<FunctionCallNode>();
+
+    ast[functionCall].functionIdentifier = tokens.peek().symbol;
+    tokens.advance();
+    assert_token(tokens.peek(), EToken::OPERATOR, Symbol::OPEN_PAREN);
+    tokens.advance();
+    if(!is_symbol(tokens.peek(), Symbol::CLOSE_PAREN)) {
+        ast[functionCall].argumentsList = ast.createList(parseExpressionList(tokens, ast));
+    }
+    assert_token(tokens.peek(), EToken::OPERATOR, Symbol::CLOSE_PAREN);
+    tokens.advance();
     return functionCall;
 }
 
-std::shared_ptr<StatementNode> parseStatementIdentifier(std::vector<Token> tokens, size_t& offset) {
-    auto nextToken = tokens[offset+1];
+NodeRef<StatementNode> parseStatementIdentifier(TokenCursor& tokens, AstArena& ast) {
+    auto nextToken = tokens.peek(1);
     if(nextToken.token == EToken::OPERATOR) {
-        if(nextToken.value == "(") {
+        if(is_symbol(nextToken, Symbol::OPEN_PAREN)) {
             // Function call
-            assert_declaration_type(tokens[offset], IdentifierType::FUNCTION);
-            return parseFunctionCall(tokens, offset);
-        } else if(nextToken.value == "=") {
-            // Assignment
-            assert_declaration_type(tokens[offset], IdentifierType::VARIABLE);
-            return parseAssignment(tokens, offset);
+            Builtin builtin = is_declared(tokens.peek().symbol) ? Builtin::NONE : find_builtin(tokens.peek().symbol);
+            if(builtin != Builtin::NONE) return parseBuiltinCall(tokens, ast, builtin);
+            assert_declaration_type(tokens.peek(), IdentifierType::FUNCTION);
+            return parseFunctionCall(tokens, ast);
+        } else if(is_symbol(nextToken, Symbol::ASSIGN) || is_symbol(nextToken, Symbol::OPEN_BRACKET)) {
+            // Assignment, to an element for arrays
+            assert_declaration_type(tokens.peek(), IdentifierType::VARIABLE);
+            return parseAssignment(tokens, ast);
         }
     }
     token_error(nextToken);
 }
 
-std::shared_ptr<LastStatementNode> parseLastStatement(std::vector<Token> tokens, size_t& offset) {
-    auto lastStatement = std::make_shared<LastStatementNode>();
-    assert_token_type(tokens[offset], EToken::KEYWORD);
-    if(tokens[offset].value == "return") {
-        offset++;
-        if(tokens[offset].token != EToken::NEWLINE) {
-            lastStatement->returnExpr = parseExpression(tokens, offset);
+NodeRef<LastStatementNode> parseLastStatement(TokenCursor& tokens, AstArena& ast) {
+    auto lastStatement = ast.create<LastStatementNode>();
+    assert_token_type(tokens.peek(), EToken::KEYWORD);
+    if(is_symbol(tokens.peek(), Symbol::RETURN)) {
+        tokens.advance();
+        if(tokens.peek().token != EToken::NEWLINE) {
+            ast[lastStatement].returnExpr = parseExpression(tokens, ast);
         } else {
-            assert_token_type(tokens[offset], EToken::NEWLINE);
-            offset++;
+            assert_token_type(tokens.peek(), EToken::NEWLINE);
+            tokens.advance();
         }
         return lastStatement;
-    } else if(tokens[offset].value == "break") {
-        offset++;
-        assert_token_type(tokens[offset], EToken::NEWLINE);
-        offset++;
+    } else if(is_symbol(tokens.peek(), Symbol::BREAK)) {
+        ast[lastStatement].isBreak = true;
+        tokens.advance();
+        assert_token_type(tokens.peek(), EToken::NEWLINE);
+        tokens.advance();
         return lastStatement;
     }
-    token_error(tokens[offset]);
-    return nullptr;
+    token_error(tokens.peek());
+    return {};
 }
 
-std::shared_ptr<StatementNode> parseStatement(std::vector<Token> tokens, size_t& offset) {
-    switch (tokens[offset].token) {
+NodeRef<StatementNode> parseStatement(TokenCursor& tokens, AstArena& ast) {
+    switch (tokens.peek().token) {
         case EToken::TYPE:
-            return parseStatementDeclaration(tokens, offset);
+            return parseStatementDeclaration(tokens, ast);
         case EToken::IDENTIFIER:
-            return parseStatementIdentifier(tokens, offset);
+            return parseStatementIdentifier(tokens, ast);
         case EToken::KEYWORD:
-            if(tokens[offset].value == "global") {
-                return parseStatementDeclaration(tokens, offset);
-            } else if(tokens[offset].value == "if") {
-                return parseBranch(tokens, offset);
-            } else if(tokens[offset].value == "return" || tokens[offset].value == "break") {
-                return parseLastStatement(tokens, offset);
+            if(is_symbol(tokens.peek(), Symbol::GLOBAL)) {
+                return parseStatementDeclaration(tokens, ast);
+            } else if(is_symbol(tokens.peek(), Symbol::IF)) {
+                return parseBranch(tokens, ast);
+            } else if(is_symbol(tokens.peek(), Symbol::WHILE)) {
+                return parseLoop(tokens, ast);
+            } else if(is_symbol(tokens.peek(), Symbol::RETURN) || is_symbol(tokens.peek(), Symbol::BREAK)) {
+                return parseLastStatement(tokens, ast);
             } else {
                 parserError("Unsupported keyword");
             }
         default:
-            fprintf(stderr, "Unsupported token\n");
-            exit(-1);
+            hlang_error(tokens.peek().location(), "Unsupported token");
     }
 }
 
-std::shared_ptr<BlockNode> parseProgramBlock(std::vector<Token> tokens) {
-    auto blockNode = std::make_shared<BlockNode>();
-    size_t offset = 0;
-    while(true) {
-        if(tokens[offset].token == EToken::NEWLINE) {
-            offset++;
+// Parses top level statements until the end of tokens, recording the source offset each statement starts at
+void parseTopLevelStatements(TokenCursor& tokens, AstArena& ast, std::vector<NodeRef<StatementNode>>& statements, std::vector<uint32_t>& starts) {
+    while(!tokens.atEnd()) {
+        if(tokens.peek().token == EToken::NEWLINE) {
+            tokens.advance();
             continue;
         }
-        blockNode->statements.push_back(parseStatement(tokens, offset));
-
-        if(offset >= (tokens.size()-1)) break;
+        tokens.release();
+        starts.push_back((uint32_t)tokens.peek().offset());
+        statements.push_back(parseStatement(tokens, ast));
     }
+}
 
-    //if(offset != (tokens.size()-1)) parserError("Program block did not consume correct amount of tokens");
+NodeRef<BlockNode> parseProgramBlock(TokenCursor& tokens, AstArena& ast, StatementStarts& statementStarts) {
+    auto blockNode = ast.create<BlockNode>();
+    std::vector<NodeRef<StatementNode>> statements;
+    std::vector<uint32_t> starts;
+    parseTopLevelStatements(tokens, ast, statements, starts);
+    if(!starts.empty()) starts[0] = 0;
+    statementStarts.assign(std::move(starts));
+    ast[blockNode].statements = ast.createList(statements);
 
     return blockNode;
 }
 
-std::shared_ptr<ProgramNode> parseTokens(std::vector<Token> tokens) {
-    auto ast = std::make_shared<ProgramNode>();
+std::shared_ptr<ProgramNode> parseTokens(TokenStream& tokens, bool lazyBodies) {
+    auto program = std::make_shared<ProgramNode>();
+    TokenCursor cursor(tokens);
+
+    program->source = tokens.source;
+    program->lazyBodies = lazyBodies;
+    if(lazyBodies) program->bodySources.push_back(tokens.source);
+    // Left over when the previous parse on this thread ended in an error
+    operands.clear();
+    operators.clear();
+    {
+        LazyBodyScope lazy(lazyBodies, 0);
+        ParsingDeclarations declarations(program->declarations);
+        program->programBlock = parseProgramBlock(cursor, program->ast, program->statementStarts);
+    }
+
+    return program;
+}
+
+NodeRef<BlockNode> parseFunctionBody(ProgramNode& program, NodeRef<FunctionDeclarationNode> function) {
+    auto& ast = program.ast;
+    if(ast[function].functionBlock || ast[function].bodyEnd == 0) return ast[function].functionBlock;
+
+    // The body slice ends with the closing end keyword which stops parseBlock
+    TokenStream body(program.bodySources[ast[function].bodySource], false, ast[function].bodyStart, ast[function].bodyEnd);
+    TokenCursor cursor(body);
+    ParsingDeclarations declarations(program.declarations);
+    LazyBodyScope lazy(true, ast[function].bodySource);
+    auto block = parseBlock(cursor, ast);
+    assert_token(cursor.peek(), EToken::KEYWORD, Symbol::END);
+
+    ast[function].functionBlock = block;
+    if(program.resolved) resolveFunction(program, function);
+    return block;
+}
+
+void collectFunctions(ProgramNode& program, NodeRef<BlockNode> block, std::vector<NodeRef<FunctionDeclarationNode>>& functions) {
+    auto& ast = program.ast;
+    // Parsing a body grows the arena, the statement list is looked up again every time
+    for(uint32_t i = 0; i < ast[block].statements.count; i++) {
+        auto statement = ast[ast[block].statements][i];
+        if(ast[statement].type == NodeType::FUNCTION_DECLARATION) {
+            auto function = statement.as<FunctionDeclarationNode>();
+            functions.push_back(function);
+            collectFunctions(program, parseFunctionBody(program, function), functions);
+        } else if(ast[statement].type == NodeType::BRANCH) {
+            auto branch = statement.as<BranchNode>();
+            collectFunctions(program, ast[branch].trueBlock, functions);
+            if(ast[branch].falseBlock) collectFunctions(program, ast[branch].falseBlock, functions);
+        } else if(ast[statement].type == NodeType::LOOP) {
+            collectFunctions(program, ast[statement.as<LoopNode>()].body, functions);
+        }
+    }
+}
+
+struct TopLevelStatement {
+    size_t token; // Index of the first token
+    bool isFunction;
+};
+
+// Splits the top level into statements by looking at tokens only, a statement ends at the first newline that is not
+// inside a do/then ... end block. Returns false when a block is never closed, the sequential parser reports that properly
+bool scanTopLevel(TokenCursor tokens, std::vector<TopLevelStatement>& statements) {
+    while(!tokens.atEnd()) {
+        if(tokens.peek().token == EToken::NEWLINE) {
+            tokens.advance();
+            continue;
+        }
+        TopLevelStatement statement = {tokens.position(), false};
+        size_t name = tokens.peek().token == EToken::TYPE ? typeLength(tokens) : 0;
+        if(name > 0 && tokens.peek(name).token == EToken::IDENTIFIER && is_symbol(tokens.peek(name + 1), Symbol::OPEN_PAREN)) {
+            statement.isFunction = true;
+        }
+        statements.push_back(statement);
+
+        size_t lookahead = 0;
+        while(!tokens.atEnd(lookahead) && tokens.peek(lookahead).token != EToken::NEWLINE) {
+            auto token = tokens.peek(lookahead++);
+            if(token.token == EToken::KEYWORD && (is_symbol(token, Symbol::DO) || is_symbol(token, Symbol::THEN))) {
+                TokenCursor block = tokens;
+                block.advance(lookahead);
+                size_t blockEnd = findBlockEnd(block);
+                if(blockEnd == SIZE_MAX) return false;
+                lookahead += blockEnd + 1;
+            }
+        }
+        tokens.advance(lookahead);
+    }
+    return true;
+}
+
+// Declarations the statement from tokens up to token end makes, in the order parsing it would make them. Every type
+// starts a declaration, of a function when the name is followed by a parameter list
+void scanDeclarations(TokenCursor tokens, size_t end, std::vector<std::pair<SymbolId, IdentifierType>>& declarations) {
+    while(tokens.position() < end && !tokens.atEnd()) {
+        if(tokens.peek().token != EToken::TYPE) {
+            tokens.advance();
+            continue;
+        }
+        size_t name = typeLength(tokens);
+        if(tokens.peek(name).token == EToken::IDENTIFIER) {
+            bool isFunction = is_symbol(tokens.peek(name + 1), Symbol::OPEN_PAREN);
+            declarations.emplace_back(tokens.peek(name).symbol, isFunction ? IdentifierType::FUNCTION : IdentifierType::VARIABLE);
+        }
+        tokens.advance(name);
+    }
+}
+
+// Adds shift to every reference below root, root itself has to be relocated already.
+// Used after the nodes were moved into another arena with AstArena::append
+void relocateNodes(AstArena& ast, NodeRef<Node> root, uint32_t shift) {
+    std::vector<NodeRef<Node>> pending = {root};
+    auto relocate = [&](auto& ref) {
+        if(!ref) return;
+        ref.offset += shift;
+        pending.push_back(ref);
+    };
+    auto relocateList = [&](auto& list) {
+        if(list.count == 0) return;
+        list.offset += shift;
+        auto items = ast[list];
+        for(uint32_t i = 0; i < items.size(); i++) {
+            auto item = items[i];
+            relocate(item);
+            ast.setListItem(list, i, item);
+        }
+    };
+
+    while(!pending.empty()) {
+        auto node = pending.back();
+        pending.pop_back();
+        switch (ast[node].type) {
+            case NodeType::EXPRESSION:
+            case NodeType::PREFIX_EXPRESSION:
+                relocate(ast[node.as<ExpressionNode>()].operation);
+                break;
+            case NodeType::BINARY_OPERATION:
+                relocate(ast[node.as<BinaryOperation>()].left);
+                relocate(ast[node.as<BinaryOperation>()].right);
+                break;
+            case NodeType::LAST_STATEMENT:
+                relocate(ast[node.as<LastStatementNode>()].returnExpr);
+                break;
+            case NodeType::DECLARATION:
+                relocate(ast[node.as<DeclarationNode>()].defaultValueExpression);
+                break;
+            case NodeType::ASSIGNMENT:
+                relocate(ast[node.as<AssignmentNode>()].index);
+                relocate(ast[node.as<AssignmentNode>()].expression);
+                break;
+            case NodeType::BLOCK:
+                relocateList(ast[node.as<BlockNode>()].statements);
+                break;
+            case NodeType::FUNCTION_CALL:
+                relocateList(ast[node.as<FunctionCallNode>()].argumentsList);
+                break;
+            case NodeType::FUNCTION_DECLARATION:
+                relocateList(ast[node.as<FunctionDeclarationNode>()].paramDeclarations);
+                relocate(ast[node.as<FunctionDeclarationNode>()].functionBlock);
+                break;
+            case NodeType::BRANCH:
+                relocate(ast[node.as<BranchNode>()].expression);
+                relocate(ast[node.as<BranchNode>()].trueBlock);
+                relocate(ast[node.as<BranchNode>()].falseBlock);
+                break;
+            case NodeType::LOOP:
+                relocate(ast[node.as<LoopNode>()].expression);
+                relocate(ast[node.as<LoopNode>()].body);
+                break;
+            case NodeType::INDEX:
+                relocate(ast[node.as<IndexNode>()].array);
+                relocate(ast[node.as<IndexNode>()].index);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+struct ParseWorker {
+    AstArena ast;
+    std::vector<size_t> statements; // Top level statements this worker parsed
+    uint32_t shift = 0;
+};
+
+std::shared_ptr<ProgramNode> parseTokensParallel(TokenStream& tokens, unsigned threadCount) {
+    tokens.fill();
+    std::vector<TopLevelStatement> topLevel;
+    if(threadCount <= 1 || !scanTopLevel(TokenCursor(tokens), topLevel)) return parseTokens(tokens);
+
+    auto program = std::make_shared<ProgramNode>();
+    ParsingDeclarations declarations(program->declarations);
+    program->source = tokens.source;
+    std::vector<NodeRef<StatementNode>> statements(topLevel.size());
+    std::vector<size_t> functions;
+
+    // What every statement declares is known from its tokens, statements only see the declarations before them.
+    // The declarations of the whole program are left the same as after a sequential parse
+    DeclarationHistory history;
+    std::vector<std::pair<SymbolId, IdentifierType>> declared;
+    for(size_t i = 0; i < topLevel.size(); i++) {
+        size_t end = i + 1 < topLevel.size() ? topLevel[i + 1].token : SIZE_MAX;
+        declared.clear();
+        scanDeclarations(TokenCursor(tokens, topLevel[i].token), end, declared);
+        for(auto& declaration: declared) {
+            auto& symbolHistory = history.statements[declaration.first];
+            if(symbolHistory.empty() || symbolHistory.back().first != i) symbolHistory.emplace_back(i, declaration.second);
+            symbolHistory.back().second = declaration.second;
+            declaredIdentifiers[declaration.first] = declaration.second;
+        }
+    }
+    const DeclarationMap programDeclarations = std::move(declaredIdentifiers);
+
+    // Scoped to a worker so the history never outlives this parse, also when an error is thrown
+    struct VisibleDeclarations {
+        explicit VisibleDeclarations(const DeclarationHistory& history) {
+            declarationHistory = &history;
+        }
+        ~VisibleDeclarations() {
+            declarationHistory = nullptr;
+            declaredIdentifiers.clear();
+        }
+    };
+    // Parses top level statement i seeing only the declarations before it and its own
+    auto parseAt = [&](size_t i, AstArena& ast, auto parse) {
+        declaredIdentifiers.clear();
+        statementIndex = i;
+        TokenCursor cursor(tokens, topLevel[i].token);
+        statements[i] = parse(cursor, ast);
+    };
+
+    // Everything but function declarations is parsed up front, they are small next to functions
+    std::vector<uint32_t> starts;
+    {
+        VisibleDeclarations visible(history);
+        for(size_t i = 0; i < topLevel.size(); i++) {
+            starts.push_back((uint32_t)tokens[topLevel[i].token].offset());
+            if(topLevel[i].isFunction) {
+                functions.push_back(i);
+            } else {
+                parseAt(i, program->ast, parseStatement);
+            }
+        }
+    }
+    if(!starts.empty()) starts[0] = 0;
+    program->statementStarts.assign(std::move(starts));
+
+    threadCount = (unsigned)std::max<size_t>(1, std::min<size_t>(threadCount, functions.size()));
+    std::vector<ParseWorker> workers(threadCount);
+    std::atomic<size_t> nextFunction(0);
+
+    auto parseFunctions = [&](ParseWorker& worker) {
+        VisibleDeclarations visible(history);
+        for(size_t i = nextFunction++; i < functions.size(); i = nextFunction++) {
+            parseAt(functions[i], worker.ast, [](TokenCursor& cursor, AstArena& ast) {
+                return NodeRef<StatementNode>(parseFunctionDeclaration(cursor, ast));
+            });
+            worker.statements.push_back(functions[i]);
+        }
+    };
+    // Errors are held until every worker is joined
+    WorkerDiagnostics diagnostics;
+    std::vector<std::thread> threads;
+    for(unsigned i = 1; i < threadCount; i++) {
+        threads.emplace_back([&, i]() { diagnostics.run([&]() { parseFunctions(workers[i]); }); });
+    }
+    diagnostics.run([&]() { parseFunctions(workers[0]); });
+    for(auto& thread: threads) thread.join();
+    diagnostics.rethrow();
+    declaredIdentifiers = programDeclarations;
+
+    // Worker arenas are copied behind each other and relocated in parallel, their regions do not overlap
+    for(auto& worker: workers) {
+        worker.shift = program->ast.append(worker.ast);
+    }
+    auto relocateFunctions = [&](ParseWorker& worker) {
+        for(size_t statement: worker.statements) {
+            statements[statement].offset += worker.shift;
+            relocateNodes(program->ast, statements[statement], worker.shift);
+        }
+    };
+    threads.clear();
+    for(unsigned i = 1; i < threadCount; i++) {
+        threads.emplace_back(relocateFunctions, std::ref(workers[i]));
+    }
+    relocateFunctions(workers[0]);
+    for(auto& thread: threads) thread.join();
+
+    program->programBlock = program->ast.create<BlockNode>();
+    auto list = program->ast.createList(statements);
+    program->ast[program->programBlock].statements = list;
+    return program;
+}
+
+void StatementStarts::assign(std::vector<uint32_t> offsets) {
+    starts = std::move(offsets);
+    shifts.assign(starts.size() + 1, 0);
+}
+
+uint32_t StatementStarts::shift(size_t i) const {
+    uint32_t sum = 0;
+    for(size_t j = i + 1; j > 0; j -= j & (~j + 1)) sum += shifts[j];
+    return sum;
+}
+
+void StatementStarts::addShift(size_t from, uint32_t delta) {
+    for(size_t j = from + 1; j < shifts.size(); j += j & (~j + 1)) shifts[j] += delta;
+}
+
+uint32_t StatementStarts::operator[](size_t i) const {
+    return starts[i] + shift(i);
+}
+
+size_t StatementStarts::find(size_t offset) const {
+    size_t low = 0, high = starts.size();
+    while(high - low > 1) {
+        size_t middle = low + (high - low) / 2;
+        if((*this)[middle] <= offset) {
+            low = middle;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void StatementStarts::replace(size_t first, size_t last, const std::vector<uint32_t>& offsets, ptrdiff_t delta) {
+    if(offsets.size() == last - first + 1) {
+        for(size_t i = 0; i < offsets.size(); i++) {
+            starts[first + i] = offsets[i] - shift(first + i);
+        }
+        addShift(last + 1, (uint32_t)delta);
+        return;
+    }
+    std::vector<uint32_t> current;
+    current.reserve(starts.size() - (last - first + 1) + offsets.size());
+    for(size_t i = 0; i < first; i++) current.push_back((*this)[i]);
+    current.insert(current.end(), offsets.begin(), offsets.end());
+    for(size_t i = last + 1; i < starts.size(); i++) current.push_back((*this)[i] + (uint32_t)delta);
+    if(!current.empty()) current[0] = 0;
+    assign(std::move(current));
+}
+
+size_t common_prefix(const char* a, const char* b, size_t length) {
+    const size_t blockSize = 4096;
+    size_t i = 0;
+    while(i + blockSize <= length && memcmp(a + i, b + i, blockSize) == 0) i += blockSize;
+    while(i < length && a[i] == b[i]) i++;
+    return i;
+}
+
+// Matching bytes at the end of a and b, at most max
+size_t common_suffix(const char* a, size_t aLength, const char* b, size_t bLength, size_t max) {
+    const size_t blockSize = 4096;
+    size_t i = 0;
+    while(i + blockSize <= max && memcmp(a + aLength - i - blockSize, b + bLength - i - blockSize, blockSize) == 0) i += blockSize;
+    while(i < max && a[aLength - i - 1] == b[bLength - i - 1]) i++;
+    return i;
+}
 
-    auto block = std::make_shared<BlockNode>();
-    ast->programBlock = parseProgramBlock(tokens);
+std::shared_ptr<ProgramNode> reparseSource(std::shared_ptr<ProgramNode> program, std::shared_ptr<SourceFile> source) {
+    if(!source || !program->source) return reparseSource(program, source, {0, 0, 0});
 
-    return ast;
+    // The edit is everything between the unchanged prefix and suffix
+    const SourceFile& previous = *program->source;
+    size_t shorter = std::min(previous.size(), source->size());
+    size_t prefix = common_prefix(previous.data(), source->data(), shorter);
+    size_t suffix = common_suffix(previous.data(), previous.size(), source->data(), source->size(), shorter - prefix);
+    return reparseSource(program, source, {prefix, previous.size() - suffix - prefix, source->size() - suffix - prefix});
+}
+
+std::shared_ptr<ProgramNode> reparseSource(std::shared_ptr<ProgramNode> program, std::shared_ptr<SourceFile> source, SourceEdit edit) {
+    if(!source) return program;
+    auto fullParse = [&]() {
+        TokenStream tokens(source, true);
+        return parseTokens(tokens, program->lazyBodies);
+    };
+    auto& starts = program->statementStarts;
+    if(!program->source || starts.empty()) return fullParse();
+
+    const SourceFile& previous = *program->source;
+    if(edit.offset + edit.removed > previous.size() || edit.offset + edit.inserted > source->size() ||
+       previous.size() - edit.removed + edit.inserted != source->size()) {
+        return fullParse();
+    }
+    if(edit.removed == 0 && edit.inserted == 0) {
+        program->source = source;
+        return program;
+    }
+    size_t prefix = edit.offset;
+    size_t changeEnd = edit.offset + edit.removed;
+    ptrdiff_t delta = (ptrdiff_t)edit.inserted - (ptrdiff_t)edit.removed;
+
+    size_t first = starts.find(prefix);
+    size_t last = starts.find(std::max(changeEnd, prefix + 1) - 1);
+    // An edit up to the start of the next statement may have joined it to the edited one
+    if(last + 1 < starts.size() && changeEnd == starts[last + 1]) last++;
+
+    size_t sliceBegin = starts[first];
+    size_t sliceEnd = last + 1 < starts.size() ? starts[last + 1] + delta : source->size();
+    TokenStream slice(source, false, sliceBegin, sliceEnd);
+    slice.fill();
+    TokenCursor cursor(slice);
+    // Blocks opened or closed across the slice boundary change how the statements after it parse
+    if(!hasBalancedBlocks(cursor)) return fullParse();
+
+    AstArena& ast = program->ast;
+    std::vector<NodeRef<StatementNode>> statements;
+    std::vector<uint32_t> sliceStarts;
+    if(program->lazyBodies) program->bodySources.push_back(source);
+    {
+        LazyBodyScope lazy(program->lazyBodies, program->lazyBodies ? (uint32_t)program->bodySources.size() - 1 : 0);
+        ParsingDeclarations declarations(program->declarations);
+        parseTopLevelStatements(cursor, ast, statements, sliceStarts);
+    }
+    if(!sliceStarts.empty()) sliceStarts[0] = (uint32_t)sliceBegin;
+    program->resolved = false;
+
+    auto& block = ast[program->programBlock];
+    size_t replaced = last - first + 1;
+    if(statements.size() == replaced) {
+        for(size_t i = 0; i < replaced; i++) {
+            ast.setListItem(block.statements, (uint32_t)(first + i), statements[i]);
+        }
+    } else {
+        auto previousStatements = ast[block.statements];
+        std::vector<NodeRef<StatementNode>> spliced(previousStatements.begin(), previousStatements.begin() + first);
+        spliced.insert(spliced.end(), statements.begin(), statements.end());
+        spliced.insert(spliced.end(), previousStatements.begin() + last + 1, previousStatements.end());
+        auto list = ast.createList(spliced);
+        ast[program->programBlock].statements = list;
+    }
+
+    starts.replace(first, last, sliceStarts, delta);
+    program->source = source;
+
+    return program;
 }
 
 size_t indent = 0;
@@ -683,51 +1319,79 @@ const char* get_type_name(DataType type) {
             return "string";
         case DataType::VOID:
             return "void";
+        case DataType::INT_ARRAY:
+            return "int[]";
+        case DataType::BOOL_ARRAY:
+            return "bool[]";
         default:
             return "unknown";
     }
 }
 
-void debugBlock(std::shared_ptr<BlockNode> node);
+void debugBlock(const AstArena& ast, NodeRef<BlockNode> node);
 
-void debugFunctionDeclaration(std::shared_ptr<FunctionDeclarationNode> node) {
-    printf("func_dec return_type='%s' name='%s', params=(TODO)\n", get_type_name(node->returnType), node->functionName.c_str());
+void debugFunctionDeclaration(const AstArena& ast, NodeRef<FunctionDeclarationNode> node) {
+    printf("func_dec return_type='%s' name='%.*s', params=(TODO)\n", get_type_name(ast[node].returnType), (int)symbol_name(ast[node].functionName).size(), symbol_name(ast[node].functionName).data());
     indent++;
-    debugBlock(node->functionBlock);
+    if(ast[node].functionBlock) {
+        debugBlock(ast, ast[node].functionBlock);
+    } else {
+        print_indent();
+        printf("[lazy_block]\n");
+    }
     indent--;
 }
 
-void debug_number(std::shared_ptr<NumberNode> node) {
-    printf("%i", node->value);
+void debug_number(const AstArena& ast, NodeRef<NumberNode> node) {
+    printf("%i", ast[node].value);
 }
 
-void debug_identifier(std::shared_ptr<IdentifierNode> node) {
-    printf("%s", node->identifier.c_str());
+void debug_identifier(const AstArena& ast, NodeRef<IdentifierNode> node) {
+    printf("%.*s", (int)symbol_name(ast[node].identifier).size(), symbol_name(ast[node].identifier).data());
 }
 
-void debug_expression(std::shared_ptr<ExpressionNode> expression);
+void debug_binary_operand(const AstArena& ast, NodeRef<Node> node);
 
-void debug_prefix_expression(std::shared_ptr<PrefixExpression> expression) {
+void debug_prefix_expression(const AstArena& ast, NodeRef<PrefixExpression> expression) {
     printf("(");
-    debug_expression(expression);
+    debug_binary_operand(ast, ast[expression].operation);
     printf(")");
 }
 
-void debug_binary_op(std::shared_ptr<BinaryOperation> binaryOp);
+void debug_binary_op(const AstArena& ast, NodeRef<BinaryOperation> binaryOp);
+
+void debug_function_call(const AstArena& ast, NodeRef<FunctionCallNode> call) {
+    printf("%.*s(", (int)symbol_name(ast[call].functionIdentifier).size(), symbol_name(ast[call].functionIdentifier).data());
+    auto arguments = ast[ast[call].argumentsList];
+    for(uint32_t i = 0; i < arguments.size(); i++) {
+        if(i > 0) printf(", ");
+        debug_binary_operand(ast, ast[arguments[i]].operation);
+    }
+    printf(")");
+}
 
-void debug_binary_operand(std::shared_ptr<Node> node) {
-    switch (node->type) {
+void debug_binary_operand(const AstArena& ast, NodeRef<Node> node) {
+    switch (ast[node].type) {
         case NodeType::NUMBER:
-            debug_number(std::reinterpret_pointer_cast<NumberNode>(node));
+            debug_number(ast, node.as<NumberNode>());
             break;
         case NodeType::IDENTIFIER:
-            debug_identifier(std::reinterpret_pointer_cast<IdentifierNode>(node));
+            debug_identifier(ast, node.as<IdentifierNode>());
             break;
         case NodeType::BINARY_OPERATION:
-            debug_binary_op(std::reinterpret_pointer_cast<BinaryOperation>(node));
+            debug_binary_op(ast, node.as<BinaryOperation>());
             break;
         case NodeType::PREFIX_EXPRESSION:
-            debug_prefix_expression(std::reinterpret_pointer_cast<PrefixExpression>(node));
+            debug_prefix_expression(ast, node.as<PrefixExpression>());
+            break;
+        case NodeType::FUNCTION_CALL:
+            debug_function_call(ast, node.as<FunctionCallNode>());
+            break;
+        case NodeType::INDEX:
+            debug_identifier(ast, ast[node.as<IndexNode>()].array);
+            printf("[");
+            debug_binary_operand(ast, ast[ast[node.as<IndexNode>()].index].operation);
+            printf("]");
             break;
         default:
             printf("ERROR");
@@ -762,37 +1426,37 @@ const char* get_operator(OperatorType type) {
     }
 }
 
-void debug_binary_op(std::shared_ptr<BinaryOperation> binaryOp) {
+void debug_binary_op(const AstArena& ast, NodeRef<BinaryOperation> binaryOp) {
     printf("(");
-    debug_binary_operand(binaryOp->left);
-    printf("%s", get_operator(binaryOp->op));
-    debug_binary_operand(binaryOp->right);
+    debug_binary_operand(ast, ast[binaryOp].left);
+    printf("%s", get_operator(ast[binaryOp].op));
+    debug_binary_operand(ast, ast[binaryOp].right);
     printf(")");
 }
 
-void debug_expression(std::shared_ptr<ExpressionNode> expression) {
+void debug_expression(const AstArena& ast, NodeRef<ExpressionNode> expression) {
     print_indent();
     printf("[expression]");
-    debug_binary_operand(expression->operation);
+    debug_binary_operand(ast, ast[expression].operation);
     printf("\n");
 }
 
-void debug_vardec(std::shared_ptr<DeclarationNode> node) {
-    printf("(var_dec type='%s' name='%s')", get_type_name(node->dataType), node->name.c_str());
-    if(node->defaultValueExpression) {
+void debug_vardec(const AstArena& ast, NodeRef<DeclarationNode> node) {
+    printf("(var_dec type='%s' name='%.*s')", get_type_name(ast[node].dataType), (int)symbol_name(ast[node].name).size(), symbol_name(ast[node].name).data());
+    if(ast[node].defaultValueExpression) {
         printf(" {expression_begin}\n");
         indent++;
-        debug_expression(node->defaultValueExpression);
+        debug_expression(ast, ast[node].defaultValueExpression);
         indent--;
         print_indent();
         printf("{end}\n");
     }
 }
 
-void debugStatement(std::shared_ptr<StatementNode> statementNode) {
+void debugStatement(const AstArena& ast, NodeRef<StatementNode> statementNode) {
     print_indent();
     printf("[statement] ");
-    switch (statementNode->type) {
+    switch (ast[statementNode].type) {
         case NodeType::ASSIGNMENT:
             printf("assignment\n");
             return;
@@ -800,16 +1464,19 @@ void debugStatement(std::shared_ptr<StatementNode> statementNode) {
             printf("function_call\n");
             return;
         case NodeType::DECLARATION:
-            debug_vardec(std::reinterpret_pointer_cast<DeclarationNode>(statementNode));
+            debug_vardec(ast, statementNode.as<DeclarationNode>());
             return;
         case NodeType::FUNCTION_DECLARATION:
             indent++;
-            debugFunctionDeclaration(std::reinterpret_pointer_cast<FunctionDeclarationNode>(statementNode));
+            debugFunctionDeclaration(ast, statementNode.as<FunctionDeclarationNode>());
             indent--;
             return;
         case NodeType::BRANCH:
             printf("branch\n");
             return;
+        case NodeType::LOOP:
+            printf("loop\n");
+            return;
         case NodeType::LAST_STATEMENT:
             printf("return/break\n");
             return;
@@ -819,13 +1486,13 @@ void debugStatement(std::shared_ptr<StatementNode> statementNode) {
     }
 }
 
-void debugBlock(std::shared_ptr<BlockNode> node) {
+void debugBlock(const AstArena& ast, NodeRef<BlockNode> node) {
     print_indent();
     printf("[block]\n");
 
     indent++;
-    for(auto statement: node->statements) {
-        debugStatement(statement);
+    for(auto statement: ast[ast[node].statements]) {
+        debugStatement(ast, statement);
     }
     indent--;
 }
@@ -834,7 +1501,7 @@ void debugAst(std::shared_ptr<ProgramNode> node) {
     setbuf(stdout, NULL);
     printf("[program]\n");
     indent++;
-    debugBlock(node->programBlock);
+    debugBlock(node->ast, node->programBlock);
     indent--;
     printf("[end_program]\n");
 }
\ No newline at end of file
@@ -3,9 +3,11 @@
 //
 #pragma once
 
+#include <unordered_map>
 #include <utility>
 #include <vector>
 #include <memory>
+#include "ast_arena.h"
 #include "tokenizer.h"
 
 enum class NodeType {
@@ -22,7 +24,9 @@ enum class NodeType {
     FUNCTION_CALL,
     ASSIGNMENT,
     BLOCK,
-    BRANCH
+    BRANCH,
+    LOOP,
+    INDEX
 };
 
 enum class OperatorType {
@@ -44,21 +48,47 @@ enum class DataType {
     BOOL,
     INT,
     FLOAT,
-    STRING
+    STRING,
+    INT_ARRAY, // int[]
+    BOOL_ARRAY // bool[]
 };
 
-struct ParamDeclaration {
-    DataType type;
-    std::string name;
-    size_t stackBaseOffset;
+// Functions every program has, see array.h. Calls to them are FunctionCallNodes with builtin set, a function declared
+// with the same name hides the builtin
+enum class Builtin: uint32_t {
+    NONE,
+    INT_ARRAY, // int_array(length), zeroed
+    BOOL_ARRAY, // bool_array(length), all false
+    LEN, // len(array)
+    SUM, // sum(array)
+    MIN, // min(array)
+    MAX, // max(array)
+    SELECT // select(mask, whenTrue, whenFalse), either of the values may be a scalar
 };
 
-struct VariableDeclaration {
-    DataType type;
-    std::string name;
-    size_t stackBaseOffset;
+inline uint32_t builtin_arity(Builtin builtin) {
+    return builtin == Builtin::SELECT ? 3 : 1;
+}
+
+enum class IdentifierType {
+    INVALID,
+    FUNCTION,
+    VARIABLE
 };
 
+using DeclarationMap = std::unordered_map<SymbolId, IdentifierType>;
+
+// Where a variable lives at runtime, filled in by resolveNames. Every declaration gets its own slot in the frame of the
+// function it is declared in, or in the global frame for top level and global declarations.
+// Functions can not see the locals of other functions so a frame is either the current one or the global one
+struct VariableSlot {
+    uint32_t index = 0;
+    bool global = false;
+};
+
+// Nodes live in the AstArena of their ProgramNode and reference each other through NodeRef offsets,
+// they have to stay trivially destructible
+
 class Node {
 public:
     Node() {};
@@ -71,7 +101,7 @@ public:
         type = NodeType::EXPRESSION;
     };
 
-    std::shared_ptr<Node> operation;
+    NodeRef<Node> operation;
 };
 
 class PrefixExpression: public ExpressionNode {
@@ -87,9 +117,10 @@ public:
         type = NodeType::BINARY_OPERATION;
     }
 
-    std::shared_ptr<Node> left, right;
+    NodeRef<Node> left, right;
     OperatorType op;
-    size_t precedence;
+    uint32_t precedence;
+    DataType dataType = DataType::INT; // Of the result, set by resolveNames. Whole array operations give arrays
 };
 
 class IdentifierNode: public Node {
@@ -98,7 +129,9 @@ public:
         type = NodeType::IDENTIFIER;
     };
 
-    std::string identifier;
+    SymbolId identifier;
+    VariableSlot slot;
+    DataType dataType = DataType::INT; // Declared type of the variable, set by resolveNames
 };
 
 class NumberNode: public Node {
@@ -123,7 +156,8 @@ public:
         type = NodeType::LAST_STATEMENT;
     }
 
-    std::shared_ptr<ExpressionNode> returnExpr; // Optional
+    NodeRef<ExpressionNode> returnExpr; // Optional
+    bool isBreak = false; // Leaves the innermost loop instead of the function
 };
 
 class DeclarationNode: public StatementNode {
@@ -133,8 +167,9 @@ public:
     };
     bool isGlobal = false;
     DataType dataType;
-    std::string name;
-    std::shared_ptr<ExpressionNode> defaultValueExpression;
+    SymbolId name;
+    NodeRef<ExpressionNode> defaultValueExpression;
+    VariableSlot slot;
 };
 
 
@@ -143,8 +178,10 @@ public:
     AssignmentNode() {
         type = NodeType::ASSIGNMENT;
     };
-    std::string name;
-    std::shared_ptr<ExpressionNode> expression;
+    SymbolId name;
+    NodeRef<ExpressionNode> index; // Optional, name[index] = expression stores one element of an array
+    NodeRef<ExpressionNode> expression;
+    VariableSlot slot;
 };
 
 class BlockNode: public Node {
@@ -153,7 +190,9 @@ public:
         type = NodeType::BLOCK;
     };
 
-    std::vector<std::shared_ptr<StatementNode>> statements;
+    NodeList<StatementNode> statements;
+    uint32_t frameSize = 0; // Slots of the frame, only set on the program block and function blocks
+    uint32_t blockTop = 0; // Slots of a function frame in use while the block runs, nested blocks raise it on entry
 };
 
 class FunctionCallNode: public StatementNode {
@@ -162,8 +201,10 @@ public:
         type = NodeType::FUNCTION_CALL;
     }
 
-    std::string functionIdentifier;
-    std::vector<std::shared_ptr<ExpressionNode>> argumentsList;
+    SymbolId functionIdentifier;
+    NodeList<ExpressionNode> argumentsList;
+    Builtin builtin = Builtin::NONE;
+    DataType dataType = DataType::INT; // Of the result, set by resolveNames
 };
 
 class FunctionDeclarationNode: public StatementNode {
@@ -174,9 +215,18 @@ public:
 
     int numParams;
     DataType returnType;
-    std::string functionName;
-    std::vector<std::shared_ptr<DeclarationNode>> paramDeclarations;
-    std::shared_ptr<BlockNode> functionBlock;
+    SymbolId functionName;
+    NodeList<DeclarationNode> paramDeclarations;
+    NodeRef<BlockNode> functionBlock; // Null until parseFunctionBody ran for lazily parsed functions
+
+    // Source range from the first token of the body to the end of the closing end keyword,
+    // bodySource indexes ProgramNode::bodySources. Only set for lazily parsed functions
+    uint32_t bodyStart = 0;
+    uint32_t bodyEnd = 0;
+    uint32_t bodySource = 0;
+    // At most this many functions and globals are declared in the skipped body, nested bodies included
+    uint32_t bodyFunctions = 0;
+    uint32_t bodyGlobals = 0;
 };
 
 class BranchNode: public StatementNode {
@@ -184,18 +234,121 @@ public:
     BranchNode() {
         type = NodeType::BRANCH;
     };
-    std::shared_ptr<ExpressionNode> expression;
-    std::shared_ptr<BlockNode> trueBlock;
-    std::shared_ptr<BlockNode> falseBlock;
+    NodeRef<ExpressionNode> expression;
+    NodeRef<BlockNode> trueBlock;
+    NodeRef<BlockNode> falseBlock;
 };
 
+// while expression do body end, the condition is tested before every iteration
+class LoopNode: public StatementNode {
+public:
+    LoopNode() {
+        type = NodeType::LOOP;
+    };
+    NodeRef<ExpressionNode> expression;
+    NodeRef<BlockNode> body;
+};
+
+// array[index], reads one element
+class IndexNode: public Node {
+public:
+    IndexNode() {
+        type = NodeType::INDEX;
+    };
+    NodeRef<IdentifierNode> array;
+    NodeRef<ExpressionNode> index;
+    DataType dataType = DataType::INT; // Of the element, set by resolveNames
+};
+
+// Start offsets of the top level statements of a program. An edit that keeps the statement count moves every later
+// start by adding one entry to a Fenwick tree of shifts, O(log n) rather than rewriting each start after the edit.
+// Edits that add or remove statements rebuild it
+class StatementStarts {
+public:
+    void assign(std::vector<uint32_t> offsets);
+    size_t size() const { return starts.size(); }
+    bool empty() const { return starts.empty(); }
+    uint32_t operator[](size_t i) const;
+    // Index of the last statement starting at or before offset, the first statement always starts at 0
+    size_t find(size_t offset) const;
+    // Statements first to last are replaced by statements starting at offsets, every later one moves by delta bytes
+    void replace(size_t first, size_t last, const std::vector<uint32_t>& offsets, ptrdiff_t delta);
+
+private:
+    uint32_t shift(size_t i) const;
+    void addShift(size_t from, uint32_t delta);
+
+    std::vector<uint32_t> starts; // Offsets without the shifts of later edits
+    std::vector<uint32_t> shifts; // 1 based Fenwick tree, statement i moved by the wrapping sum of entries up to i + 1
+};
+
+// An edit of a source, removed bytes at offset of the previous version were replaced by inserted bytes
+struct SourceEdit {
+    size_t offset;
+    size_t removed;
+    size_t inserted;
+};
+
+// Owns the arena every other node of the program is allocated in
 class ProgramNode: public Node {
 public:
     ProgramNode() {
         type = NodeType::PROGRAM;
     };
-    std::shared_ptr<BlockNode> programBlock;
+    AstArena ast;
+    NodeRef<BlockNode> programBlock;
+
+    // Kept for reparseSource. Top level statement i spans the source from statementStarts[i] up to the start
+    // of the next one, trailing blank lines and comments included, the first one always starts at 0
+    std::shared_ptr<SourceFile> source;
+    StatementStarts statementStarts;
+
+    // Function bodies are skipped while parsing and parsed by parseFunctionBody when first needed.
+    // Every source version bodies were skipped in is kept since unparsed bodies still point into it
+    bool lazyBodies = false;
+    std::vector<std::shared_ptr<SourceFile>> bodySources;
+
+    // Identifiers declared anywhere in the program, restored when parsing more of it
+    DeclarationMap declarations;
+
+    // Mapping of the program image ast is a view of, null for programs parsed in this process
+    std::shared_ptr<SourceFile> image;
+
+    // Set once resolveNames filled in every variable slot, parsing more of the program clears it.
+    // Global slots are kept for function bodies parsed after resolving
+    bool resolved = false;
+    std::unordered_map<SymbolId, uint32_t> globalSlots;
+    std::unordered_map<SymbolId, DataType> globalTypes; // Declared type of every entry of globalSlots
+    // Declaration of every function the resolver saw by name, calls are type checked against them
+    std::unordered_map<SymbolId, NodeRef<FunctionDeclarationNode>> signatures;
+    // Every function declaration in the order the resolver reached them, see resolveFunctions
+    std::vector<NodeRef<FunctionDeclarationNode>> functions;
+    // Upper bounds of the functions and global slots the bodies not parsed yet add once they are, so backends that
+    // parse bodies on their first call can keep room for them
+    uint32_t skippedFunctions = 0;
+    uint32_t skippedGlobals = 0;
 };
 
-std::shared_ptr<ProgramNode> parseTokens(std::vector<Token> tokens);
-void debugAst(std::shared_ptr<ProgramNode> node);
\ No newline at end of file
+// Parses statements as they are pulled from tokens, streaming token streams only hold the current statement.
+// With lazyBodies function bodies are only scanned for their closing end, see parseFunctionBody
+std::shared_ptr<ProgramNode> parseTokens(TokenStream& tokens, bool lazyBodies = false);
+// Returns the body of function, parsing it first if it was skipped by a lazy parse. Not thread safe
+NodeRef<BlockNode> parseFunctionBody(ProgramNode& program, NodeRef<FunctionDeclarationNode> function);
+// Finds every function declaration reachable from block, parsing skipped bodies on the way
+void collectFunctions(ProgramNode& program, NodeRef<BlockNode> block, std::vector<NodeRef<FunctionDeclarationNode>>& functions);
+// Same result as parseTokens, but top level function declarations are parsed on threadCount threads once a scan
+// over the tokens found their extents. Like parseTokens every statement only sees the declarations made before it,
+// which are read off the tokens up front. Lexes the rest of tokens first
+std::shared_ptr<ProgramNode> parseTokensParallel(TokenStream& tokens, unsigned threadCount);
+// Brings program up to date with an edited version of its source. Only the top level statements, normally function
+// declarations, overlapping the edited bytes are tokenized and parsed again and spliced into program, everything
+// else falls back to a full parse. Returns program or the fully reparsed replacement.
+// Nodes of replaced statements stay in the arena and declarations they made stay registered until a full parse.
+// The previous source has to be unchanged, read rather than map files that get rewritten in place.
+// source is the whole edited version and edit says where it differs from the previous one. When the edit keeps the
+// number of top level statements the cost only depends on the edit and the statements it touches, not on the program
+std::shared_ptr<ProgramNode> reparseSource(std::shared_ptr<ProgramNode> program, std::shared_ptr<SourceFile> source, SourceEdit edit);
+// Same for callers that do not know what changed, the edit is found by comparing both versions byte by byte first
+std::shared_ptr<ProgramNode> reparseSource(std::shared_ptr<ProgramNode> program, std::shared_ptr<SourceFile> source);
+void debugAst(std::shared_ptr<ProgramNode> node);
+const char* get_type_name(DataType type);
\ No newline at end of file
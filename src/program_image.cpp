@@ -0,0 +1,218 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "program_image.h"
+#include "resolver.h"
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+constexpr uint64_t layout_hash() {
+    uint64_t hash = 0;
+    for(size_t size: {sizeof(Node), sizeof(ExpressionNode), sizeof(BinaryOperation), sizeof(IdentifierNode),
+                      sizeof(NumberNode), sizeof(LastStatementNode), sizeof(DeclarationNode), sizeof(AssignmentNode),
+                      sizeof(BlockNode), sizeof(FunctionCallNode), sizeof(FunctionDeclarationNode), sizeof(BranchNode),
+                      sizeof(LoopNode), sizeof(IndexNode), sizeof(SymbolId), sizeof(NodeRef<Node>)}) {
+        hash = hash * 31 + size;
+    }
+    return hash;
+}
+
+uint64_t hash_source(std::string_view text) {
+    // A word at a time, checking an image has to stay far cheaper than lexing the source
+    const uint64_t multiplier = 0x9e3779b97f4a7c15ull;
+    uint64_t hash = text.size() * multiplier;
+    size_t offset = 0;
+    for(; offset + sizeof(uint64_t) <= text.size(); offset += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, text.data() + offset, sizeof(word));
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, text.data() + offset, text.size() - offset);
+    hash = (hash ^ tail) * multiplier;
+    return hash ^ (hash >> 32);
+}
+
+// Calls visit on every node reachable from root before reading its children, visit may allocate
+template<typename Visit>
+void walkNodes(AstArena& ast, NodeRef<Node> root, Visit&& visit) {
+    std::vector<NodeRef<Node>> pending = {root};
+    auto push = [&](NodeRef<Node> ref) {
+        if(ref) pending.push_back(ref);
+    };
+    auto pushList = [&](auto list) {
+        for(auto item: ast[list]) push(item);
+    };
+
+    while(!pending.empty()) {
+        auto node = pending.back();
+        pending.pop_back();
+        visit(node);
+        switch (ast[node].type) {
+            case NodeType::EXPRESSION:
+            case NodeType::PREFIX_EXPRESSION:
+                push(ast[node.as<ExpressionNode>()].operation);
+                break;
+            case NodeType::BINARY_OPERATION:
+                push(ast[node.as<BinaryOperation>()].left);
+                push(ast[node.as<BinaryOperation>()].right);
+                break;
+            case NodeType::LAST_STATEMENT:
+                push(ast[node.as<LastStatementNode>()].returnExpr);
+                break;
+            case NodeType::DECLARATION:
+                push(ast[node.as<DeclarationNode>()].defaultValueExpression);
+                break;
+            case NodeType::ASSIGNMENT:
+                push(ast[node.as<AssignmentNode>()].index);
+                push(ast[node.as<AssignmentNode>()].expression);
+                break;
+            case NodeType::BLOCK:
+                pushList(ast[node.as<BlockNode>()].statements);
+                break;
+            case NodeType::FUNCTION_CALL:
+                pushList(ast[node.as<FunctionCallNode>()].argumentsList);
+                break;
+            case NodeType::FUNCTION_DECLARATION:
+                pushList(ast[node.as<FunctionDeclarationNode>()].paramDeclarations);
+                push(ast[node.as<FunctionDeclarationNode>()].functionBlock);
+                break;
+            case NodeType::BRANCH:
+                push(ast[node.as<BranchNode>()].expression);
+                push(ast[node.as<BranchNode>()].trueBlock);
+                push(ast[node.as<BranchNode>()].falseBlock);
+                break;
+            case NodeType::LOOP:
+                push(ast[node.as<LoopNode>()].expression);
+                push(ast[node.as<LoopNode>()].body);
+                break;
+            case NodeType::INDEX:
+                push(ast[node.as<IndexNode>()].array);
+                push(ast[node.as<IndexNode>()].index);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Replaces every identifier symbol reachable from root with remap(symbol)
+template<typename Remap>
+void remapSymbols(AstArena& ast, NodeRef<Node> root, Remap&& remap) {
+    walkNodes(ast, root, [&](NodeRef<Node> node) {
+        switch (ast[node].type) {
+            case NodeType::IDENTIFIER:
+                ast[node.as<IdentifierNode>()].identifier = remap(ast[node.as<IdentifierNode>()].identifier);
+                break;
+            case NodeType::DECLARATION:
+                ast[node.as<DeclarationNode>()].name = remap(ast[node.as<DeclarationNode>()].name);
+                break;
+            case NodeType::ASSIGNMENT:
+                ast[node.as<AssignmentNode>()].name = remap(ast[node.as<AssignmentNode>()].name);
+                break;
+            case NodeType::FUNCTION_CALL:
+                ast[node.as<FunctionCallNode>()].functionIdentifier = remap(ast[node.as<FunctionCallNode>()].functionIdentifier);
+                break;
+            case NodeType::FUNCTION_DECLARATION:
+                ast[node.as<FunctionDeclarationNode>()].functionName = remap(ast[node.as<FunctionDeclarationNode>()].functionName);
+                break;
+            default:
+                break;
+        }
+    });
+}
+
+bool writeProgramImage(ProgramNode& program, const char* fileName) {
+    walkNodes(program.ast, program.programBlock, [&](NodeRef<Node> node) {
+        if(program.ast[node].type == NodeType::FUNCTION_DECLARATION) {
+            parseFunctionBody(program, node.as<FunctionDeclarationNode>());
+        }
+    });
+    resolveNames(program);
+
+    // Symbols are rewritten in a copy, the program stays usable in this process
+    const SymbolId firstIdentifier = symbol_id(Symbol::FIRST_IDENTIFIER);
+    AstArena image = AstArena::copy(program.ast.bytes(), program.ast.size());
+    std::unordered_map<SymbolId, SymbolId> imageIds;
+    std::vector<uint32_t> nameEnds;
+    std::string names;
+    remapSymbols(image, program.programBlock, [&](SymbolId symbol) {
+        if(symbol < firstIdentifier) return symbol;
+        auto id = imageIds.emplace(symbol, firstIdentifier + (SymbolId)nameEnds.size());
+        if(id.second) {
+            names += symbol_name(symbol);
+            nameEnds.push_back((uint32_t)names.size());
+        }
+        return id.first->second;
+    });
+
+    ProgramImageHeader header = {};
+    header.magic = programImageMagic;
+    header.version = programImageVersion;
+    header.sourceHash = program.source ? hash_source(program.source->view()) : 0;
+    header.layoutHash = layout_hash();
+    header.astSize = (uint32_t)image.size();
+    header.programBlock = program.programBlock.offset;
+    header.symbolCount = (uint32_t)nameEnds.size();
+    header.symbolNamesSize = (uint32_t)names.size();
+
+    FILE* file = fopen(fileName, "wb");
+    if(!file) return false;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(image.bytes(), 1, image.size(), file) == image.size() &&
+                   fwrite(nameEnds.data(), sizeof(uint32_t), nameEnds.size(), file) == nameEnds.size() &&
+                   fwrite(names.data(), 1, names.size(), file) == names.size();
+    return fclose(file) == 0 && written;
+}
+
+std::shared_ptr<ProgramNode> loadProgramImage(const char* fileName, const SourceFile& source) {
+    // The header is checked before mapping, a stale image costs one small read
+    FILE* file = fopen(fileName, "rb");
+    if(!file) return nullptr;
+    ProgramImageHeader header;
+    bool headerRead = fread(&header, sizeof(header), 1, file) == 1;
+    fclose(file);
+    if(!headerRead || header.magic != programImageMagic || header.version != programImageVersion ||
+       header.layoutHash != layout_hash() || header.sourceHash != hash_source(source.view())) {
+        return nullptr;
+    }
+
+    auto image = SourceFile::map(fileName);
+    size_t namesOffset = sizeof(header) + header.astSize + header.symbolCount * sizeof(uint32_t);
+    if(!image || image->size() < namesOffset + header.symbolNamesSize || header.astSize % sizeof(uint64_t) != 0 ||
+       header.programBlock >= header.astSize) {
+        return nullptr;
+    }
+    const uint8_t* astBytes = (const uint8_t*)image->data() + sizeof(header);
+    const uint32_t* nameEnds = (const uint32_t*)(astBytes + header.astSize);
+    const char* names = image->data() + namesOffset;
+
+    const SymbolId firstIdentifier = symbol_id(Symbol::FIRST_IDENTIFIER);
+    std::vector<SymbolId> symbols(header.symbolCount);
+    bool sameIds = true;
+    uint32_t nameStart = 0;
+    reserve_symbols(header.symbolCount);
+    for(uint32_t i = 0; i < header.symbolCount; i++) {
+        if(nameEnds[i] < nameStart || nameEnds[i] > header.symbolNamesSize) return nullptr;
+        symbols[i] = intern_symbol({names + nameStart, nameEnds[i] - nameStart});
+        sameIds &= symbols[i] == firstIdentifier + i;
+        nameStart = nameEnds[i];
+    }
+
+    auto program = std::make_shared<ProgramNode>();
+    program->programBlock = NodeRef<BlockNode>(header.programBlock);
+    program->resolved = true; // Images are written resolved and with every function body parsed
+    if(sameIds) {
+        program->ast = AstArena::view(astBytes, header.astSize);
+        program->image = image;
+    } else {
+        program->ast = AstArena::copy(astBytes, header.astSize);
+        remapSymbols(program->ast, program->programBlock, [&](SymbolId symbol) {
+            return symbol < firstIdentifier ? symbol : symbols[symbol - firstIdentifier];
+        });
+    }
+    collectFunctions(*program, program->programBlock, program->functions);
+    return program;
+}
@@ -0,0 +1,44 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include "parser.h"
+
+// Compiled programs are cached as images of their syntax tree arena. Node references are arena offsets so the
+// bytes run as they are once mapped, loading only interns the identifier names the program uses.
+//
+// Layout, the arena starts 8 byte aligned:
+//   ProgramImageHeader
+//   astSize bytes of AstArena::bytes(), symbols in the nodes are image ids, see below
+//   uint32_t nameEnds[symbolCount], end offset of every name in the name bytes
+//   symbolNamesSize name bytes
+// Image ids are handed out from FIRST_IDENTIFIER in the order the names are listed. Interning the names in that order
+// in a process that has not interned anything else yields the same ids and the arena is used straight from the
+// mapping, otherwise it is copied once and its symbols rewritten.
+constexpr uint32_t programImageMagic = 0x49504c48; // "HLPI"
+constexpr uint32_t programImageVersion = 7; // Bump whenever node fields or NodeType values change
+
+struct ProgramImageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceHash; // hash_source of the source the program was compiled from
+    uint64_t layoutHash; // Node sizes of the build that wrote the image, node layout is compiler and platform specific
+    uint32_t astSize;
+    uint32_t programBlock;
+    uint32_t symbolCount;
+    uint32_t symbolNamesSize;
+};
+
+// Fast non cryptographic hash of a whole source file, only used to tell whether an image is stale
+uint64_t hash_source(std::string_view text);
+
+// Writes program to fileName, parsing any function bodies that were skipped and resolving names first. False when the file
+// could not be written
+bool writeProgramImage(ProgramNode& program, const char* fileName);
+// Maps the image in fileName. Returns null when there is no image or it was written for a different source,
+// image version or build, the caller compiles source instead
+std::shared_ptr<ProgramNode> loadProgramImage(const char* fileName, const SourceFile& source);
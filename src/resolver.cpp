@@ -0,0 +1,396 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "resolver.h"
+#include "diagnostics.h"
+#include <algorithm>
+#include <unordered_map>
+
+constexpr uint32_t noDeclaration = UINT32_MAX;
+
+struct VisibleVariable {
+    SymbolId name;
+    VariableSlot slot;
+    DataType type;
+    uint32_t frame; // 0 for the global frame
+    uint32_t hidden; // Index of the declaration of name this one hides, noDeclaration if none
+};
+
+// Resolving never allocates nodes so node references can be held across calls, node pointers still are not
+class Resolver {
+public:
+    Resolver(ProgramNode& program): program(program), ast(program.ast) {}
+
+    void resolveProgram() {
+        ast[program.programBlock].frameSize = 0;
+        program.globalSlots.clear();
+        program.globalTypes.clear();
+        program.signatures.clear();
+        program.functions.clear();
+        program.skippedFunctions = 0;
+        program.skippedGlobals = 0;
+        resolveStatements(program.programBlock);
+    }
+
+    void resolveFunction(NodeRef<FunctionDeclarationNode> function) {
+        for(auto& global: program.globalSlots) {
+            VariableSlot slot;
+            slot.index = global.second;
+            slot.global = true;
+            makeVisible(global.first, slot, program.globalTypes[global.first], 0);
+        }
+        resolveFunctionBody(function);
+        // Counted as skipped when its declaration was resolved
+        program.skippedFunctions -= ast[function].bodyFunctions;
+        program.skippedGlobals -= ast[function].bodyGlobals;
+    }
+
+private:
+    void declare(NodeRef<DeclarationNode> declaration) {
+        bool global = frame == 0 || ast[declaration].isGlobal;
+        VariableSlot slot;
+        slot.global = global;
+        if(global) {
+            slot.index = ast[program.programBlock].frameSize++;
+        } else {
+            slot.index = frameTop++;
+            frameSize = std::max(frameSize, frameTop);
+        }
+        ast[declaration].slot = slot;
+
+        SymbolId name = ast[declaration].name;
+        DataType type = ast[declaration].dataType;
+        if(frame != 0 && global) {
+            // Outlives the function, only seen where no other declaration of the name is
+            functionGlobals[name] = {slot, type};
+        } else {
+            makeVisible(name, slot, type, global ? 0 : frame);
+        }
+        if(global && (frame != 0 || blockStarts.empty())) {
+            program.globalSlots[name] = slot.index;
+            program.globalTypes[name] = type;
+        }
+    }
+
+    void makeVisible(SymbolId name, VariableSlot slot, DataType type, uint32_t declarationFrame) {
+        auto innermost = visible.emplace(name, noDeclaration).first;
+        declarations.push_back({name, slot, type, declarationFrame, innermost->second});
+        innermost->second = (uint32_t)declarations.size() - 1;
+    }
+
+    std::pair<VariableSlot, DataType> lookup(SymbolId name) {
+        auto it = visible.find(name);
+        if(it != visible.end() && it->second != noDeclaration) {
+            auto& variable = declarations[it->second];
+            // Locals of an enclosing function are not on the frame the function runs with
+            if(variable.slot.global || variable.frame == frame) return {variable.slot, variable.type};
+        }
+        auto global = functionGlobals.find(name);
+        if(global != functionGlobals.end()) return global->second;
+        auto text = symbol_name(name);
+        hlang_error("%.*s has not been declared", (int)text.size(), text.data());
+    }
+
+    // A value of type given can be stored where expected is declared. Arrays only go where the same array type is
+    static void expectAssignable(DataType expected, DataType given, SymbolId name) {
+        if(expected == given || (!is_array_type(expected) && !is_array_type(given))) return;
+        auto text = symbol_name(name);
+        hlang_error("Type mismatch for %.*s, expected %s but got %s", (int)text.size(), text.data(),
+                    get_type_name(expected), get_type_name(given));
+    }
+
+    static void expectScalar(DataType type, const char* what) {
+        if(is_array_type(type)) hlang_error("%s has to be an int or bool, not %s", what, get_type_name(type));
+    }
+
+    static void expectArray(DataType type, SymbolId name) {
+        if(is_array_type(type)) return;
+        auto text = symbol_name(name);
+        hlang_error("%.*s takes an array, not %s", (int)text.size(), text.data(), get_type_name(type));
+    }
+
+    static void expectArguments(SymbolId name, uint32_t expected, uint32_t given) {
+        if(expected == given) return;
+        auto text = symbol_name(name);
+        hlang_error("%.*s takes %u arguments, %u given", (int)text.size(), text.data(), expected, given);
+    }
+
+    // Operators on an array work on every element, scalar operands go with every element
+    static DataType binaryType(OperatorType op, DataType left, DataType right) {
+        bool comparison = op >= OperatorType::EQUALS && op <= OperatorType::NOT_EQUALS;
+        if(is_array_type(left) || is_array_type(right)) return comparison ? DataType::BOOL_ARRAY : DataType::INT_ARRAY;
+        return comparison ? DataType::BOOL : DataType::INT;
+    }
+
+    DataType resolveCall(NodeRef<FunctionCallNode> call) {
+        SymbolId name = ast[call].functionIdentifier;
+        auto arguments = ast[ast[call].argumentsList];
+        if(ast[call].builtin == Builtin::NONE) {
+            auto signature = program.signatures.find(name);
+            if(signature == program.signatures.end()) {
+                // Declared in a body that was not parsed yet, the call is checked when it runs
+                for(auto argument: arguments) resolveExpression(argument);
+                return DataType::INT;
+            }
+            auto function = signature->second;
+            auto parameters = ast[ast[function].paramDeclarations];
+            expectArguments(name, parameters.size(), arguments.size());
+            for(uint32_t i = 0; i < arguments.size(); i++) {
+                expectAssignable(ast[parameters[i]].dataType, resolveExpression(arguments[i]), ast[parameters[i]].name);
+            }
+            return ast[function].returnType;
+        }
+
+        DataType types[3];
+        expectArguments(name, builtin_arity(ast[call].builtin), arguments.size());
+        for(uint32_t i = 0; i < arguments.size(); i++) types[i] = resolveExpression(arguments[i]);
+        switch (ast[call].builtin) {
+            case Builtin::INT_ARRAY:
+                expectScalar(types[0], "An array length");
+                return DataType::INT_ARRAY;
+            case Builtin::BOOL_ARRAY:
+                expectScalar(types[0], "An array length");
+                return DataType::BOOL_ARRAY;
+            case Builtin::SELECT:
+                expectArray(types[0], name);
+                return types[1] == DataType::BOOL_ARRAY && types[2] == DataType::BOOL_ARRAY ? DataType::BOOL_ARRAY : DataType::INT_ARRAY;
+            default: // len, sum, min and max
+                expectArray(types[0], name);
+                return DataType::INT;
+        }
+    }
+
+    // Returns the type of the expression, VOID for no expression and calls of void functions
+    DataType resolveExpression(NodeRef<Node> node) {
+        if(!node) return DataType::VOID;
+        switch (ast[node].type) {
+            case NodeType::EXPRESSION:
+            case NodeType::PREFIX_EXPRESSION:
+                return resolveExpression(ast[node.as<ExpressionNode>()].operation);
+            case NodeType::BINARY_OPERATION: {
+                auto operation = node.as<BinaryOperation>();
+                DataType left = resolveExpression(ast[operation].left);
+                DataType right = resolveExpression(ast[operation].right);
+                ast[operation].dataType = binaryType(ast[operation].op, left, right);
+                return ast[operation].dataType;
+            }
+            case NodeType::IDENTIFIER: {
+                auto identifier = node.as<IdentifierNode>();
+                auto variable = lookup(ast[identifier].identifier);
+                ast[identifier].slot = variable.first;
+                ast[identifier].dataType = variable.second;
+                return variable.second;
+            }
+            case NodeType::INDEX: {
+                auto element = node.as<IndexNode>();
+                DataType array = resolveExpression(ast[element].array);
+                expectArray(array, ast[ast[element].array].identifier);
+                expectScalar(resolveExpression(ast[element].index), "An index");
+                ast[element].dataType = array == DataType::BOOL_ARRAY ? DataType::BOOL : DataType::INT;
+                return ast[element].dataType;
+            }
+            case NodeType::FUNCTION_CALL: {
+                auto call = node.as<FunctionCallNode>();
+                DataType type = resolveCall(call);
+                ast[call].dataType = type;
+                return type;
+            }
+            default:
+                return DataType::INT;
+        }
+    }
+
+    void resolveStatements(NodeRef<BlockNode> block) {
+        // Functions can be called before their declaration, calls are typed against every function of the block
+        for(auto statement: ast[ast[block].statements]) {
+            if(ast[statement].type != NodeType::FUNCTION_DECLARATION) continue;
+            auto function = statement.as<FunctionDeclarationNode>();
+            program.signatures[ast[function].functionName] = function;
+        }
+        for(auto statement: ast[ast[block].statements]) {
+            switch (ast[statement].type) {
+                case NodeType::DECLARATION: {
+                    auto declaration = statement.as<DeclarationNode>();
+                    // The initial value is resolved first, it can not see the variable it initializes
+                    DataType type = resolveExpression(ast[declaration].defaultValueExpression);
+                    if(ast[declaration].defaultValueExpression) expectAssignable(ast[declaration].dataType, type, ast[declaration].name);
+                    declare(declaration);
+                    break;
+                }
+                case NodeType::ASSIGNMENT: {
+                    auto assignment = statement.as<AssignmentNode>();
+                    DataType type = resolveExpression(ast[assignment].expression);
+                    auto variable = lookup(ast[assignment].name);
+                    ast[assignment].slot = variable.first;
+                    if(ast[assignment].index) {
+                        expectArray(variable.second, ast[assignment].name);
+                        expectScalar(resolveExpression(ast[assignment].index), "An index");
+                        expectScalar(type, "An element");
+                    } else {
+                        expectAssignable(variable.second, type, ast[assignment].name);
+                    }
+                    break;
+                }
+                case NodeType::BRANCH: {
+                    auto branch = statement.as<BranchNode>();
+                    expectScalar(resolveExpression(ast[branch].expression), "A condition");
+                    resolveBlock(ast[branch].trueBlock);
+                    if(ast[branch].falseBlock) resolveBlock(ast[branch].falseBlock);
+                    break;
+                }
+                case NodeType::LOOP: {
+                    // Every iteration runs the body in the same slots, declarations in it start over each time
+                    auto loop = statement.as<LoopNode>();
+                    expectScalar(resolveExpression(ast[loop].expression), "A condition");
+                    loopDepth++;
+                    resolveBlock(ast[loop].body);
+                    loopDepth--;
+                    break;
+                }
+                case NodeType::FUNCTION_DECLARATION:
+                    program.functions.push_back(statement.as<FunctionDeclarationNode>());
+                    resolveFunctionBody(statement.as<FunctionDeclarationNode>());
+                    break;
+                case NodeType::FUNCTION_CALL:
+                    resolveExpression(statement);
+                    break;
+                case NodeType::LAST_STATEMENT: {
+                    auto returnExpr = ast[statement.as<LastStatementNode>()].returnExpr;
+                    if(ast[statement.as<LastStatementNode>()].isBreak && loopDepth == 0) hlang_error("break outside of a loop");
+                    DataType type = resolveExpression(returnExpr);
+                    // The value of a top level return goes nowhere
+                    if(returnExpr && frame != 0) expectAssignable(returnType, type, returnName);
+                    break;
+                }
+                default:
+                    break;
+            }
+        }
+    }
+
+    // Locals of a function block are released when it closes so sibling blocks reuse their slots. Global slots never
+    // are, a function can run and set one while any block is open
+    void resolveBlock(NodeRef<BlockNode> block) {
+        uint32_t outerTop = frameTop;
+        blockStarts.push_back((uint32_t)declarations.size());
+        resolveStatements(block);
+        ast[block].blockTop = frame == 0 ? 0 : frameTop;
+        closeBlock();
+        frameTop = outerTop;
+    }
+
+    // Parameters take the first slots of the frame and share the scope of the body
+    void resolveFunctionBody(NodeRef<FunctionDeclarationNode> function) {
+        if(!ast[function].functionBlock) {
+            // Skipped by a lazy parse, resolved by parseFunctionBody
+            program.skippedFunctions += ast[function].bodyFunctions;
+            program.skippedGlobals += ast[function].bodyGlobals;
+            return;
+        }
+        uint32_t outerFrame = frame;
+        uint32_t outerFrameSize = frameSize;
+        uint32_t outerFrameTop = frameTop;
+        uint32_t outerLoopDepth = loopDepth;
+        DataType outerReturnType = returnType;
+        SymbolId outerReturnName = returnName;
+        frame = ++frameCount;
+        frameSize = 0;
+        frameTop = 0;
+        loopDepth = 0;
+        returnType = ast[function].returnType;
+        returnName = ast[function].functionName;
+        blockStarts.push_back((uint32_t)declarations.size());
+        for(auto parameter: ast[ast[function].paramDeclarations]) {
+            declare(parameter);
+        }
+        resolveStatements(ast[function].functionBlock);
+        ast[ast[function].functionBlock].frameSize = frameSize;
+        ast[ast[function].functionBlock].blockTop = frameTop;
+        closeBlock();
+        frame = outerFrame;
+        frameSize = outerFrameSize;
+        frameTop = outerFrameTop;
+        loopDepth = outerLoopDepth;
+        returnType = outerReturnType;
+        returnName = outerReturnName;
+    }
+
+    void closeBlock() {
+        for(uint32_t i = (uint32_t)declarations.size(); i-- > blockStarts.back();) {
+            visible[declarations[i].name] = declarations[i].hidden;
+        }
+        declarations.resize(blockStarts.back());
+        blockStarts.pop_back();
+    }
+
+    ProgramNode& program;
+    AstArena& ast;
+    // Declarations in scope in the order they were made, each open block hides the ones after its start when it closes
+    std::vector<VisibleVariable> declarations;
+    std::vector<uint32_t> blockStarts;
+    std::unordered_map<SymbolId, uint32_t> visible; // Innermost declaration of every name
+    std::unordered_map<SymbolId, std::pair<VariableSlot, DataType>> functionGlobals; // Globals declared inside of functions
+    uint32_t frame = 0;
+    uint32_t frameCount = 0;
+    uint32_t frameSize = 0; // Most slots the current function frame needs at once
+    uint32_t frameTop = 0; // Slots of the current function frame held by the open blocks
+    uint32_t loopDepth = 0; // Loops around the statement being resolved, in the current function
+    DataType returnType = DataType::VOID; // Of the function being resolved
+    SymbolId returnName = 0;
+};
+
+void resolveNames(ProgramNode& program) {
+    if(program.resolved) return;
+    Resolver(program).resolveProgram();
+    program.resolved = true;
+}
+
+const std::vector<NodeRef<FunctionDeclarationNode>>& resolveFunctions(ProgramNode& program) {
+    resolveNames(program);
+    // Parsing a skipped body resolves it, which adds the functions declared inside of it
+    for(size_t i = 0; i < program.functions.size(); i++) {
+        parseFunctionBody(program, program.functions[i]);
+    }
+    return program.functions;
+}
+
+void resolveFunction(ProgramNode& program, NodeRef<FunctionDeclarationNode> function) {
+    Resolver(program).resolveFunction(function);
+}
+
+DataType expression_type(const AstArena& ast, NodeRef<Node> node) {
+    switch (ast[node].type) {
+        case NodeType::EXPRESSION:
+        case NodeType::PREFIX_EXPRESSION:
+            return expression_type(ast, ast[node.as<ExpressionNode>()].operation);
+        case NodeType::BINARY_OPERATION:
+            return ast[node.as<BinaryOperation>()].dataType;
+        case NodeType::IDENTIFIER:
+            return ast[node.as<IdentifierNode>()].dataType;
+        case NodeType::INDEX:
+            return ast[node.as<IndexNode>()].dataType;
+        case NodeType::FUNCTION_CALL:
+            return ast[node.as<FunctionCallNode>()].dataType;
+        default:
+            return DataType::INT;
+    }
+}
+
+bool findGlobalSlot(const ProgramNode& program, SymbolId name, uint32_t& slot) {
+    auto it = program.globalSlots.find(name);
+    if(it != program.globalSlots.end()) {
+        slot = it->second;
+        return true;
+    }
+    // Programs loaded from an image only have the slots in their nodes
+    const AstArena& ast = program.ast;
+    auto statements = ast[ast[program.programBlock].statements];
+    for(uint32_t i = statements.size(); i-- > 0;) {
+        if(ast[statements[i]].type != NodeType::DECLARATION) continue;
+        auto& declaration = ast[statements[i].as<DeclarationNode>()];
+        if(declaration.name != name) continue;
+        slot = declaration.slot.index;
+        return true;
+    }
+    return false;
+}
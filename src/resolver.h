@@ -0,0 +1,29 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include "parser.h"
+
+// Gives every variable declaration, read and assignment of program its VariableSlot and sizes the frames, so the
+// interpreter never looks variables up by name. Scopes are lexical, a name is visible from its declaration to the end
+// of the block declaring it, global declarations stay visible to the end of the program. Function frames are laid out
+// like a stack, a block's locals sit above the ones of the blocks around it and are reused once it closes.
+// Function bodies that have not been parsed yet are resolved by parseFunctionBody once the program is resolved.
+// Uses of undeclared names are errors. Every expression gets its type, arrays only go where arrays are declared and
+// conditions, indices and elements have to be scalars. Int and bool mix freely. Does nothing when the program is already
+// resolved
+void resolveNames(ProgramNode& program);
+// Resolves program and parses every skipped function body, returns every function declaration of program
+const std::vector<NodeRef<FunctionDeclarationNode>>& resolveFunctions(ProgramNode& program);
+// Resolves a single function of an already resolved program against its globals
+void resolveFunction(ProgramNode& program, NodeRef<FunctionDeclarationNode> function);
+// Global frame slot of the top level variable name in a resolved program, the last declaration wins
+bool findGlobalSlot(const ProgramNode& program, SymbolId name, uint32_t& slot);
+
+inline bool is_array_type(DataType type) {
+    return type == DataType::INT_ARRAY || type == DataType::BOOL_ARRAY;
+}
+
+// Type of a resolved expression or operand, read from what resolveNames stored in its nodes
+DataType expression_type(const AstArena& ast, NodeRef<Node> node);
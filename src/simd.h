@@ -0,0 +1,37 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+// What the bulk scanning and array kernels build on. x86-64 always has SSE2, AVX2 code is compiled with
+// HLANG_TARGET_AVX2 and only called once cpu_has_avx2() said so. Other targets only get the scalar code
+#if defined(__x86_64__) || defined(_M_X64)
+#define HLANG_SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HLANG_TARGET_AVX2
+#else
+#define HLANG_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define HLANG_SIMD_X86 0
+#endif
+
+#if HLANG_SIMD_X86
+inline bool cpu_has_avx2() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if(info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+    if(!osSavesYmm) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
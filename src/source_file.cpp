@@ -0,0 +1,109 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "source_file.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SourceFile::~SourceFile() {
+    if(!mapping) return;
+#ifdef _WIN32
+    UnmapViewOfFile(begin);
+    CloseHandle((HANDLE)mapping);
+#else
+    munmap((void*)begin, length);
+#endif
+}
+
+std::shared_ptr<SourceFile> SourceFile::map(const char* fileName) {
+    std::shared_ptr<SourceFile> source(new SourceFile());
+#ifdef _WIN32
+    HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "Could not open file %s\n", fileName);
+        return nullptr;
+    }
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return read(fileName);
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file); // The mapping keeps its own reference to the file
+    if(!mapping) return read(fileName);
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if(!view) {
+        CloseHandle(mapping);
+        return read(fileName);
+    }
+    source->mapping = mapping;
+    source->begin = (const char*)view;
+    source->length = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(fileName, O_RDONLY);
+    if(fd < 0) {
+        fprintf(stderr, "Could not open file %s\n", fileName);
+        return nullptr;
+    }
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+        close(fd);
+        return read(fileName);
+    }
+    void* view = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps its own reference to the file
+    if(view == MAP_FAILED) return read(fileName);
+    source->mapping = view;
+    source->begin = (const char*)view;
+    source->length = (size_t)fileStat.st_size;
+#endif
+    return source;
+}
+
+std::shared_ptr<SourceFile> SourceFile::read(const char* fileName) {
+    std::ifstream file(fileName, std::ios::in | std::ios::binary);
+    if(!file.is_open()) {
+        fprintf(stderr, "Could not open file %s\n", fileName);
+        return nullptr;
+    }
+    std::shared_ptr<SourceFile> source(new SourceFile());
+    file.seekg(0, std::ios::end);
+    source->buffer.resize((size_t)file.tellg());
+    file.seekg(0, std::ios::beg);
+    file.read(source->buffer.data(), source->buffer.size());
+    source->begin = source->buffer.data();
+    source->length = source->buffer.size();
+    return source;
+}
+
+std::shared_ptr<SourceFile> SourceFile::copy(std::string_view text) {
+    std::shared_ptr<SourceFile> source(new SourceFile());
+    source->buffer.assign(text.begin(), text.end());
+    source->begin = source->buffer.data();
+    source->length = source->buffer.size();
+    return source;
+}
+
+SourceLocation SourceFile::location(size_t offset) const {
+    std::call_once(lineStartsBuilt, [this]() {
+        lineStarts.push_back(0);
+        const char* it = begin;
+        const char* end = begin + length;
+        while((it = (const char*)memchr(it, '\n', end - it))) {
+            lineStarts.push_back(++it - begin);
+        }
+    });
+    auto line = std::upper_bound(lineStarts.begin(), lineStarts.end(), offset) - 1;
+    return {(size_t)(line - lineStarts.begin()) + 1, offset - *line + 1};
+}
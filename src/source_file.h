@@ -0,0 +1,51 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// 1 based
+struct SourceLocation {
+    size_t line;
+    size_t column;
+};
+
+// Read only view of a whole source file. Tokens point straight into this memory so a SourceFile
+// has to outlive every token produced from it.
+class SourceFile {
+public:
+    ~SourceFile();
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+
+    // Maps the file into memory, falls back to reading it when the file can not be mapped (empty files)
+    static std::shared_ptr<SourceFile> map(const char* fileName);
+    // Reads the whole file into an owned buffer
+    static std::shared_ptr<SourceFile> read(const char* fileName);
+    // Source that did not come from a file, text is copied
+    static std::shared_ptr<SourceFile> copy(std::string_view text);
+
+    const char* data() const { return begin; }
+    size_t size() const { return length; }
+    std::string_view view() const { return {begin, length}; }
+    bool isMapped() const { return mapping != nullptr; }
+
+    // The newline index behind this is only built the first time a location is asked for, normally for an error
+    SourceLocation location(size_t offset) const;
+
+private:
+    SourceFile() = default;
+
+    const char* begin = nullptr;
+    size_t length = 0;
+    void* mapping = nullptr; // Platform mapping handle, null when the file is buffered
+    std::vector<char> buffer;
+
+    mutable std::once_flag lineStartsBuilt;
+    mutable std::vector<size_t> lineStarts;
+};
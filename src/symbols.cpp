@@ -0,0 +1,134 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "symbols.h"
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+
+constexpr std::string_view reservedNames[] = {
+        "",
+        "if", "then", "else", "true", "false", "end", "return", "do", "break", "global", "while",
+        "int", "bool", "string", "void",
+        "=", "+", "-", "/", "*", "<", ">", "!", "(", ")", "==", "<=", ">=", "!=", "[", "]", ","
+};
+static_assert(sizeof(reservedNames) / sizeof(reservedNames[0]) == symbol_id(Symbol::FIRST_IDENTIFIER),
+        "reservedNames must list every reserved Symbol in order");
+
+constexpr size_t reservedTableSize = 64;
+
+// Constants found by search so that every reserved name lands in its own slot, checked below
+constexpr size_t reserved_hash(std::string_view str) {
+    return ((unsigned char)str[0] + (unsigned char)str[str.size()-1] * 32 + str.size() * 54) & (reservedTableSize - 1);
+}
+
+struct ReservedTable {
+    uint8_t slots[reservedTableSize];
+};
+
+constexpr ReservedTable build_reserved_table() {
+    ReservedTable table{};
+    for(SymbolId id = symbol_id(Symbol::IF); id < symbol_id(Symbol::FIRST_IDENTIFIER); id++) {
+        table.slots[reserved_hash(reservedNames[id])] = (uint8_t)id;
+    }
+    return table;
+}
+
+constexpr ReservedTable reservedTable = build_reserved_table();
+
+constexpr bool reserved_hash_is_perfect() {
+    for(SymbolId id = symbol_id(Symbol::IF); id < symbol_id(Symbol::FIRST_IDENTIFIER); id++) {
+        if(reservedTable.slots[reserved_hash(reservedNames[id])] != id) return false;
+    }
+    return true;
+}
+static_assert(reserved_hash_is_perfect(), "Two reserved names share a hash slot, pick new reserved_hash constants");
+
+Symbol lookup_reserved_symbol(std::string_view str) {
+    if(str.empty()) return Symbol::NONE;
+    SymbolId id = reservedTable.slots[reserved_hash(str)];
+    if(id != 0 && reservedNames[id] == str) return (Symbol)id;
+    return Symbol::NONE;
+}
+
+// Names are copied since tokens only borrow their text from the source file, deque keeps the copies in place so views
+// of them stay valid after the lock is released. Shared by every thread and context of the process, see hlang.h
+std::deque<std::string> internedNames;
+std::unordered_map<std::string_view, SymbolId> internedIds;
+std::shared_mutex internedMutex;
+
+// internedMutex has to be held exclusively
+SymbolId intern_locked(std::string_view str) {
+    auto it = internedIds.find(str);
+    if(it != internedIds.end()) return it->second;
+
+    SymbolId id = symbol_id(Symbol::FIRST_IDENTIFIER) + internedNames.size();
+    internedNames.emplace_back(str);
+    internedIds.emplace(internedNames.back(), id);
+    return id;
+}
+
+SymbolId intern_symbol(std::string_view str) {
+    Symbol reserved = lookup_reserved_symbol(str);
+    if(reserved != Symbol::NONE) return symbol_id(reserved);
+
+    // Most lookups find a name interned before, only new names wait for the exclusive lock
+    {
+        std::shared_lock<std::shared_mutex> lock(internedMutex);
+        auto it = internedIds.find(str);
+        if(it != internedIds.end()) return it->second;
+    }
+    std::unique_lock<std::shared_mutex> lock(internedMutex);
+    return intern_locked(str);
+}
+
+bool find_symbol(std::string_view str, SymbolId& id) {
+    Symbol reserved = lookup_reserved_symbol(str);
+    if(reserved != Symbol::NONE) {
+        id = symbol_id(reserved);
+        return true;
+    }
+    std::shared_lock<std::shared_mutex> lock(internedMutex);
+    auto it = internedIds.find(str);
+    if(it == internedIds.end()) return false;
+    id = it->second;
+    return true;
+}
+
+std::string_view symbol_name(SymbolId id) {
+    if(id < symbol_id(Symbol::FIRST_IDENTIFIER)) return reservedNames[id];
+    std::shared_lock<std::shared_mutex> lock(internedMutex);
+    return internedNames[id - symbol_id(Symbol::FIRST_IDENTIFIER)];
+}
+
+SymbolId symbol_count() {
+    std::shared_lock<std::shared_mutex> lock(internedMutex);
+    return symbol_id(Symbol::FIRST_IDENTIFIER) + internedNames.size();
+}
+
+void reserve_symbols(size_t count) {
+    std::unique_lock<std::shared_mutex> lock(internedMutex);
+    internedIds.reserve(internedIds.size() + count);
+}
+
+SymbolId LocalSymbolTable::intern(std::string_view str) {
+    auto it = ids.find(str);
+    if(it != ids.end()) return it->second;
+
+    SymbolId id = symbol_id(Symbol::FIRST_IDENTIFIER) + names.size();
+    names.push_back(str);
+    ids.emplace(str, id);
+    return id;
+}
+
+std::vector<SymbolId> LocalSymbolTable::publish() const {
+    std::vector<SymbolId> globalIds;
+    globalIds.reserve(names.size());
+    std::unique_lock<std::shared_mutex> lock(internedMutex);
+    for(auto name: names) {
+        Symbol reserved = lookup_reserved_symbol(name);
+        globalIds.push_back(reserved != Symbol::NONE ? symbol_id(reserved) : intern_locked(name));
+    }
+    return globalIds;
+}
@@ -0,0 +1,96 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+typedef uint32_t SymbolId;
+
+// Reserved words and operators have fixed ids, every other identifier is interned after FIRST_IDENTIFIER
+enum class Symbol : SymbolId {
+    NONE,
+    // Keywords
+    IF,
+    THEN,
+    ELSE,
+    TRUE,
+    FALSE,
+    END,
+    RETURN,
+    DO,
+    BREAK,
+    GLOBAL,
+    WHILE,
+    // Types
+    INT,
+    BOOL,
+    STRING,
+    VOID,
+    // Operators
+    ASSIGN, // =
+    ADD, // +
+    SUB, // -
+    DIV, // /
+    MUL, // *
+    LESS_THAN, // <
+    LARGER_THAN, // >
+    NOT, // !
+    OPEN_PAREN, // (
+    CLOSE_PAREN, // )
+    EQUALS, // ==
+    LESS_EQUALS, // <=
+    LARGER_EQUALS, // >=
+    NOT_EQUALS, // !=
+    OPEN_BRACKET, // [
+    CLOSE_BRACKET, // ]
+    COMMA, // ,
+    FIRST_IDENTIFIER
+};
+
+constexpr SymbolId symbol_id(Symbol symbol) {
+    return (SymbolId)symbol;
+}
+
+constexpr bool is_keyword_symbol(SymbolId id) {
+    return id >= symbol_id(Symbol::IF) && id <= symbol_id(Symbol::WHILE);
+}
+
+constexpr bool is_type_symbol(SymbolId id) {
+    return id >= symbol_id(Symbol::INT) && id <= symbol_id(Symbol::VOID);
+}
+
+constexpr bool is_operator_symbol(SymbolId id) {
+    return id >= symbol_id(Symbol::ASSIGN) && id <= symbol_id(Symbol::CLOSE_BRACKET);
+}
+
+// Perfect hash lookup of the reserved words and operators, returns Symbol::NONE for anything else
+Symbol lookup_reserved_symbol(std::string_view str);
+
+// The interning table is shared by every thread of the process and guarded by a lock, names stay interned until the
+// process exits. Returns the id of str, interning it the first time it is seen. Ids are dense and never reused
+SymbolId intern_symbol(std::string_view str);
+// Looks str up without interning it, false when no thread has interned it yet
+bool find_symbol(std::string_view str, SymbolId& id);
+std::string_view symbol_name(SymbolId id);
+// Number of ids handed out so far including the reserved ones, ids are always below this
+SymbolId symbol_count();
+// Makes room for count more identifiers when many are about to be interned at once
+void reserve_symbols(size_t count);
+
+// Private interning table for tokenizer threads so they do not contend on the global table. Local ids start at
+// FIRST_IDENTIFIER like global ones, publish() interns every local name globally and returns the id mapping.
+// The names are not copied so the text they point to has to outlive the table.
+class LocalSymbolTable {
+public:
+    SymbolId intern(std::string_view str);
+    // Indexed by local id - FIRST_IDENTIFIER
+    std::vector<SymbolId> publish() const;
+
+private:
+    std::unordered_map<std::string_view, SymbolId> ids;
+    std::vector<std::string_view> names;
+};
@@ -1,16 +1,11 @@
 #include "tokenizer.h"
+#include "char_class.h"
+#include "diagnostics.h"
+#include <algorithm>
+#include <cctype>
 #include <cstdio>
-#include <istream>
-#include <fstream>
-#include <unordered_set>
-
-std::unordered_set<std::string> keywords = {
-        "if", "then", "else", "true", "false", "end", "return", "do", "break", "global"
-};
-
-std::unordered_set<std::string> types = {
-        "int", "bool", "string"
-};
+#include <cstring>
+#include <thread>
 
 bool is_separator(char c) {
     switch (c) {
@@ -24,6 +19,8 @@ bool is_separator(char c) {
         case '!':
         case '(':
         case ')':
+        case '[':
+        case ']':
         case ',':
         case ';':
         case ' ':
@@ -48,6 +45,8 @@ bool is_operator(char c) {
         case '!':
         case '(':
         case ')':
+        case '[':
+        case ']':
             return true;
         default:
             return false;
@@ -73,99 +72,85 @@ bool is_newline(char c) {
     }
 }
 
-bool is_number(std::string str) {
+bool is_number(std::string_view str) {
     auto it = str.begin();
     while(it != str.end() && std::isdigit(*it)) ++it;
     return !str.empty() && it == str.end();
 }
 
-bool is_type(std::string token) {
-    return types.find(token) != types.end();
-}
-
-bool is_keyword(std::string token) {
-    return keywords.find(token) != keywords.end();
-}
-
-EToken identify_token(std::string token) {
+Token identify_token(std::string_view token, const SourceFile& source, LocalSymbolTable* localSymbols) {
     if(is_number(token)) {
-        return EToken::NUMBER;
-    } else if(is_type(token)) {
-        return EToken::TYPE;
-    } else if(is_keyword(token)) {
-        return EToken::KEYWORD;
+        return {EToken::NUMBER, token, symbol_id(Symbol::NONE), &source};
+    }
+    SymbolId symbol = symbol_id(lookup_reserved_symbol(token));
+    if(is_type_symbol(symbol)) {
+        return {EToken::TYPE, token, symbol, &source};
+    } else if(is_keyword_symbol(symbol)) {
+        return {EToken::KEYWORD, token, symbol, &source};
     }
-    return EToken::IDENTIFIER;
+    return {EToken::IDENTIFIER, token, localSymbols ? localSymbols->intern(token) : intern_symbol(token), &source};
 }
 
-std::string extract_string_token(char* token, size_t len, size_t offset) {
-    std::string str;
-    for(int y = offset; y < len; y++) {
-        if(is_separator(token[y])) break;
-        str += token[y];
-    }
-    return str;
+std::string_view extract_string_token(const char* token, size_t len, size_t offset) {
+    return {&token[offset], find_separator(token, len, offset) - offset};
 }
 
-std::string extract_operator_token(char* token, size_t len, size_t offset) {
-    std::string str;
+std::string_view extract_operator_token(const char* token, size_t len, size_t offset) {
     char op = token[offset];
-    str += op;
     switch (op) {
         case '=':
         case '<':
         case '>':
         case '!':
-            if(token[offset+1] == '=') {
-                str += token[offset+1];
+            if(offset + 1 < len && token[offset+1] == '=') {
+                return {&token[offset], 2};
             }
             break;
         default:
             break;
     }
 
-    return str;
+    return {&token[offset], 1};
 }
 
-size_t skip_comment(char* token, size_t len, size_t offset) {
-    size_t commentLen = 0;
-    for(int y = offset; y < len; y++) {
-        commentLen++;
-        if(token[y] == '\n') return commentLen;
-    }
-    fprintf(stderr, "Error parsing comment no newline found\n");
-    exit(-1);
+size_t skip_comment(const char* token, size_t len, size_t offset) {
+    auto newline = (const char*)memchr(&token[offset], '\n', len - offset);
+    if(newline) return (newline - &token[offset]) + 1;
+    hlang_error("Error parsing comment no newline found");
 }
 
-void tokenize_separators(char* token, size_t len, std::vector<Token>& tokens) {
-    int i = 0;
+// Lexes the next token skipping whitespace and comments. Returns false at the end of the source or at a \0 character.
+// Identifiers are interned into localSymbols when given instead of the global symbol table
+bool lex_token(const SourceFile& source, size_t len, size_t& offset, Token& out, LocalSymbolTable* localSymbols = nullptr) {
+    const char* token = source.data();
+    size_t i = offset;
     while(i < len) {
         auto c = token[i];
-        if(c == '\0') return;
+        if(c == '\0') break;
         if(is_separator(c)) {
             if(is_operator(c)) {
-                if (c == '/' && token[i + 1] == '/') {
+                if (c == '/' && i + 1 < len && token[i + 1] == '/') {
                     i += skip_comment(token, len, i);
                     continue;
                 }
                 auto operatorStr = extract_operator_token(token, len, i);
-                i += operatorStr.length();
-                tokens.push_back({EToken::OPERATOR, operatorStr});
+                out = {EToken::OPERATOR, operatorStr, symbol_id(lookup_reserved_symbol(operatorStr)), &source};
             } else if(is_list_separator(c)){
-                tokens.push_back({EToken::LIST_SEPARATOR, std::string({c})});
-                i++;
+                out = {EToken::LIST_SEPARATOR, std::string_view(&token[i], 1), symbol_id(Symbol::COMMA), &source};
+            } else if(is_newline(c)) {
+                out = {EToken::NEWLINE, std::string_view(&token[i], 1), symbol_id(Symbol::NONE), &source};
             } else {
-                if(is_newline(c)) {
-                    tokens.push_back({EToken::NEWLINE});
-                }
-                i++;
+                i = skip_blanks(token, len, i + 1);
+                continue;
             }
         } else {
-            auto tokenStr = extract_string_token(token, len, i);
-            i += tokenStr.length();
-            tokens.push_back({identify_token(tokenStr), tokenStr});
+            out = identify_token(extract_string_token(token, len, i), source, localSymbols);
         }
+        offset = i + out.value.length();
+        return true;
     }
+    offset = i;
+    return false;
 }
 
 //void tokenize_separators(char* token, size_t len, std::vector<Token>& tokens) {
@@ -240,27 +225,204 @@ void tokenize_separators(char* token, size_t len, std::vector<Token>& tokens) {
 //    }
 //}
 
-std::vector<Token> tokenize(const char* fileName) {
-    std::vector<Token> tokens;
-    std::fstream file;
-    file.open(fileName, std::ios::in);
-    if(!file.is_open()) {
-        fprintf(stderr, "Could not open file %s\n", fileName);
-        return tokens;
+SourceLocation Token::location() const {
+    if(!source) return {0, 0};
+    return source->location(value.data() - source->data());
+}
+
+void TokenBuffer::push(EToken kind, size_t start, size_t length, SymbolId symbol) {
+    if(length > UINT16_MAX) {
+        hlang_error("Token at offset %zu is longer than %u characters", start, UINT16_MAX);
+    }
+    kinds.push_back((uint8_t)kind);
+    starts.push_back((uint32_t)start);
+    lengths.push_back((uint16_t)length);
+    symbols.push_back(symbol);
+}
+
+void TokenBuffer::append(const TokenBuffer& other) {
+    kinds.insert(kinds.end(), other.kinds.begin(), other.kinds.end());
+    starts.insert(starts.end(), other.starts.begin(), other.starts.end());
+    lengths.insert(lengths.end(), other.lengths.begin(), other.lengths.end());
+    symbols.insert(symbols.end(), other.symbols.begin(), other.symbols.end());
+}
+
+void TokenBuffer::eraseFront(size_t count) {
+    kinds.erase(kinds.begin(), kinds.begin() + count);
+    starts.erase(starts.begin(), starts.begin() + count);
+    lengths.erase(lengths.begin(), lengths.begin() + count);
+    symbols.erase(symbols.begin(), symbols.begin() + count);
+}
+
+TokenStream::TokenStream(std::shared_ptr<SourceFile> source, bool streaming): source(std::move(source)), streaming(streaming) {
+    if(!this->source) {
+        finished = true;
+        return;
+    }
+    if(this->source->size() > UINT32_MAX) {
+        hlang_error("Source files larger than 4GB are not supported");
+    }
+    sourceEnd = this->source->size();
+}
+
+TokenStream::TokenStream(std::shared_ptr<SourceFile> source, bool streaming, size_t begin, size_t end): TokenStream(std::move(source), streaming) {
+    if(finished) return;
+    sourceOffset = std::min(begin, sourceEnd);
+    sourceEnd = std::max(sourceOffset, std::min(end, sourceEnd));
+}
+
+bool TokenStream::lexUntil(size_t index) {
+    while(firstToken + tokens.size() <= index) {
+        if(finished) return false;
+        Token next;
+        if(lex_token(*source, sourceEnd, sourceOffset, next)) {
+            tokens.push(next.token, next.offset(), next.value.length(), next.symbol);
+        } else {
+            finish();
+        }
+    }
+    return true;
+}
+
+void TokenStream::finish() {
+    finished = true;
+    // Statements are newline terminated so make sure the last one is as well
+    if(tokens.size() == 0 || tokens.kinds.back() != (uint8_t)EToken::NEWLINE) {
+        tokens.push(EToken::NEWLINE, sourceOffset, 0, symbol_id(Symbol::NONE));
+    }
+}
+
+Token TokenStream::operator[](size_t index) {
+    if(index < firstToken) {
+        hlang_error("Token %zu has already been released", index);
     }
-    const int strBuffLen = 512;
-    char str[strBuffLen];
+    size_t local = lexUntil(index) ? index - firstToken : tokens.size() - 1;
+    return {
+        (EToken)tokens.kinds[local],
+        std::string_view(source->data() + tokens.starts[local], tokens.lengths[local]),
+        tokens.symbols[local],
+        source.get()
+    };
+}
+
+bool TokenStream::isEnd(size_t index) {
+    return !lexUntil(index);
+}
+
+void TokenStream::release(size_t index) {
+    // Compacting moves every held token so wait until it frees at least half of the buffer
+    const size_t minCompaction = 1024;
+    if(!streaming || index <= firstToken) return;
+    // The last token doubles as the end of stream token so it is never dropped
+    size_t count = std::min(index - firstToken, tokens.size() - 1);
+    if(count < minCompaction || count < tokens.size() / 2) return;
+    tokens.eraseFront(count);
+    firstToken += count;
+}
+
+void TokenStream::fill() {
+    lexUntil(SIZE_MAX - 1);
+}
 
-    while(!file.eof()) {
-        file.read(str, strBuffLen);
-        tokenize_separators(str, file.gcount(), tokens);
+struct TokenChunk {
+    size_t offset;
+    size_t end;
+    TokenBuffer tokens;
+    LocalSymbolTable symbols;
+    bool stoppedEarly = false; // Hit a \0 which ends the source for the serial lexer as well
+};
+
+void lex_chunk(const SourceFile& source, TokenChunk& chunk) {
+    Token next;
+    while(lex_token(source, chunk.end, chunk.offset, next, &chunk.symbols)) {
+        chunk.tokens.push(next.token, next.offset(), next.value.length(), next.symbol);
+    }
+    chunk.stoppedEarly = chunk.offset < chunk.end;
+}
+
+// Identifier ids are chunk local until every chunk before has published its symbols
+void rebase_chunk(TokenChunk& chunk, const std::vector<SymbolId>& globalSymbols) {
+    for(size_t i = 0; i < chunk.tokens.size(); i++) {
+        if(chunk.tokens.kinds[i] == (uint8_t)EToken::IDENTIFIER) {
+            chunk.tokens.symbols[i] = globalSymbols[chunk.tokens.symbols[i] - symbol_id(Symbol::FIRST_IDENTIFIER)];
+        }
     }
+}
+
+void TokenStream::fillParallel(unsigned threadCount) {
+    // Not worth spinning up threads for less than this much source per thread
+    const size_t minChunkSize = 64 * 1024;
+    if(finished) return;
 
-    if(tokens[tokens.size()-1].token != EToken::NEWLINE) {
-        tokens.push_back({EToken::NEWLINE});
+    const char* data = source->data();
+    size_t start = sourceOffset;
+    size_t remaining = sourceEnd - start;
+    threadCount = (unsigned)std::min<size_t>(threadCount, remaining / minChunkSize);
+    if(threadCount <= 1) {
+        fill();
+        return;
     }
 
-    return tokens;
+    // Comments are the only construct that spans characters up to a newline so chunks split right after one
+    std::vector<TokenChunk> chunks;
+    size_t chunkStart = start;
+    for(unsigned i = 0; i < threadCount && chunkStart < sourceEnd; i++) {
+        size_t chunkEnd = sourceEnd;
+        if(i + 1 < threadCount) {
+            size_t target = std::max(chunkStart, start + remaining / threadCount * (i + 1));
+            auto newline = (const char*)memchr(&data[target], '\n', sourceEnd - target);
+            if(newline) chunkEnd = (newline - data) + 1;
+        }
+        TokenChunk chunk;
+        chunk.offset = chunkStart;
+        chunk.end = chunkEnd;
+        chunks.push_back(std::move(chunk));
+        chunkStart = chunkEnd;
+    }
+
+    WorkerDiagnostics diagnostics;
+    std::vector<std::thread> workers;
+    for(size_t i = 1; i < chunks.size(); i++) {
+        workers.emplace_back([&, i]() { diagnostics.run([&]() { lex_chunk(*source, chunks[i]); }); });
+    }
+    diagnostics.run([&]() { lex_chunk(*source, chunks[0]); });
+    for(auto& worker: workers) worker.join();
+    diagnostics.rethrow();
+
+    size_t usedChunks = 0;
+    while(usedChunks < chunks.size() && !chunks[usedChunks++].stoppedEarly);
+
+    std::vector<std::vector<SymbolId>> globalSymbols(usedChunks);
+    for(size_t i = 0; i < usedChunks; i++) {
+        globalSymbols[i] = chunks[i].symbols.publish();
+    }
+
+    workers.clear();
+    for(size_t i = 1; i < usedChunks; i++) {
+        workers.emplace_back(rebase_chunk, std::ref(chunks[i]), std::cref(globalSymbols[i]));
+    }
+    rebase_chunk(chunks[0], globalSymbols[0]);
+    for(auto& worker: workers) worker.join();
+
+    for(size_t i = 0; i < usedChunks; i++) {
+        tokens.append(chunks[i].tokens);
+    }
+    sourceOffset = chunks[usedChunks - 1].offset;
+    finish();
+}
+
+TokenStream tokenize(const char* fileName, bool mapSource, unsigned threadCount) {
+    TokenStream stream(mapSource ? SourceFile::map(fileName) : SourceFile::read(fileName), false);
+    if(threadCount > 1) {
+        stream.fillParallel(threadCount);
+    } else {
+        stream.fill();
+    }
+    return stream;
+}
+
+TokenStream stream_tokens(const char* fileName, bool mapSource) {
+    return TokenStream(mapSource ? SourceFile::map(fileName) : SourceFile::read(fileName), true);
 }
 
 
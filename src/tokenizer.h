@@ -3,8 +3,12 @@
 //
 #pragma once
 
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
+#include "source_file.h"
+#include "symbols.h"
 
 enum class EToken {
     UNKNOWN,
@@ -17,14 +21,87 @@ enum class EToken {
     NEWLINE
 };
 
+// Tokens are views handed out by TokenStream, the stream itself only stores the fields in a TokenBuffer
 struct Token {
-    EToken token;
-    std::string value;
-    size_t line;
-    size_t column;
-    size_t len;
+    EToken token = EToken::UNKNOWN;
+    std::string_view value; // Points into source
+    SymbolId symbol = symbol_id(Symbol::NONE); // Reserved Symbol or interned identifier, Symbol::NONE for numbers and newlines
+    const SourceFile* source = nullptr;
+
+    size_t offset() const { return value.data() - source->data(); }
+    SourceLocation location() const;
+};
+
+// Struct of arrays token storage, 11 bytes per token. Positions are offsets into the source,
+// line and column are derived from them through SourceFile::location when needed
+struct TokenBuffer {
+    std::vector<uint8_t> kinds; // EToken
+    std::vector<uint32_t> starts;
+    std::vector<uint16_t> lengths;
+    std::vector<SymbolId> symbols;
+
+    size_t size() const { return kinds.size(); }
+    void push(EToken kind, size_t start, size_t length, SymbolId symbol);
+    void append(const TokenBuffer& other);
+    void eraseFront(size_t count);
+};
+
+// Tokens only reference the source text so the stream keeps the source alive for as long as it exists.
+// A streaming TokenStream lexes lazily as the parser indexes into it and frees tokens the parser has released,
+// so only the lookahead window is held in memory. A non streaming stream keeps every token it has lexed.
+class TokenStream {
+public:
+    TokenStream() = default;
+    TokenStream(std::shared_ptr<SourceFile> source, bool streaming);
+    // Only lexes source between begin and end, begin has to be on a token boundary
+    TokenStream(std::shared_ptr<SourceFile> source, bool streaming, size_t begin, size_t end);
+
+    // Indexes are absolute token positions, reading past the end returns the final newline token
+    Token operator[](size_t index);
+    bool isEnd(size_t index);
+    // Marks every token before index as consumed, streaming streams drop them
+    void release(size_t index);
+    // Lexes the rest of the source
+    void fill();
+    // Lexes the rest of the source split into newline aligned chunks on threadCount threads
+    void fillParallel(unsigned threadCount);
+
+    std::shared_ptr<SourceFile> source;
+
+private:
+    bool lexUntil(size_t index);
+    void finish();
+
+    TokenBuffer tokens;
+    size_t firstToken = 0; // Absolute index of the first token still held in tokens
+    size_t sourceOffset = 0;
+    size_t sourceEnd = 0;
+    bool streaming = false;
+    bool finished = false;
+};
+
+// The parsers position in a TokenStream, passed by reference through the whole parse. Lookahead is relative
+// to the current token and only the cursor moves, the stream is never copied
+class TokenCursor {
+public:
+    explicit TokenCursor(TokenStream& stream, size_t offset = 0): stream(&stream), offset(offset) {}
+
+    Token peek(size_t lookahead = 0) const { return (*stream)[offset + lookahead]; }
+    bool atEnd(size_t lookahead = 0) const { return stream->isEnd(offset + lookahead); }
+    void advance(size_t count = 1) { offset += count; }
+    size_t position() const { return offset; }
+    // Lets a streaming stream drop every token before the cursor
+    void release() const { stream->release(offset); }
+
+private:
+    TokenStream* stream;
+    size_t offset;
 };
 
-std::vector<Token> tokenize(const char* source);
+// mapSource selects between memory mapping the file and reading it into a buffer, tokens are zero copy in both modes.
+// With more than one thread large sources are lexed in parallel, the resulting tokens are identical to a serial run
+TokenStream tokenize(const char* fileName, bool mapSource = true, unsigned threadCount = 1);
+// Same as tokenize but tokens are only lexed once the parser asks for them
+TokenStream stream_tokens(const char* fileName, bool mapSource = true);
 
 const char* ETokenAsStr(EToken eToken);
@@ -0,0 +1,413 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#include "vm.h"
+#include "array.h"
+#include "diagnostics.h"
+#include "jit.h"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+
+// Computed goto jumps straight from one handler to the next through a label table, every handler gets its own
+// indirect branch for the predictor. Compilers without labels as values (MSVC) use the switch loop
+#if defined(__GNUC__) && !defined(HLANG_SWITCH_DISPATCH)
+#define HLANG_COMPUTED_GOTO 1
+#else
+#define HLANG_COMPUTED_GOTO 0
+#endif
+
+#if HLANG_COMPUTED_GOTO
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() { instruction = pc++; goto *dispatchTable[instruction->op]; }
+#else
+#define VM_CASE(name) case Opcode::name:
+#define VM_NEXT() break
+#endif
+
+// Windows of every active call, the top level code's window at 0 holds the globals
+thread_local std::vector<Value> registers;
+thread_local uint32_t globalCount = 0;
+thread_local JitRuntime jitRuntime;
+
+constexpr size_t maxRegisters = 1 << 26;
+
+// Makes room for count registers from base on, moving base and globals along when the register file moves
+void reserve_registers(size_t count, Value*& base, Value*& globals) {
+    size_t baseOffset = base - registers.data();
+    if(baseOffset + count <= registers.size()) return;
+    if(baseOffset + count > maxRegisters) hlang_error("Stack overflow");
+    registers.resize(std::max(registers.size() * 2, baseOffset + count));
+    jitRuntime.registers = registers.data();
+    jitRuntime.registerBytes = registers.size() * sizeof(Value);
+    base = registers.data() + baseOffset;
+    globals = registers.data();
+}
+
+// Tiered execution. Every function starts out interpreted, calls and backward jumps count towards hotThreshold and a
+// function that reaches it is compiled to native code, which its following calls and loop iterations run. Native code
+// deoptimizes by handing its window and pc back to the interpreter, which finishes the call.
+struct FunctionTier {
+    uint32_t counter = 0;
+    std::unique_ptr<JitCode> code;
+};
+
+thread_local bool jitEnabled = false;
+thread_local uint32_t hotThreshold = 1000;
+thread_local BytecodeProgram* runningProgram = nullptr;
+thread_local std::vector<FunctionTier> tiers; // Per function of runningProgram, empty when the JIT is off
+thread_local std::vector<JitEntry> entries; // jitRuntime.entries
+thread_local std::vector<uint64_t> loopIterations; // jitRuntime.loopIterations, per function of runningProgram
+// Errors can not unwind through native code, the call handler keeps them here for run_native to rethrow
+thread_local std::exception_ptr nativeError;
+
+void set_vm_jit(bool enabled, uint32_t threshold) {
+    jitEnabled = enabled;
+    hotThreshold = std::max<uint32_t>(threshold, 1);
+}
+
+uint64_t vm_loop_iterations(uint32_t function) {
+    return function < loopIterations.size() ? loopIterations[function] : 0;
+}
+
+uint32_t vm_jit_compiled_count() {
+    uint32_t count = 0;
+    for(auto& tier: tiers) {
+        if(tier.code) count++;
+    }
+    return count;
+}
+
+// Counts a call or backward jump into function, returns its native code once it is hot and may be entered
+static JitEntry tier_up(uint32_t function);
+// Counts a backward jump in function, returns its loop entry once it is hot
+static JitEntry loop_tier_up(uint32_t function);
+static uint64_t run_native(JitEntry entry, size_t window);
+static void run_array_instruction(Value* base, const Instruction* instruction);
+static void execute(BytecodeProgram& program, const BytecodeFunction* function, const Instruction* pc, size_t window);
+
+struct CallFrame {
+    const BytecodeFunction* function;
+    const Instruction* returnPc;
+    size_t base;
+};
+
+void run_bytecode(BytecodeProgram& program) {
+    const BytecodeFunction* function = &program.functions[0];
+    registers.assign(std::max<size_t>(function->registerCount, 1 << 12), Value());
+    globalCount = program.globalCount;
+    runningProgram = &program;
+    tiers.clear();
+    entries.clear();
+    loopIterations.assign(program.functions.size(), 0);
+    if(jitEnabled && jit_supported()) {
+        tiers.resize(program.functions.size());
+        entries.resize(program.functions.size(), nullptr);
+    }
+    jitRuntime.registers = registers.data();
+    jitRuntime.registerBytes = registers.size() * sizeof(Value);
+    jitRuntime.entries = entries.data();
+    jitRuntime.loopIterations = loopIterations.data();
+    jitRuntime.depth = 0;
+    reset_arrays();
+    execute(program, function, function->code.data(), 0);
+}
+
+// Runs function from pc in the window at register window until it returns
+static void execute(BytecodeProgram& program, const BytecodeFunction* function, const Instruction* pc, size_t window) {
+    std::vector<CallFrame> calls;
+    Value* base = registers.data() + window;
+    Value* globals = registers.data();
+    const Instruction* instruction;
+
+#if HLANG_COMPUTED_GOTO
+#define OPERATOR_LABELS(prefix, suffix) &&prefix##ADD##suffix, &&prefix##MUL##suffix, &&prefix##DIV##suffix, \
+        &&prefix##SUB##suffix, &&prefix##EQUALS##suffix, &&prefix##LESS_EQUALS##suffix, &&prefix##LARGER_EQUALS##suffix, \
+        &&prefix##LESS_THAN##suffix, &&prefix##LARGER_THAN##suffix, &&prefix##NOT_EQUALS##suffix
+#define COMPARISON_LABELS(prefix, suffix) &&prefix##EQUALS##suffix, &&prefix##LESS_EQUALS##suffix, \
+        &&prefix##LARGER_EQUALS##suffix, &&prefix##LESS_THAN##suffix, &&prefix##LARGER_THAN##suffix, &&prefix##NOT_EQUALS##suffix
+    // Same order as Opcode
+    static const void* dispatchTable[] = {
+        &&op_LOAD_CONSTANT, &&op_MOVE, &&op_GET_GLOBAL, &&op_SET_GLOBAL,
+        OPERATOR_LABELS(op_, ),
+        OPERATOR_LABELS(op_, _CONSTANT),
+        OPERATOR_LABELS(op_GLOBAL_, _CONSTANT),
+        COMPARISON_LABELS(op_JUMP_UNLESS_, ),
+        COMPARISON_LABELS(op_JUMP_UNLESS_, _CONSTANT),
+        &&op_ARRAY_GET, &&op_ARRAY_SET, &&op_ARRAY_OP, &&op_BUILTIN,
+        &&op_JUMP, &&op_JUMP_IF_FALSE, &&op_CALL, &&op_TAIL_CALL, &&op_RETURN, &&op_RETURN_VOID
+    };
+#undef OPERATOR_LABELS
+#undef COMPARISON_LABELS
+    static_assert(sizeof(dispatchTable) / sizeof(dispatchTable[0]) == (size_t)Opcode::RETURN_VOID + 1, "Every opcode needs a handler");
+    VM_NEXT();
+#else
+    while(true) {
+        instruction = pc++;
+        switch ((Opcode)instruction->op) {
+#endif
+            VM_CASE(LOAD_CONSTANT)
+                base[instruction->a] = Value::integer((HInt)instruction->b);
+                VM_NEXT();
+            VM_CASE(MOVE)
+                base[instruction->a] = base[instruction->b];
+                VM_NEXT();
+            VM_CASE(GET_GLOBAL)
+                base[instruction->a] = globals[instruction->b];
+                VM_NEXT();
+            VM_CASE(SET_GLOBAL)
+                globals[instruction->a] = base[instruction->b];
+                VM_NEXT();
+
+// make is Value::integer or Value::boolean, the type of the result
+#define BINARY_OPCODE(opcode, make, expression) \
+            VM_CASE(opcode) { \
+                HInt left = base[instruction->b].intValue; \
+                HInt right = base[instruction->c].intValue; \
+                base[instruction->a] = Value::make(expression); \
+                VM_NEXT(); \
+            } \
+            VM_CASE(opcode##_CONSTANT) { \
+                HInt left = base[instruction->b].intValue; \
+                HInt right = (HInt)instruction->c; \
+                base[instruction->a] = Value::make(expression); \
+                VM_NEXT(); \
+            } \
+            VM_CASE(GLOBAL_##opcode##_CONSTANT) { \
+                HInt left = globals[instruction->b].intValue; \
+                HInt right = (HInt)instruction->c; \
+                globals[instruction->a] = Value::make(expression); \
+                VM_NEXT(); \
+            }
+            BINARY_OPCODE(ADD, integer, wrapping_add(left, right))
+            BINARY_OPCODE(MUL, integer, wrapping_mul(left, right))
+            BINARY_OPCODE(SUB, integer, wrapping_sub(left, right))
+            BINARY_OPCODE(EQUALS, boolean, left == right)
+            BINARY_OPCODE(LESS_EQUALS, boolean, left <= right)
+            BINARY_OPCODE(LARGER_EQUALS, boolean, left >= right)
+            BINARY_OPCODE(LESS_THAN, boolean, left < right)
+            BINARY_OPCODE(LARGER_THAN, boolean, left > right)
+            BINARY_OPCODE(NOT_EQUALS, boolean, left != right)
+            BINARY_OPCODE(DIV, integer, checked_div(left, right))
+#undef BINARY_OPCODE
+
+#define BRANCH_OPCODE(opcode, comparison) \
+            VM_CASE(JUMP_UNLESS_##opcode) \
+                if(!(base[instruction->a].intValue comparison base[instruction->c].intValue)) pc = function->code.data() + instruction->b; \
+                VM_NEXT(); \
+            VM_CASE(JUMP_UNLESS_##opcode##_CONSTANT) \
+                if(!(base[instruction->a].intValue comparison (HInt)instruction->c)) pc = function->code.data() + instruction->b; \
+                VM_NEXT();
+            BRANCH_OPCODE(EQUALS, ==)
+            BRANCH_OPCODE(LESS_EQUALS, <=)
+            BRANCH_OPCODE(LARGER_EQUALS, >=)
+            BRANCH_OPCODE(LESS_THAN, <)
+            BRANCH_OPCODE(LARGER_THAN, >)
+            BRANCH_OPCODE(NOT_EQUALS, !=)
+#undef BRANCH_OPCODE
+
+            VM_CASE(ARRAY_GET)
+            VM_CASE(ARRAY_SET)
+            VM_CASE(ARRAY_OP)
+            VM_CASE(BUILTIN)
+                run_array_instruction(base, instruction);
+                VM_NEXT();
+
+// Back to the caller, the result is in base[0]
+#define RETURN_TO_CALLER() \
+                if(calls.empty()) return; \
+                function = calls.back().function; \
+                pc = calls.back().returnPc; \
+                base = registers.data() + calls.back().base; \
+                calls.pop_back(); \
+                VM_NEXT();
+
+            VM_CASE(JUMP)
+                pc = function->code.data() + instruction->b;
+                if(pc <= instruction) {
+                    // The back-edge of a loop. Iterations count like calls, once the function is compiled the loop
+                    // goes on in native code from its header with the window as it is
+                    uint32_t index = (uint32_t)(function - program.functions.data());
+                    loopIterations[index]++;
+                    if(!tiers.empty()) {
+                        if(JitEntry entry = loop_tier_up(index)) {
+                            size_t window = base - registers.data();
+                            jitRuntime.loopEntry = instruction->b;
+                            uint64_t status = run_native(entry, window);
+                            base = registers.data() + window;
+                            globals = registers.data();
+                            if(status == JIT_RETURNED) {
+                                RETURN_TO_CALLER()
+                            }
+                            pc = function->code.data() + status - JIT_DEOPTIMIZED;
+                        }
+                    }
+                }
+                VM_NEXT();
+            VM_CASE(JUMP_IF_FALSE)
+                if(base[instruction->a].intValue == 0) pc = function->code.data() + instruction->b;
+                VM_NEXT();
+
+            VM_CASE(CALL) {
+                const BytecodeFunction* callee = &program.functions[instruction->b];
+                if(!callee->compiled) compileBytecodeFunction(program, instruction->b);
+                reserve_registers(instruction->a + callee->registerCount, base, globals);
+                size_t callerWindow = base - registers.data();
+                const Instruction* calleePc = callee->code.data();
+                if(!tiers.empty()) {
+                    if(JitEntry entry = tier_up(instruction->b)) {
+                        uint64_t status = run_native(entry, callerWindow + instruction->a);
+                        base = registers.data() + callerWindow;
+                        globals = registers.data();
+                        if(status == JIT_RETURNED) VM_NEXT();
+                        // Deoptimized, the callee goes on here from where the native code left it
+                        calleePc += status - JIT_DEOPTIMIZED;
+                    }
+                }
+                calls.push_back({function, pc, callerWindow});
+                function = callee;
+                pc = calleePc;
+                base += instruction->a;
+                VM_NEXT();
+            }
+            VM_CASE(TAIL_CALL) {
+                // The caller's window is reused, no call frame is pushed so tail recursion runs in constant space
+                const BytecodeFunction* callee = &program.functions[instruction->b];
+                if(!callee->compiled) compileBytecodeFunction(program, instruction->b);
+                reserve_registers(std::max<size_t>(callee->registerCount, instruction->a + instruction->c), base, globals);
+                memmove(base, base + instruction->a, instruction->c * sizeof(Value));
+                function = callee;
+                pc = callee->code.data();
+                if(!tiers.empty()) {
+                    if(JitEntry entry = tier_up(instruction->b)) {
+                        size_t calleeWindow = base - registers.data();
+                        uint64_t status = run_native(entry, calleeWindow);
+                        base = registers.data() + calleeWindow;
+                        globals = registers.data();
+                        if(status == JIT_RETURNED) {
+                            RETURN_TO_CALLER()
+                        }
+                        pc += status - JIT_DEOPTIMIZED;
+                    }
+                }
+                VM_NEXT();
+            }
+            VM_CASE(RETURN)
+            VM_CASE(RETURN_VOID)
+                // The result goes to the first register of the window, the caller's call register. The window of the
+                // top level code is the global frame
+                if(base != globals) base[0] = (Opcode)instruction->op == Opcode::RETURN ? base[instruction->a] : Value();
+                RETURN_TO_CALLER()
+#undef RETURN_TO_CALLER
+#if !HLANG_COMPUTED_GOTO
+        }
+    }
+#endif
+}
+
+// CALL from native code that it could not make directly. The callee runs to completion in here, natively once it is hot
+// or in a nested interpreter loop, which also finishes calls whose native code deoptimized
+static uint64_t native_call(size_t window, uint32_t functionIndex, uint64_t resume) {
+    try {
+        const BytecodeFunction* callee = &runningProgram->functions[functionIndex];
+        if(!callee->compiled) compileBytecodeFunction(*runningProgram, functionIndex);
+        size_t calleeWindow = window / sizeof(Value);
+        const Instruction* pc = callee->code.data();
+        if(resume != 0) {
+            execute(*runningProgram, callee, pc + resume - JIT_DEOPTIMIZED, calleeWindow);
+            return JIT_RETURNED;
+        }
+        Value* base = registers.data() + calleeWindow;
+        Value* globals = registers.data();
+        reserve_registers(callee->registerCount, base, globals);
+        if(JitEntry entry = tier_up(functionIndex)) {
+            uint64_t status = run_native(entry, calleeWindow);
+            if(status == JIT_RETURNED) return JIT_RETURNED;
+            pc += status - JIT_DEOPTIMIZED;
+        }
+        execute(*runningProgram, callee, pc, calleeWindow);
+        return JIT_RETURNED;
+    } catch (...) {
+        nativeError = std::current_exception();
+        return JIT_FAILED;
+    }
+}
+
+// Array instructions work on the window they are in and never move the register file, native code and the VM share this
+static void run_array_instruction(Value* base, const Instruction* instruction) {
+    switch ((Opcode)instruction->op) {
+        case Opcode::ARRAY_GET:
+            base[instruction->a] = Value::integer(array_get(base[instruction->b].intValue, base[instruction->c].intValue));
+            break;
+        case Opcode::ARRAY_SET:
+            array_set(base[instruction->a].intValue, base[instruction->b].intValue, base[instruction->c].intValue);
+            break;
+        case Opcode::ARRAY_OP: {
+            uint32_t packed = instruction->c;
+            auto op = (OperatorType)((uint32_t)OperatorType::ADD + ((packed >> arrayOpShift) & 0xF));
+            base[instruction->a] = Value::array(array_binary(op, base[instruction->b].intValue, (packed >> arrayOpLeftShift) & 3,
+                                                             base[packed & arrayOpRegister].intValue, (packed >> arrayOpRightShift) & 3));
+            break;
+        }
+        case Opcode::BUILTIN: {
+            auto builtin = (Builtin)instruction->b;
+            HInt arguments[3];
+            for(uint32_t i = 0; i < builtin_arity(builtin); i++) arguments[i] = base[instruction->a + i].intValue;
+            HInt result = run_builtin(builtin, arguments, instruction->c);
+            bool makesArray = builtin == Builtin::INT_ARRAY || builtin == Builtin::BOOL_ARRAY || builtin == Builtin::SELECT;
+            base[instruction->a] = makesArray ? Value::array(result) : Value::integer(result);
+            break;
+        }
+        default:
+            hlang_error("Not an array instruction");
+    }
+}
+
+// Array instruction from native code, errors are kept like the call handler keeps them
+static uint64_t native_instruction(size_t window, const Instruction* instruction) {
+    try {
+        run_array_instruction(registers.data() + window / sizeof(Value), instruction);
+        return JIT_RETURNED;
+    } catch (...) {
+        nativeError = std::current_exception();
+        return JIT_FAILED;
+    }
+}
+
+static JitEntry tier_up(uint32_t function) {
+    FunctionTier& tier = tiers[function];
+    if(!tier.code && ++tier.counter == hotThreshold) {
+        tier.code = JitCode::compile(*runningProgram, function, native_call, native_instruction);
+        if(tier.code) entries[function] = tier.code->entry();
+    }
+    return jitRuntime.depth < maxJitDepth ? entries[function] : nullptr;
+}
+
+static JitEntry loop_tier_up(uint32_t function) {
+    tier_up(function);
+    JitCode* code = tiers[function].code.get();
+    return code && jitRuntime.depth < maxJitDepth ? code->loopEntry() : nullptr;
+}
+
+// Returns JIT_RETURNED or the deoptimization status, errors raised under the native code are rethrown
+static uint64_t run_native(JitEntry entry, size_t window) {
+    jitRuntime.depth++;
+    uint64_t status = entry(window * sizeof(Value), &jitRuntime);
+    jitRuntime.depth--;
+    if(status == JIT_FAILED) {
+        std::exception_ptr error = nativeError;
+        nativeError = nullptr;
+        std::rethrow_exception(error);
+    }
+    return status;
+}
+
+const char* vm_dispatch_name() {
+    return HLANG_COMPUTED_GOTO ? "computed goto" : "switch";
+}
+
+bool read_bytecode_global(uint32_t slot, HInt& value) {
+    if(slot >= globalCount || slot >= registers.size()) return false;
+    value = registers[slot].asInt();
+    return true;
+}
@@ -0,0 +1,22 @@
+//
+// Created by idrol on 17/10/2026.
+//
+#pragma once
+
+#include "bytecode.h"
+
+// Runs program on this thread's register file, compiling functions left for their first call when they are called.
+// Errors go through hlang_error
+void run_bytecode(BytecodeProgram& program);
+// Global slot of the last program run on this thread, valid until the next run. False when the slot does not exist
+bool read_bytecode_global(uint32_t slot, HInt& value);
+// "computed goto" or "switch", whichever loop this build dispatches with
+const char* vm_dispatch_name();
+// Tiered execution for the following runs on this thread: functions are interpreted until hotThreshold calls or
+// backward jumps, then compiled to native code. Builds without a native code generator keep interpreting
+void set_vm_jit(bool enabled, uint32_t hotThreshold = 1000);
+// Functions the last run on this thread compiled to native code
+uint32_t vm_jit_compiled_count();
+// Loop iterations the last run on this thread made in program.functions[function], interpreted and native ones.
+// Backward jumps also count towards compiling the function, a loop that gets hot finishes in native code
+uint64_t vm_loop_iterations(uint32_t function);